@@ -44,6 +44,7 @@
  * EXTERNAL VARIABLES
  *******************************************************************/
 EXTERN_CVAR(Bool, archive_load_data)
+EXTERN_CVAR(Int, compression_threads)
 
 
 /*******************************************************************
@@ -151,10 +152,12 @@ bool ADatArchive::open(MemChunk& mc)
 		// Create directory if needed
 		ArchiveTreeNode* dir = createDir(fn.GetPath(true, wxPATH_UNIX));
 
-		// Create entry
-		ArchiveEntry* entry = new ArchiveEntry(fn.GetFullName(), compsize);
-		entry->exProp("Offset") = (int)offset;
-		entry->exProp("FullSize") = (int)decsize;
+		// Create entry. If the compressed data can be read from the source
+		// data, it is inflated when the entry data is first needed
+		bool lazy = (!archive_load_data && data_source && compsize > 0);
+		ArchiveEntry* entry = new ArchiveEntry(fn.GetFullName(), lazy ? decsize : compsize);
+		entry->setOffset(offset);
+		entry->setFullSize(decsize);
 		entry->setLoaded(false);
 		entry->setState(0);
 
@@ -162,16 +165,26 @@ bool ADatArchive::open(MemChunk& mc)
 		dir->addEntry(entry);
 	}
 
-	// Detect all entry types
+	// Entry data is inflated on demand, the entry types are detected
+	// when the entries are opened
+	if (!archive_load_data && data_source)
+	{
+		setMuted(false);
+		setModified(false);
+		announce("opened");
+
+		theSplashWindow->setProgressMessage("");
+
+		return true;
+	}
+
+	// Read all entry data
 	MemChunk edata;
 	vector<ArchiveEntry*> all_entries;
 	getEntryTreeAsList(all_entries);
 	theSplashWindow->setProgressMessage("Detecting entry types");
 	for (size_t a = 0; a < all_entries.size(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_entries)));
-
 		// Get entry
 		ArchiveEntry* entry = all_entries[a];
 
@@ -179,9 +192,9 @@ bool ADatArchive::open(MemChunk& mc)
 		if (entry->getSize() > 0)
 		{
 			// Read the entry data
-			mc.exportMemChunk(edata, (int)entry->exProp("Offset"), entry->getSize());
+			mc.exportMemChunk(edata, entry->getOffset(), entry->getSize());
 			MemChunk xdata;
-			if (Compression::ZlibInflate(edata, xdata, (int)entry->exProp("FullSize")))
+			if (Compression::ZlibInflate(edata, xdata, entry->getFullSize()))
 				entry->importMemChunk(xdata);
 			else
 			{
@@ -189,9 +202,14 @@ bool ADatArchive::open(MemChunk& mc)
 				entry->importMemChunk(edata);
 			}
 		}
+	}
+
+	// Detect all entry types
+	EntryType::detectEntryTypes(all_entries);
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
 
 		// Unload entry data if needed
 		if (!archive_load_data)
@@ -246,7 +264,7 @@ bool ADatArchive::write(MemChunk& mc, bool update)
 
 		// Create compressed version of the lump
 		MemChunk* entry = NULL;
-		if (Compression::ZlibDeflate(entries[a]->getMCData(), compressed, 9))
+		if (Compression::ZlibDeflate(entries[a]->getMCData(), compressed, 9, compression_threads))
 		{
 			entry = &compressed;
 		}
@@ -261,7 +279,7 @@ bool ADatArchive::write(MemChunk& mc, bool update)
 		if (update)
 		{
 			entries[a]->setState(0);
-			entries[a]->exProp("Offset") = (int)offset;
+			entries[a]->setOffset(offset);
 		}
 
 		///////////////////////////////////
@@ -325,20 +343,6 @@ bool ADatArchive::write(MemChunk& mc, bool update)
 	return true;
 }
 
-/* ADatArchive::write
- * Writes the dat archive to a file
- * Returns true if successful, false otherwise
- *******************************************************************/
-bool ADatArchive::write(string filename, bool update)
-{
-	// Write to a MemChunk, then export it to a file
-	MemChunk mc;
-	if (write(mc, true))
-		return mc.exportFile(filename);
-	else
-		return false;
-}
-
 /* ADatArchive::loadEntryData
  * Loads an entry's data from the dat file
  * Returns true if successful, false otherwise
@@ -357,24 +361,31 @@ bool ADatArchive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
-	// Open archive file
-	wxFile file(filename);
-
-	// Check it opened
-	if (!file.IsOpened())
+	// Get the compressed data from the source data. The compressed size
+	// isn't kept, but the zlib stream ends itself so just give it the
+	// rest of the source data
+	MemChunk cdata;
+	if (!getSourceData(cdata, entry->getOffset(), 0))
 	{
-		wxLogMessage("ADatArchive::loadEntryData: Unable to open archive file %s", CHR(filename));
+		wxLogMessage("ADatArchive::loadEntryData: No dat data to read entry %s from", CHR(entry->getName()));
 		return false;
 	}
 
-	// Seek to entry offset in file and read it in
-	file.Seek((int)entry->exProp("Offset"), wxFromStart);
-	entry->importFileStream(file, entry->getSize());
-
-	// Set the lump to loaded
-	entry->setLoaded();
+	// Inflate to a new block of memory and let the entry view that
+	uint32_t size = entry->getSize();
+	uint8_t* buf = new uint8_t[size];
+	if (!Compression::ZlibInflate(cdata.getData(), cdata.getSize(), buf, size))
+	{
+		wxLogMessage("ADatArchive::loadEntryData: Entry %s couldn't be inflated", CHR(entry->getName()));
+		delete[] buf;
+		return false;
+	}
+	MemBlock* block = MemBlock::fromData(buf, size);
+	MemChunk mc;
+	mc.importBlock(block);
+	block->release();
 
-	return true;
+	return readEntryData(entry, mc, 0);
 }
 
 /* ADatArchive::detectNamespace
@@ -32,8 +32,18 @@
 #include "MainApp.h"
 #include "Misc.h"
 #include "UndoRedo.h"
+#include "EntryTypeCache.h"
+#include "EntryTypeDetector.h"
+#include "ArchiveSearchIndex.h"
+#include "ArchiveManager.h"
+#include "ThreadPool.h"
 #include <wx/filename.h>
 #include <wx/dir.h>
+#include <wx/file.h>
+#include <wx/wfstream.h>
+#include <wx/stopwatch.h>
+#include <algorithm>
+#include <set>
 
 /* Archive Directory Layout:
  * ---------------------
@@ -55,6 +65,87 @@
  * VARIABLES
  *******************************************************************/
 CVAR(Bool, archive_load_data, false, CVAR_SAVE)
+CVAR(Bool, archive_map_files, true, CVAR_SAVE)
+CVAR(Bool, archive_type_cache, true, CVAR_SAVE)
+CVAR(Bool, archive_detect_background, true, CVAR_SAVE)
+
+const int ArchiveEvent::MODIFIED = Announcer::eventId("modified");
+const int ArchiveEvent::SAVED = Announcer::eventId("saved");
+const int ArchiveEvent::CLOSING = Announcer::eventId("closing");
+const int ArchiveEvent::CLOSED = Announcer::eventId("closed");
+const int ArchiveEvent::ENTRY_STATE_CHANGED = Announcer::eventId("entry_state_changed");
+const int ArchiveEvent::ENTRIES_CHANGED = Announcer::eventId("entries_changed");
+const int ArchiveEvent::ENTRY_TYPES_DETECTED = Announcer::eventId("entry_types_detected");
+const int ArchiveEvent::ENTRY_TYPES_UPDATED = Announcer::eventId("entry_types_updated");
+const int ArchiveEvent::DIRECTORY_ADDED = Announcer::eventId("directory_added");
+const int ArchiveEvent::DIRECTORY_MODIFIED = Announcer::eventId("directory_modified");
+const int ArchiveEvent::ENTRY_ADDED = Announcer::eventId("entry_added");
+const int ArchiveEvent::ENTRY_REMOVING = Announcer::eventId("entry_removing");
+const int ArchiveEvent::ENTRY_REMOVED = Announcer::eventId("entry_removed");
+const int ArchiveEvent::ENTRIES_SWAPPED = Announcer::eventId("entries_swapped");
+const int ArchiveEvent::ENTRY_RENAMING = Announcer::eventId("entry_renaming");
+
+
+/*******************************************************************
+ * READFILESJOB CLASS
+ *******************************************************************
+ * Reads a list of files into memory on multiple threads
+ */
+class ReadFilesJob : public ThreadPool::Job
+{
+public:
+	wxArrayString&		files;
+	vector<MemChunk>	data;
+	vector<uint8_t>		ok;		// Not vector<bool>, it is written from multiple threads
+
+	ReadFilesJob(wxArrayString& files) : files(files)
+	{
+		data.resize(files.size());
+		ok.resize(files.size(), 0);
+	}
+
+	void process(unsigned index)
+	{
+		wxFile file(files[index]);
+		if (file.IsOpened())
+			ok[index] = data[index].importFileStream(file) ? 1 : 0;
+	}
+};
+
+
+/*******************************************************************
+ * FUNCTIONS
+ *******************************************************************/
+
+/* treeOrderKey
+ * Returns a key for [entry] that sorts entries in the same order a
+ * recursive search of the archive finds them (each directory's
+ * entries first, then its subdirectories)
+ *******************************************************************/
+static vector<unsigned> treeOrderKey(ArchiveEntry* entry)
+{
+	vector<unsigned> key;
+	ArchiveTreeNode* dir = entry->getParentDir();
+	key.push_back(dir->entryIndex(entry));
+
+	// Subdirectories sort after all entries
+	while (dir->getParent())
+	{
+		STreeNode* parent = dir->getParent();
+		for (unsigned a = 0; a < parent->nChildren(); a++)
+		{
+			if (parent->getChild(a) == dir)
+			{
+				key.push_back(0x80000000 | a);
+				break;
+			}
+		}
+		dir = (ArchiveTreeNode*)parent;
+	}
+
+	std::reverse(key.begin(), key.end());
+	return key;
+}
 
 
 /*******************************************************************
@@ -73,6 +164,7 @@ ArchiveTreeNode::ArchiveTreeNode(ArchiveTreeNode* parent) : STreeNode(parent)
 
 	// Init variables
 	archive = NULL;
+	renumber_from = 0;
 }
 
 /* ArchiveTreeNode::~ArchiveTreeNode
@@ -127,22 +219,29 @@ string ArchiveTreeNode::getName()
 
 /* ArchiveTreeNode::entryIndex
  * Returns the index of [entry] within this directory, or -1 if
- * the entry doesn't exist
+ * the entry doesn't exist. Entries keep track of their own index,
+ * which is renumbered (only as far as needed) after entries are
+ * added or removed anywhere but the end of the directory
  *******************************************************************/
 int ArchiveTreeNode::entryIndex(ArchiveEntry* entry)
 {
-	// Check entry was given
-	if (!entry)
+	// Check entry is in this directory
+	if (!entry || entry->parent != this)
 		return -1;
 
-	// Search for it
-	for (unsigned a = 0; a < entries.size(); a++)
-	{
-		if (entries[a] == entry)
-			return (int)a;
-	}
+	// Check the entry's index is up to date
+	if (entry->index < entries.size() && entries[entry->index] == entry)
+		return (int)entry->index;
 
-	// Not found
+	// Renumber entries
+	for (unsigned a = renumber_from; a < entries.size(); a++)
+		entries[a]->index = a;
+	renumber_from = entries.size();
+
+	if (entry->index < entries.size() && entries[entry->index] == entry)
+		return (int)entry->index;
+
+	// Not found (eg. a directory entry)
 	return -1;
 }
 
@@ -169,16 +268,58 @@ ArchiveEntry* ArchiveTreeNode::getEntry(string name, bool cut_ext)
 	if (name == "")
 		return NULL;
 
-	// Go through entries
-	for (unsigned a = 0; a < entries.size(); a++)
+	// Look up the (non-case-sensitive) name in the index
+	EntryNameMap& index = cut_ext ? names_noext : names;
+	EntryNameMap::iterator i = index.find(name.Lower());
+	if (i == index.end() || i->second.empty())
+		return NULL;
+
+	// If more than one entry has the name, return the first one in the directory
+	vector<ArchiveEntry*>& matches = i->second;
+	if (matches.size() == 1)
+		return matches[0];
+	ArchiveEntry* first = NULL;
+	int first_index = -1;
+	for (unsigned a = 0; a < matches.size(); a++)
 	{
-		// Check for (non-case-sensitive) name match
-		if (S_CMPNOCASE(entries[a]->getName(cut_ext), name))
-			return entries[a];
+		int index = entryIndex(matches[a]);
+		if (first_index < 0 || index < first_index)
+		{
+			first = matches[a];
+			first_index = index;
+		}
 	}
 
-	// Not found
-	return NULL;
+	return first;
+}
+
+/* ArchiveTreeNode::indexEntry
+ * Adds [entry] to the name index
+ *******************************************************************/
+void ArchiveTreeNode::indexEntry(ArchiveEntry* entry)
+{
+	names[entry->getName().Lower()].push_back(entry);
+	names_noext[entry->getName(true).Lower()].push_back(entry);
+}
+
+/* ArchiveTreeNode::unindexEntry
+ * Removes [entry] from the name index
+ *******************************************************************/
+void ArchiveTreeNode::unindexEntry(ArchiveEntry* entry)
+{
+	EntryNameMap* indices[2] = { &names, &names_noext };
+	string keys[2] = { entry->getName().Lower(), entry->getName(true).Lower() };
+	for (unsigned a = 0; a < 2; a++)
+	{
+		EntryNameMap::iterator i = indices[a]->find(keys[a]);
+		if (i == indices[a]->end())
+			continue;
+
+		vector<ArchiveEntry*>& list = i->second;
+		list.erase(std::remove(list.begin(), list.end(), entry), list.end());
+		if (list.empty())
+			indices[a]->erase(i);
+	}
 }
 
 /* ArchiveTreeNode::numEntries
@@ -231,6 +372,9 @@ bool ArchiveTreeNode::addEntry(ArchiveEntry* entry, unsigned index)
 		entry->next = NULL;
 
 		// Add it to end
+		entry->index = entries.size();
+		if (renumber_from == entries.size())
+			renumber_from++;
 		entries.push_back(entry);
 	}
 	else
@@ -244,12 +388,15 @@ bool ArchiveTreeNode::addEntry(ArchiveEntry* entry, unsigned index)
 		entries[index]->prev = entry;
 		entry->next = entries[index];
 
-		// Add it at index
+		// Add it at index (entries after it need renumbering)
+		entry->index = index;
 		entries.insert(entries.begin() + index, entry);
+		renumber_from = MIN(renumber_from, index + 1);
 	}
 
 	// Set entry's parent to this node
 	entry->parent = this;
+	indexEntry(entry);
 
 	return true;
 }
@@ -265,6 +412,7 @@ bool ArchiveTreeNode::removeEntry(unsigned index)
 		return false;
 
 	// De-parent entry
+	unindexEntry(entries[index]);
 	entries[index]->parent = NULL;
 
 	// De-link entry
@@ -273,8 +421,9 @@ bool ArchiveTreeNode::removeEntry(unsigned index)
 	if (index > 0) entries[index-1]->next = getEntry(index+1);
 	if (index < entries.size()-1) entries[index+1]->prev = getEntry(index-1);
 
-	// Remove it from the entry list
+	// Remove it from the entry list (entries after it need renumbering)
 	entries.erase(entries.begin() + index);
+	renumber_from = MIN(renumber_from, index);
 
 	return true;
 }
@@ -297,6 +446,8 @@ bool ArchiveTreeNode::swapEntries(unsigned index1, unsigned index2)
 	// Swap entries
 	entries[index1] = entry2;
 	entries[index2] = entry1;
+	entry1->index = index2;
+	entry2->index = index1;
 
 	// Update links
 	linkEntries(getEntry(index1-1), entry2);
@@ -523,6 +674,14 @@ Archive::Archive(uint8_t type)
 	on_disk = false;
 	parent = NULL;
 	read_only = false;
+	data_source = NULL;
+	source_offset = 0;
+	type_cache = NULL;
+	search_index = NULL;
+	type_detector = NULL;
+	detect_background = false;
+	batch_level = 0;
+	batch_changed = false;
 
 	// Create root directory
 	dir_root = new ArchiveTreeNode();
@@ -534,10 +693,17 @@ Archive::Archive(uint8_t type)
  *******************************************************************/
 Archive::~Archive()
 {
+	finishTypeDetection(true);
 	if (dir_root)
 		delete dir_root;
 	if (parent)
 		parent->unlock();
+	if (data_source)
+		data_source->release();
+	if (type_cache)
+		delete type_cache;
+	if (search_index)
+		delete search_index;
 }
 
 /* Archive::getFilename
@@ -572,26 +738,50 @@ string Archive::getFilename(bool full)
  *******************************************************************/
 bool Archive::open(string filename)
 {
-	// Read the file into a MemChunk
+	wxStopWatch sw;
+
+	// Read the file into a MemChunk (or map it into memory if possible)
 	MemChunk mc;
-	if (!mc.importFile(filename))
+	bool read_ok = archive_map_files ? mc.importFileMapped(filename) : mc.importFile(filename);
+	if (!read_ok)
 	{
 		Global::error = "Unable to open file. Make sure it isn't in use by another program.";
 		return false;
 	}
 
+	// If the file was mapped, keep the mapping to load entry data from
+	setDataSource(mc.getBlock());
+
 	// Update filename before opening
 	string backupname = this->filename;
 	this->filename = filename;
 
 	// Load from MemChunk
+	openTypeCache(filename);
 	if (open(mc))
 	{
+		closeTypeCache(true);
 		this->on_disk = true;
+
+		// Log open time and how much entry data was kept in memory
+		vector<ArchiveEntry*> entries;
+		getEntryTreeAsList(entries);
+		uint32_t loaded = 0;
+		for (unsigned a = 0; a < entries.size(); a++)
+		{
+			if (entries[a]->isLoaded())
+				loaded += entries[a]->getSize();
+		}
+		wxLogMessage("Opened %s in %ldms (%s, %s entry data loaded)", CHR(filename), sw.Time(),
+		             data_source ? "memory mapped" : "read into memory", CHR(Misc::sizeAsString(loaded)));
+
 		return true;
 	}
 	else
 	{
+		finishTypeDetection(true);
+		closeTypeCache(false);
+		setDataSource(NULL);
 		this->filename = backupname;
 		return false;
 	}
@@ -603,16 +793,50 @@ bool Archive::open(string filename)
  *******************************************************************/
 bool Archive::open(ArchiveEntry* entry)
 {
+	if (!entry)
+		return false;
+
+	// Open directly from the entry's data, which is shared rather than
+	// copied (entry data is read as views of it where possible), and
+	// keep it to load entry data from later
+	wxStopWatch sw;
+	MemChunk& mc = entry->getMCData();
+	setDataSource(mc);
+
 	// Load from entry's data
-	if (entry && open(entry->getMCData()))
+	if (open(mc))
 	{
-		// Update variables and return success
+		// Update variables
 		parent = entry;
 		parent->lock();
+
+		// Log how much entry data is shared with the parent entry
+		vector<ArchiveEntry*> entries;
+		getEntryTreeAsList(entries);
+		uint32_t shared = 0;
+		uint32_t separate = 0;
+		for (unsigned a = 0; a < entries.size(); a++)
+		{
+			if (!entries[a]->isLoaded())
+				continue;
+
+			MemChunk& data = entries[a]->data;
+			if (data_source && data.getBlock() == data_source)
+				shared += data.getSize();
+			else
+				separate += data.getSize();
+		}
+		wxLogMessage("Opened %s in %ldms (%s entry data viewed in the parent entry's %s, %s loaded separately)",
+		             CHR(getFilename(false)), sw.Time(), CHR(Misc::sizeAsString(shared)),
+		             CHR(Misc::sizeAsString(mc.getSize())), CHR(Misc::sizeAsString(separate)));
+
 		return true;
 	}
 	else
+	{
+		setDataSource(NULL);
 		return false;
+	}
 }
 
 /* Archive::setModified
@@ -624,7 +848,7 @@ void Archive::setModified(bool modified)
 	this->modified = modified;
 
 	// Announce
-	announce("modified");
+	announce(ArchiveEvent::MODIFIED);
 }
 
 /* Archive::checkEntry
@@ -693,37 +917,77 @@ ArchiveEntry* Archive::entryAtPath(string path)
 	if (path.StartsWith("/"))
 		path.Remove(0, 1);
 
-	// Get path as wxFileName for processing
-	wxFileName fn(path);
-
 	// Get directory from path
-	ArchiveTreeNode* dir;
-	if (fn.GetPath(false, wxPATH_UNIX).IsEmpty())
-		dir = getRoot();
-	else
-		dir = getDir(fn.GetPath(true, wxPATH_UNIX));
+	ArchiveTreeNode* dir = getRoot();
+	int slash = path.Find('/', true);
+	if (slash != wxNOT_FOUND)
+		dir = getDir(path.Left(slash));
 
 	// If dir doesn't exist, return null
 	if (!dir)
 		return NULL;
 
 	// Return entry
-	return dir->getEntry(fn.GetFullName());
+	return dir->getEntry(path.Mid(slash + 1));
 }
 
 
+/* Archive::write
+ * Writes the archive to [out]. By default the archive is written to
+ * a MemChunk first, formats that can be written as a stream should
+ * override this to avoid holding the whole archive in memory
+ * Returns true if successful, false otherwise
+ *******************************************************************/
+bool Archive::write(wxOutputStream& out, bool update)
+{
+	MemChunk mc;
+	if (!write(mc, update))
+		return false;
+
+	out.Write(mc.getData(), mc.getSize());
+	return out.IsOk();
+}
+
 /* Archive::write
  * Writes the archive to a file
  * Returns true if successful, false otherwise
  *******************************************************************/
 bool Archive::write(string filename, bool update)
 {
-	// Write to a MemChunk, then export it to a file
-	MemChunk mc;
-	if (write(mc, true))
-		return mc.exportFile(filename);
-	else
+	// If the file exists, write to a temp file and replace it afterwards. Unloaded
+	// entries are copied from the current file (or its mapping) while writing
+	string outfile = filename;
+	if (wxFileExists(filename))
+		outfile = filename + ".tmp";
+
+	// Write the archive
+	bool ok = false;
+	{
+		wxFFileOutputStream out(outfile);
+		if (!out.IsOk())
+		{
+			Global::error = "Unable to open file for saving. Make sure it isn't in use by another program.";
+			return false;
+		}
+
+		ok = write(out, true) && out.Close();
+	}
+	if (!ok || (outfile != filename && !wxRenameFile(outfile, filename, true)))
+	{
+		wxRemoveFile(outfile);
 		return false;
+	}
+
+	// Entry offsets now refer to the written file, so load entry data from it
+	if (data_source)
+	{
+		MemBlock* mapping = MemBlock::mapFile(filename);
+		setDataSource(mapping);
+		if (mapping)
+			mapping->release();
+	}
+
+	return true;
 }
 
 /* Archive::save
@@ -744,11 +1008,18 @@ bool Archive::save(string filename)
 		return false;
 	}
 
+	// Entry data can't be held on to while saving
+	finishTypeDetection();
+
 	// If the archive has a parent ArchiveEntry, just write it to that
 	if (parent)
 	{
 		success = write(parent->getMCData());
 		parent->setState(1);
+
+		// Entry offsets now refer to the written data, so load entry data from it
+		if (success && data_source)
+			setDataSource(parent->getMCData());
 	}
 	else
 	{
@@ -766,8 +1037,8 @@ bool Archive::save(string filename)
 		{
 			// No filename is given, but the archive has a filename, so overwrite it (and make a backup)
 
-			// Create backup
-			if (wxFileName::FileExists(this->filename))
+			// Create backup (unless the file is updated in place, which keeps its current contents)
+			if (wxFileName::FileExists(this->filename) && !writesInPlace(this->filename))
 			{
 				string bakfile = this->filename + ".bak";
 
@@ -791,7 +1062,7 @@ bool Archive::save(string filename)
 	if (success)
 	{
 		setModified(false);
-		announce("saved");
+		announce(ArchiveEvent::SAVED);
 	}
 
 	return success;
@@ -810,8 +1081,11 @@ unsigned Archive::numEntries()
  *******************************************************************/
 void Archive::close()
 {
+	// Stop detecting entry types
+	finishTypeDetection(true);
+
 	// Announce
-	announce("closing");
+	announce(ArchiveEvent::CLOSING);
 
 	// Delete root directory
 	delete dir_root;
@@ -824,8 +1098,11 @@ void Archive::close()
 	if (parent)
 		parent->unlock();
 
+	// Release source data
+	setDataSource(NULL);
+
 	// Announce
-	announce("closed");
+	announce(ArchiveEvent::CLOSED);
 }
 
 /* Archive::entryStateChanged
@@ -844,7 +1121,8 @@ void Archive::entryStateChanged(ArchiveEntry* entry)
 	uint32_t index = entryIndex(entry);
 	mc.write(&index, sizeof(uint32_t));
 	mc.write(&ptr, sizeof(wxUIntPtr));
-	announce("entry_state_changed", mc);
+	if (!batchEntry(entry, false))
+		announce(ArchiveEvent::ENTRY_STATE_CHANGED, mc);
 
 
 	// If entry was set to unmodified, don't set the archive to modified
@@ -855,6 +1133,355 @@ void Archive::entryStateChanged(ArchiveEntry* entry)
 	setModified(true);
 }
 
+/* Archive::entryTypeChanged
+ * Called when [entry]'s type has changed (there is no announcement
+ * for this, since it happens a lot during type detection)
+ *******************************************************************/
+void Archive::entryTypeChanged(ArchiveEntry* entry)
+{
+	if (search_index)
+		search_index->entryChanged(entry);
+}
+
+/* Archive::getSearchIndex
+ * Returns the archive's entry search index, creating it if needed
+ *******************************************************************/
+ArchiveSearchIndex* Archive::getSearchIndex()
+{
+	if (!search_index)
+		search_index = new ArchiveSearchIndex(this);
+
+	return search_index;
+}
+
+/* Archive::setMuted
+ * Mutes or unmutes announcements from the archive. Since changes
+ * aren't announced while muted, the search index is rebuilt the next
+ * time it is used
+ *******************************************************************/
+void Archive::setMuted(bool muted)
+{
+	Announcer::setMuted(muted);
+
+	if (search_index)
+		search_index->invalidate();
+}
+
+/* Archive::batchEntry
+ * Adds [entry] to the current batch of announcements ([added] is true
+ * if it was just added to the archive). Returns false if there is no
+ * batch, in which case the change should be announced as usual
+ *******************************************************************/
+bool Archive::batchEntry(ArchiveEntry* entry, bool added)
+{
+	if (!isBatching())
+		return false;
+
+	batch_entries.push_back(entry);
+	if (added)
+		batch_changed = true;
+
+	return true;
+}
+
+/* Archive::beginBatch
+ * Begins a batch of changes to the archive. Until the matching
+ * endBatch, entries being added, modified or swapped aren't
+ * announced individually. Instead a single 'entries_changed'
+ * announcement is made at the end, so listeners only need to update
+ * once for a bulk operation (eg. importing or deleting many entries).
+ * 'entry_removing', 'entry_removed' and 'entry_renaming' are still
+ * announced as they happen, since listeners can't keep using an entry
+ * after it changes. Listeners should check isBatching to avoid doing
+ * anything expensive for them until the batch ends. Batches can be
+ * nested, only the outermost one is announced
+ *******************************************************************/
+void Archive::beginBatch()
+{
+	batch_level++;
+}
+
+/* Archive::endBatch
+ * Ends a batch of changes (see beginBatch). If it was the outermost
+ * batch, announces 'entries_changed', with an EntriesChangedData
+ * listing each changed entry that is still in the archive
+ *******************************************************************/
+void Archive::endBatch()
+{
+	if (batch_level == 0 || --batch_level > 0)
+		return;
+
+	// Get each changed entry that is still in the archive, once
+	EntriesChangedData changes;
+	vector<ArchiveEntry*> all_entries;
+	getEntryTreeAsList(all_entries);
+	std::set<ArchiveEntry*> remaining(all_entries.begin(), all_entries.end());
+	for (unsigned a = 0; a < batch_entries.size(); a++)
+	{
+		if (remaining.erase(batch_entries[a]))
+			changes.entries.push_back(batch_entries[a]);
+	}
+	changes.structure = batch_changed;
+	batch_entries.clear();
+	batch_changed = false;
+
+	// Announce the changes
+	MemChunk mc;
+	announce(ArchiveEvent::ENTRIES_CHANGED, mc, &changes);
+}
+
+/* Archive::setDataSource
+ * Sets the archive's source data to [source], which unloaded entry
+ * data can be read back from (see loadEntrySourceData)
+ *******************************************************************/
+void Archive::setDataSource(MemBlock* source)
+{
+	if (source)
+		source->addRef();
+	if (data_source)
+		data_source->release();
+
+	data_source = source;
+	source_offset = 0;
+}
+
+/* Archive::setDataSource
+ * Sets the archive's source data to the data in [mc], sharing it
+ * (without copying) if it isn't already. If [mc] is a view of part
+ * of a larger block (eg. an entry in a memory mapped archive), the
+ * whole block is kept and entry data is read relative to [mc]
+ *******************************************************************/
+void Archive::setDataSource(MemChunk& mc)
+{
+	MemBlock* block = mc.shareData();
+	setDataSource(block);
+	if (block)
+		source_offset = mc.getData() - block->getData();
+}
+
+/* Archive::openTypeCache
+ * Opens the entry type cache for the archive file at [filename], so
+ * that entry types can be read from it rather than detected while
+ * the archive is being opened (see EntryType::detectEntryTypes)
+ *******************************************************************/
+void Archive::openTypeCache(string filename)
+{
+	closeTypeCache(false);
+
+	// Nothing to cache if the entry types aren't loaded yet
+	if (archive_type_cache && EntryType::definitionsHash() != 0)
+		type_cache = new EntryTypeCache(filename);
+}
+
+/* Archive::closeTypeCache
+ * Closes the entry type cache, first writing any newly detected
+ * types to it if [save] is true
+ *******************************************************************/
+void Archive::closeTypeCache(bool save)
+{
+	if (!type_cache)
+		return;
+
+	if (save)
+		type_cache->save();
+	delete type_cache;
+	type_cache = NULL;
+}
+
+/* Archive::detectEntryTypes
+ * Detects the types of [entries] while the archive is being opened.
+ * If the archive is to be opened with background type detection,
+ * only entries that can't be detected in the background are detected
+ * before returning, the rest are applied by updateTypeDetection
+ *******************************************************************/
+void Archive::detectEntryTypes(vector<ArchiveEntry*>& entries)
+{
+	bool background = detect_background && archive_detect_background;
+	detect_background = false;
+	finishTypeDetection(true);
+
+	if (!background)
+	{
+		EntryType::detectEntryTypes(entries);
+		return;
+	}
+
+	// The detector saves the type cache when it's done
+	type_detector = new EntryTypeDetector(this, entries, type_cache);
+	type_cache = NULL;
+	if (!type_detector->start())
+		finishTypeDetection();
+}
+
+/* Archive::detectsInBackground
+ * Returns true if the archive being opened will detect its entry
+ * types in the background (see detectEntryTypes)
+ *******************************************************************/
+bool Archive::detectsInBackground()
+{
+	return detect_background && archive_detect_background;
+}
+
+/* Archive::updateTypeDetection
+ * Applies any entry types detected in the background since the last
+ * update. When all are applied, maps are detected again (in case any
+ * depend on the entry types) and 'entry_types_detected' is announced
+ *******************************************************************/
+void Archive::updateTypeDetection()
+{
+	if (!type_detector)
+		return;
+
+	unsigned applied = type_detector->numApplied();
+	if (type_detector->update())
+	{
+		delete type_detector;
+		type_detector = NULL;
+
+		detectMaps();
+		announce(ArchiveEvent::ENTRY_TYPES_DETECTED);
+	}
+	else if (type_detector->numApplied() > applied)
+		announce(ArchiveEvent::ENTRY_TYPES_UPDATED);
+}
+
+/* Archive::finishTypeDetection
+ * Waits for background entry type detection to finish and applies
+ * the types, or stops it without applying any more if [cancel] is
+ * true. Does nothing if types aren't being detected
+ *******************************************************************/
+void Archive::finishTypeDetection(bool cancel)
+{
+	if (!type_detector)
+		return;
+
+	if (cancel)
+	{
+		type_detector->cancel();
+		delete type_detector;
+		type_detector = NULL;
+	}
+	else
+	{
+		type_detector->wait();
+		updateTypeDetection();
+	}
+}
+
+/* Archive::readEntryData
+ * Sets [entry]'s data to a read-only view of its data at [offset] in
+ * [mc] (the data the archive is being opened from), the data is only
+ * copied if the entry is modified. Doesn't change the entry's state.
+ * Returns false if the entry data goes past the end of [mc], true
+ * otherwise
+ *******************************************************************/
+bool Archive::readEntryData(ArchiveEntry* entry, MemChunk& mc, uint32_t offset)
+{
+	// Check entry data is within mc
+	uint32_t size = entry->getSize();
+	if ((uint64_t)offset + size > mc.getSize())
+		return false;
+
+	// Nothing to read if zero-sized
+	if (size == 0)
+		return true;
+
+	// View the data
+	if (!entry->data.importView(mc, offset, size))
+		return false;
+	entry->setLoaded();
+	ArchiveManager::entryDataUsed(entry);
+
+	return true;
+}
+
+/* Archive::getSourceData
+ * Sets [mc] to a read-only view of [size] bytes at [offset] in the
+ * archive's source data (up to the end of it if [size] is 0).
+ * Returns false if there is no source data or [offset] and [size]
+ * go past the end of it
+ *******************************************************************/
+bool Archive::getSourceData(MemChunk& mc, uint32_t offset, uint32_t size)
+{
+	// Check source data
+	if (!data_source)
+		return false;
+
+	// Check the data is within the source data
+	uint64_t start = (uint64_t)source_offset + offset;
+	if (size == 0 && start < data_source->getSize())
+		size = data_source->getSize() - start;
+	if (size == 0 || start + size > data_source->getSize())
+		return false;
+
+	return mc.importBlock(data_source, start, size);
+}
+
+/* Archive::loadEntrySourceData
+ * Sets [entry]'s data to a read-only view of [offset] in the
+ * archive's source data, without changing its state or type.
+ * Returns false if there is no source data or the entry data goes
+ * past the end of it
+ *******************************************************************/
+bool Archive::loadEntrySourceData(ArchiveEntry* entry, uint32_t offset)
+{
+	// View the data
+	if (!getSourceData(entry->data, offset, entry->getSize()))
+		return false;
+	entry->setLoaded();
+
+	return true;
+}
+
+/* Archive::writeEntryData
+ * Writes [entry]'s data to [out]. If the entry isn't loaded, its
+ * data is copied from the archive's source data (or file) at
+ * [offset] without loading it, so writing doesn't need to keep the
+ * data of every entry in memory
+ * Returns false if writing failed, true otherwise
+ *******************************************************************/
+bool Archive::writeEntryData(wxOutputStream& out, ArchiveEntry* entry, uint32_t offset)
+{
+	uint32_t size = entry->getSize();
+	if (size == 0)
+		return true;
+
+	// Loaded (or encrypted, which are stored differently) entries are written as-is
+	if (entry->isLoaded() || entry->isEncrypted())
+	{
+		out.Write(entry->getData(), size);
+		return out.IsOk();
+	}
+
+	// Copy from the source data if possible
+	if (data_source && (uint64_t)source_offset + offset + size <= data_source->getSize())
+	{
+		out.Write(data_source->getData() + source_offset + offset, size);
+		return out.IsOk();
+	}
+
+	// Otherwise copy from the file, a bit at a time
+	wxFile file;
+	if (!filename.IsEmpty() && wxFileExists(filename) && file.Open(filename) &&
+	        (uint64_t)offset + size <= (uint64_t)file.Length() && file.Seek(offset) != wxInvalidOffset)
+	{
+		uint8_t buffer[65536];
+		while (size > 0)
+		{
+			uint32_t len = MIN(size, 65536);
+			if (file.Read(buffer, len) != (ssize_t)len)
+				return false;
+			out.Write(buffer, len);
+			size -= len;
+		}
+		return out.IsOk();
+	}
+
+	// Load the entry as a last resort
+	out.Write(entry->getData(), size);
+	return out.IsOk();
+}
+
 /* Archive::getEntryTreeAsList
  * Adds the directory structure starting from [start] to [list]
  *******************************************************************/
@@ -895,6 +1522,10 @@ bool Archive::paste(ArchiveTreeNode* tree, unsigned position, ArchiveTreeNode* b
 	// Set modified
 	setModified(true);
 
+	// The merge isn't announced, so the search index needs rebuilding
+	if (search_index)
+		search_index->invalidate();
+
 	// Just do a merge
 	return base->merge(tree, position);
 }
@@ -942,7 +1573,7 @@ ArchiveTreeNode* Archive::createDir(string path, ArchiveTreeNode* base)
 	MemChunk mc;
 	wxUIntPtr ptr = wxPtrToUInt(dir);
 	mc.write(&ptr, sizeof(wxUIntPtr));
-	announce("directory_added", mc);
+	announce(ArchiveEvent::DIRECTORY_ADDED, mc);
 
 	return dir;
 }
@@ -965,6 +1596,10 @@ bool Archive::removeDir(string path, ArchiveTreeNode* base)
 	if (!dir || dir == getRoot())
 		return false;
 
+	// Its entries are deleted without being announced, so finish
+	// detecting entry types first
+	finishTypeDetection();
+
 	// Remove the directory from its parent
 	if (dir->getParent())
 		dir->getParent()->removeChild(dir);
@@ -972,6 +1607,11 @@ bool Archive::removeDir(string path, ArchiveTreeNode* base)
 	// Delete the directory
 	delete dir;
 
+	// Its entries were deleted without being announced, so the search
+	// index needs rebuilding
+	if (search_index)
+		search_index->invalidate();
+
 	// Set the archive state to modified
 	setModified(true);
 
@@ -1005,7 +1645,7 @@ bool Archive::renameDir(ArchiveTreeNode* dir, string new_name)
 	MemChunk mc;
 	wxUIntPtr ptr = wxPtrToUInt(dir);
 	mc.write(&ptr, sizeof(wxUIntPtr));
-	announce("directory_modified", mc);
+	announce(ArchiveEvent::DIRECTORY_MODIFIED, mc);
 
 	// Update variables etc
 	setModified(true);
@@ -1050,7 +1690,8 @@ ArchiveEntry* Archive::addEntry(ArchiveEntry* entry, unsigned position, ArchiveT
 	wxUIntPtr ptr = wxPtrToUInt(entry);
 	mc.write(&position, sizeof(uint32_t));
 	mc.write(&ptr, sizeof(wxUIntPtr));
-	announce("entry_added", mc);
+	if (!batchEntry(entry, true))
+		announce(ArchiveEvent::ENTRY_ADDED, mc);
 
 	// Create undo step
 	if (UndoRedo::currentlyRecording())
@@ -1118,7 +1759,9 @@ bool Archive::removeEntry(ArchiveEntry* entry, bool delete_entry)
 	wxUIntPtr ptr = wxPtrToUInt(entry);
 	mc.write(&index, sizeof(int));
 	mc.write(&ptr, sizeof(wxUIntPtr));
-	announce("entry_removing", mc);
+	announce(ArchiveEvent::ENTRY_REMOVING, mc);
+	if (type_detector)
+		type_detector->entryRemoved(entry);
 
 	// Remove it from its directory
 	bool ok = dir->removeEntry(index);
@@ -1126,8 +1769,11 @@ bool Archive::removeEntry(ArchiveEntry* entry, bool delete_entry)
 	// If it was removed ok
 	if (ok)
 	{
-		// Announce removed
-		announce("entry_removed", mc);
+		// Announce removed (even during a batch, so anything showing the
+		// archive's entries can stop showing it straight away)
+		if (isBatching())
+			batch_changed = true;
+		announce(ArchiveEvent::ENTRY_REMOVED, mc);
 
 		// Delete if necessary
 		if (delete_entry)
@@ -1163,7 +1809,10 @@ bool Archive::swapEntries(unsigned index1, unsigned index2, ArchiveTreeNode* dir
 	if (dir->swapEntries(index1, index2))
 	{
 		// Announce the swap
-		announce("entries_swapped");
+		if (isBatching())
+			batch_changed = true;
+		else
+			announce(ArchiveEvent::ENTRIES_SWAPPED);
 
 		// Set modified
 		setModified(true);
@@ -1223,7 +1872,10 @@ bool Archive::swapEntries(ArchiveEntry* entry1, ArchiveEntry* entry2)
 	dir->swapEntries(i1, i2);
 
 	// Announce the swap
-	announce("entries_swapped");
+	if (isBatching())
+		batch_changed = true;
+	else
+		announce(ArchiveEvent::ENTRIES_SWAPPED);
 
 	// Set modified
 	setModified(true);
@@ -1299,7 +1951,7 @@ bool Archive::renameEntry(ArchiveEntry* entry, string name)
 	wxUIntPtr ptr = wxPtrToUInt(entry);
 	mc.write(&index, sizeof(int));
 	mc.write(&ptr, sizeof(wxUIntPtr));
-	announce("entry_renaming", mc);
+	announce(ArchiveEvent::ENTRY_RENAMING, mc);
 
 	// Create undo step
 	if (UndoRedo::currentlyRecording())
@@ -1316,7 +1968,7 @@ bool Archive::renameEntry(ArchiveEntry* entry, string name)
 
 /* Archive::importDir
  * Imports all files (including subdirectories) from [directory] into
- * the archive
+ * the archive. The files are read on multiple threads first
  *******************************************************************/
 bool Archive::importDir(string directory)
 {
@@ -1324,6 +1976,13 @@ bool Archive::importDir(string directory)
 	wxArrayString files;
 	wxDir::GetAllFiles(directory, &files);
 
+	// Read all the files
+	ReadFilesJob job(files);
+	ThreadPool::run(job, files.size());
+
+	// Announce all the new entries at once
+	beginBatch();
+
 	// Go through files
 	for (unsigned a = 0; a < files.size(); a++)
 	{
@@ -1344,12 +2003,20 @@ bool Archive::importDir(string directory)
 		ArchiveEntry* entry = addNewEntry(ename, dir->numEntries()+1, dir);
 
 		// Load data
-		entry->importFile(files[a]);
+		if (job.ok[a])
+		{
+			if (job.data[a].hasData())
+				entry->importMemChunk(job.data[a]);
+			job.data[a].clear();
+		}
+		else
+			wxLogMessage("Archive::importDir: Unable to read file %s", CHR(files[a]));
 
 		// Set unmodified
 		entry->setState(0);
 		dir->getDirEntry()->setState(0);
 	}
+	endBatch();
 
 	return true;
 }
@@ -1385,12 +2052,73 @@ bool Archive::revertEntry(ArchiveEntry* entry)
 		return false;
 }
 
+/* Archive::findIndexed
+ * Finds all entries matching the search criteria in [options] using
+ * the search index, and adds them to [matches] in the order a
+ * recursive search would find them. Returns false without searching
+ * if the index can't narrow down the entries to check (ie. there is
+ * no type, namespace or non-wildcard name to search for)
+ *******************************************************************/
+bool Archive::findIndexed(search_options_t& options, vector<ArchiveEntry*>& matches)
+{
+	// Check the index will help
+	bool literal_name = !options.match_name.IsEmpty() && !options.match_name.Contains("*") && !options.match_name.Contains("?");
+	if (!options.match_type && !literal_name && options.match_namespace.IsEmpty())
+		return false;
+
+	ArchiveTreeNode* dir = options.dir;
+	if (!dir) dir = dir_root;
+
+	// Get matching entries from the index
+	vector<ArchiveEntry*> found = getSearchIndex()->query(options.match_type, options.match_namespace, options.match_name, options.ignore_ext);
+
+	// Entries that haven't been detected yet (or couldn't be) are indexed
+	// as unknown, check those against the type the same way a linear
+	// search would
+	if (options.match_type && options.match_type != EntryType::unknownType())
+	{
+		vector<ArchiveEntry*> unknown = getSearchIndex()->query(EntryType::unknownType(), options.match_namespace, options.match_name, options.ignore_ext);
+		for (unsigned a = 0; a < unknown.size(); a++)
+		{
+			if (options.match_type->isThisType(unknown[a]))
+				found.push_back(unknown[a]);
+		}
+	}
+
+	// Keep entries within the search directory, sorted in tree order
+	vector< std::pair<vector<unsigned>, ArchiveEntry*> > sorted;
+	for (unsigned a = 0; a < found.size(); a++)
+	{
+		ArchiveTreeNode* edir = found[a]->getParentDir();
+		if (options.search_subdirs)
+		{
+			while (edir && edir != dir)
+				edir = (ArchiveTreeNode*)edir->getParent();
+		}
+		if (edir != dir)
+			continue;
+
+		sorted.push_back(std::make_pair(treeOrderKey(found[a]), found[a]));
+	}
+	std::sort(sorted.begin(), sorted.end());
+
+	for (unsigned a = 0; a < sorted.size(); a++)
+		matches.push_back(sorted[a].second);
+
+	return true;
+}
+
 /* Archive::findFirst
  * Returns the first entry matching the search criteria in [options],
  * or NULL if no matching entry was found
  *******************************************************************/
 ArchiveEntry* Archive::findFirst(search_options_t& options)
 {
+	// Use the search index if possible
+	vector<ArchiveEntry*> matches;
+	if (findIndexed(options, matches))
+		return matches.empty() ? NULL : matches.front();
+
 	// Init search variables
 	ArchiveTreeNode* dir = options.dir;
 	if (!dir) dir = dir_root;
@@ -1465,6 +2193,11 @@ ArchiveEntry* Archive::findFirst(search_options_t& options)
  *******************************************************************/
 ArchiveEntry* Archive::findLast(search_options_t& options)
 {
+	// Use the search index if possible
+	vector<ArchiveEntry*> matches;
+	if (findIndexed(options, matches))
+		return matches.empty() ? NULL : matches.back();
+
 	// Init search variables
 	ArchiveTreeNode* dir = options.dir;
 	if (!dir) dir = dir_root;
@@ -1539,10 +2272,14 @@ ArchiveEntry* Archive::findLast(search_options_t& options)
  *******************************************************************/
 vector<ArchiveEntry*> Archive::findAll(search_options_t& options)
 {
+	// Use the search index if possible
+	vector<ArchiveEntry*> ret;
+	if (findIndexed(options, ret))
+		return ret;
+
 	// Init search variables
 	ArchiveTreeNode* dir = options.dir;
 	if (!dir) dir = dir_root;
-	vector<ArchiveEntry*> ret;
 	options.match_name.MakeLower();		// Force case-insensitive
 
 	// Begin search
@@ -5,14 +5,27 @@
 #include "ArchiveEntry.h"
 #include "Tree.h"
 #include "ListenerAnnouncer.h"
+class EntryTypeCache;
+class EntryTypeDetector;
+class ArchiveSearchIndex;
+
+// Entries by (lower case) name, in no particular order
+WX_DECLARE_STRING_HASH_MAP(vector<ArchiveEntry*>, EntryNameMap);
 
 class ArchiveTreeNode : public STreeNode
 {
 	friend class Archive;
+	friend class ArchiveEntry;
 private:
 	Archive*				archive;
 	ArchiveEntry*			dir_entry;
 	vector<ArchiveEntry*>	entries;
+	EntryNameMap			names;			// Entries by name
+	EntryNameMap			names_noext;	// Entries by name without extension
+	unsigned				renumber_from;	// Entry indices from this position on need updating
+
+	void	indexEntry(ArchiveEntry* entry);
+	void	unindexEntry(ArchiveEntry* entry);
 
 protected:
 	STreeNode* createChild(string name)
@@ -78,18 +91,78 @@ enum ArchiveTypes
 	ARCHIVE_DISK,
 };
 
+// Ids of the events announced by archives (see Announcer::eventId)
+namespace ArchiveEvent
+{
+	extern const int	MODIFIED;
+	extern const int	SAVED;
+	extern const int	CLOSING;
+	extern const int	CLOSED;
+	extern const int	ENTRY_STATE_CHANGED;
+	extern const int	ENTRIES_CHANGED;
+	extern const int	ENTRY_TYPES_DETECTED;
+	extern const int	ENTRY_TYPES_UPDATED;
+	extern const int	DIRECTORY_ADDED;
+	extern const int	DIRECTORY_MODIFIED;
+	extern const int	ENTRY_ADDED;
+	extern const int	ENTRY_REMOVING;
+	extern const int	ENTRY_REMOVED;
+	extern const int	ENTRIES_SWAPPED;
+	extern const int	ENTRY_RENAMING;
+}
+
+// Typed data announced with ArchiveEvent::ENTRIES_CHANGED (see
+// Archive::endBatch)
+class EntriesChangedData : public AnnouncementData
+{
+public:
+	vector<ArchiveEntry*>	entries;	// Entries added or modified, that are still in the archive
+	bool					structure;	// True if entries were added, removed or moved around
+
+	EntriesChangedData() { structure = false; }
+};
+
 class Archive : public Announcer
 {
 private:
 	bool				modified;
 	uint8_t				type;	// See ArchiveTypes enum
 	ArchiveTreeNode*	dir_root;
+	ArchiveSearchIndex*	search_index;	// Created on the first search
+	EntryTypeDetector*	type_detector;	// Detects entry types in the background after opening
+	bool				detect_background;
+
+	// Batched announcements (see beginBatch)
+	unsigned				batch_level;
+	vector<ArchiveEntry*>	batch_entries;	// Entries added or modified during the batch
+	bool					batch_changed;	// Entries were added, removed or moved during the batch
+
+	bool	batchEntry(ArchiveEntry* entry, bool added);
 
 protected:
 	string			filename;
 	ArchiveEntry*	parent;
 	bool			on_disk;	// Specifies whether the archive exists on disk (as opposed to being newly created)
 	bool			read_only;	// If true, the archive cannot be modified
+	MemBlock*		data_source;	// The data the archive was opened from (eg. a memory mapped file), if it's kept
+	uint32_t		source_offset;	// Offset of the archive's data within data_source (if part of a larger block)
+	EntryTypeCache*	type_cache;		// Cached entry types for the file being opened, only exists while opening
+
+	void	setDataSource(MemBlock* source);
+	void	setDataSource(MemChunk& mc);
+	void	setMuted(bool muted);
+	void	openTypeCache(string filename);
+	void	closeTypeCache(bool save);
+	void	detectEntryTypes(vector<ArchiveEntry*>& entries);
+	bool	detectsInBackground();
+	bool	readEntryData(ArchiveEntry* entry, MemChunk& mc, uint32_t offset);
+	bool	getSourceData(MemChunk& mc, uint32_t offset, uint32_t size);
+	bool	loadEntrySourceData(ArchiveEntry* entry, uint32_t offset);
+	bool	writeEntryData(wxOutputStream& out, ArchiveEntry* entry, uint32_t offset);
+
+	// Returns true if writing to [filename] only adds to the file without
+	// overwriting its current contents (so no backup is needed when saving)
+	virtual bool	writesInPlace(string filename) { return false; }
 
 public:
 	struct mapdesc_t
@@ -116,9 +189,12 @@ public:
 	ArchiveEntry*		getParent() { return parent; }
 	Archive*			getParentArchive() { return (parent ? parent->getParent() : NULL); }
 	ArchiveTreeNode*	getRoot() { return dir_root; }
+	EntryTypeCache*		getTypeCache() { return type_cache; }
+	ArchiveSearchIndex*	getSearchIndex();
 	bool				isModified() { return modified; }
 	bool				isOnDisk() { return on_disk; }
 	bool				isReadOnly() { return read_only; }
+	bool				hasDataSource() { return data_source != NULL; }
 	virtual bool		isWritable() { return true; }
 
 	void	setModified(bool modified);
@@ -143,19 +219,33 @@ public:
 
 	// Writing/Saving
 	virtual bool	write(MemChunk& mc, bool update = true) = 0;	// Write to MemChunk
+	virtual bool	write(wxOutputStream& out, bool update = true);	// Write to stream
 	virtual bool	write(string filename, bool update = true);		// Write to File
 	virtual bool	save(string filename = "");						// Save archive
 
 	// Misc
 	virtual bool		loadEntryData(ArchiveEntry* entry) = 0;
+	virtual bool		getCompressedEntryData(ArchiveEntry* entry, MemChunk& data, uint16_t& method) { return false; }
 	virtual unsigned	numEntries();
 	virtual void		close();
 	void				entryStateChanged(ArchiveEntry* entry);
+	void				entryTypeChanged(ArchiveEntry* entry);
 	void				getEntryTreeAsList(vector<ArchiveEntry*>& list, ArchiveTreeNode* start = NULL);
 	bool				canSave() { return parent || on_disk; }
 	virtual bool		paste(ArchiveTreeNode* tree, unsigned position = 0xFFFFFFFF, ArchiveTreeNode* base = NULL);
 	virtual bool		importDir(string directory);
 
+	// Batched announcements
+	void	beginBatch();
+	void	endBatch();
+	bool	isBatching() { return batch_level > 0; }
+
+	// Background entry type detection
+	void	detectTypesInBackground(bool background) { detect_background = background; }
+	bool	isDetectingTypes() { return type_detector != NULL; }
+	void	updateTypeDetection();
+	void	finishTypeDetection(bool cancel = false);
+
 	// Directory stuff
 	virtual ArchiveTreeNode*	getDir(string path, ArchiveTreeNode* base = NULL);
 	virtual ArchiveTreeNode*	createDir(string path, ArchiveTreeNode* base = NULL);
@@ -206,6 +296,9 @@ public:
 	virtual ArchiveEntry*			findLast(search_options_t& options);
 	virtual vector<ArchiveEntry*>	findAll(search_options_t& options);
 	virtual vector<ArchiveEntry*>	findModifiedEntries(ArchiveTreeNode* dir = NULL);
+
+protected:
+	bool	findIndexed(search_options_t& options, vector<ArchiveEntry*>& matches);
 };
 
 // Base class for list-based archive formats
@@ -33,6 +33,7 @@
 #include "Main.h"
 #include "ArchiveEntry.h"
 #include "Archive.h"
+#include "ArchiveManager.h"
 #include "Misc.h"
 #include <wx/filename.h>
 
@@ -58,7 +59,15 @@ ArchiveEntry::ArchiveEntry(string name, uint32_t size)
 	this->reliability = 0;
 	this->next = NULL;
 	this->prev = NULL;
+	this->index = 0;
 	this->encrypted = ENC_NONE;
+	this->offset = 0;
+	this->full_size = 0;
+	this->zip_index = -1;
+	this->has_offset = false;
+	this->lru_prev = NULL;
+	this->lru_next = NULL;
+	this->lru_size = 0;
 }
 
 /* ArchiveEntry::ArchiveEntry
@@ -78,18 +87,23 @@ ArchiveEntry::ArchiveEntry(ArchiveEntry& copy)
 	this->reliability = copy.reliability;
 	this->next = NULL;
 	this->prev = NULL;
+	this->index = 0;
 	this->encrypted = copy.encrypted;
-
-	// Copy data
-	data.importMem(copy.getData(true), copy.getSize());
+	this->offset = 0;				// The copy isn't in the archive file
+	this->full_size = copy.full_size;
+	this->zip_index = -1;
+	this->has_offset = false;
+	this->lru_prev = NULL;
+	this->lru_next = NULL;
+	this->lru_size = 0;
+
+	// Share data (it will be copied if either entry is modified)
+	if (!data.importView(copy.getMCData()))
+		data.importMem(copy.getData(true), copy.getSize());
 
 	// Copy extra properties
 	copy.exProps().copyTo(ex_props);
 
-	// Clear properties that shouldn't be copied
-	ex_props.removeProperty("ZipIndex");
-	ex_props.removeProperty("Offset");
-
 	// Set entry state
 	state = 2;
 	state_locked = false;
@@ -100,6 +114,7 @@ ArchiveEntry::ArchiveEntry(ArchiveEntry& copy)
  *******************************************************************/
 ArchiveEntry::~ArchiveEntry()
 {
+	ArchiveManager::entryDataReleased(this);
 }
 
 /* ArchiveEntry::getName
@@ -111,14 +126,29 @@ string ArchiveEntry::getName(bool cut_ext)
 	if (!cut_ext)
 		return name;
 
-	// Sanitize name if it contains the \ character (possible in WAD).
-	string saname = Misc::lumpNameToFileName(name);
-
-	// cut extension through wx function
-	wxFileName fn(saname);
+	// Cut the extension, if any (a leading . isn't an extension). Entry names
+	// can contain path separators (\ is possible in wads), so this is done
+	// directly rather than through wxFileName
+	int dot = name.Find('.', true);
+	if (dot > 0)
+		return name.Left(dot);
+	else
+		return name;
+}
 
-	// Perform reverse operation and return
-	return Misc::fileNameToLumpName(fn.GetName());
+/* ArchiveEntry::setName
+ * Sets the entry name, without changing the entry state
+ *******************************************************************/
+void ArchiveEntry::setName(string name)
+{
+	// Keep the parent directory's name index up to date
+	// (directory entries aren't in it)
+	bool indexed = parent && type != EntryType::folderType();
+	if (indexed)
+		parent->unindexEntry(this);
+	this->name = name;
+	if (indexed)
+		parent->indexEntry(this);
 }
 
 /* ArchiveEntry::getParent
@@ -174,9 +204,28 @@ MemChunk& ArchiveEntry::getMCData(bool allow_load)
 		setState(0);
 	}
 
+	// Keep track of loaded data usage
+	if (allow_load && data_loaded && parent_archive)
+		ArchiveManager::entryDataUsed(this);
+
 	return data;
 }
 
+/* ArchiveEntry::setType
+ * Sets the entry type and detection reliability, without changing
+ * the entry state
+ *******************************************************************/
+void ArchiveEntry::setType(EntryType* type, int r)
+{
+	bool changed = (this->type != type);
+	this->type = type;
+	reliability = r;
+
+	// Let the parent archive know
+	if (changed && getParent())
+		getParent()->entryTypeChanged(this);
+}
+
 /* ArchiveEntry::setState
  * Sets the entry's state. Won't change state if the change would be
  * redundant (eg new->modified, unmodified->unmodified)
@@ -213,6 +262,7 @@ void ArchiveEntry::unloadData()
 
 	// Delete any data
 	data.clear();
+	ArchiveManager::entryDataReleased(this);
 
 	// Update variables etc
 	setLoaded(false);
@@ -255,7 +305,7 @@ bool ArchiveEntry::rename(string new_name)
 	}
 
 	// Update attributes
-	name = new_name;
+	setName(new_name);
 	setState(1);
 
 	return true;
@@ -294,6 +344,7 @@ void ArchiveEntry::clearData()
 
 	// Delete the data
 	data.clear();
+	ArchiveManager::entryDataReleased(this);
 
 	// Reset attributes
 	size = 0;
@@ -443,8 +494,17 @@ bool ArchiveEntry::importEntry(ArchiveEntry* entry)
 	if (!entry)
 		return false;
 
-	// Copy entry data
-	importMem(entry->getData(), entry->getSize());
+	// Share entry data (it will be copied if either entry is modified)
+	MemChunk& edata = entry->getMCData();
+	if (edata.hasData())
+	{
+		clearData();
+		data.importView(edata);
+		size = data.getSize();
+		setLoaded();
+		setType(EntryType::unknownType());
+		setState(1);
+	}
 
 	return true;
 }
@@ -20,6 +20,7 @@ class ArchiveEntry
 {
 	friend class ArchiveTreeNode;
 	friend class Archive;
+	friend class ArchiveManager;
 private:
 	// Entry Info
 	string				name;
@@ -27,7 +28,13 @@ private:
 	MemChunk			data;
 	EntryType*			type;
 	ArchiveTreeNode*	parent;
-	PropertyList		ex_props;
+	PropertyList		ex_props;		// Rarely used extra info
+
+	// Format specific info (kept out of ex_props since it's used a lot)
+	uint32_t	offset;			// Offset of the entry data in the archive file, if has_offset
+	uint32_t	full_size;		// Uncompressed size if the entry is compressed in the archive, 0 otherwise
+	int			zip_index;		// Index in the zip (or 7z) directory, -1 if none
+	bool		has_offset;
 
 	// Entry status
 	uint8_t			state;			// 0 = unmodified, 1 = modified, 2 = newly created (not saved to disk)
@@ -40,6 +47,12 @@ private:
 	int				reliability;	// The reliability of the entry's identification
 	ArchiveEntry*	next;
 	ArchiveEntry*	prev;
+	unsigned		index;			// Position in the parent directory (can be out of date, see ArchiveTreeNode::entryIndex)
+
+	// Loaded data tracking (see ArchiveManager::entryDataUsed)
+	ArchiveEntry*	lru_prev;
+	ArchiveEntry*	lru_next;
+	uint32_t		lru_size;		// Data size when last used, 0 if not tracked
 
 public:
 	ArchiveEntry(string name = "", uint32_t size = 0);
@@ -64,10 +77,19 @@ public:
 	ArchiveEntry*		nextEntry()			{ return next; }
 	ArchiveEntry*		prevEntry()			{ return prev; }
 
+	// Format specific info
+	bool		hasOffset()		{ return has_offset; }
+	uint32_t	getOffset()		{ return offset; }
+	uint32_t	getFullSize()	{ return full_size; }
+	int			getZipIndex()	{ return zip_index; }
+	void		setOffset(uint32_t offset)	{ this->offset = offset; has_offset = true; }
+	void		setFullSize(uint32_t size)	{ full_size = size; }
+	void		setZipIndex(int index)		{ zip_index = index; }
+
 	// Modifiers (won't change entry state, except setState of course :P)
-	void		setName(string name) { this->name = name; }
+	void		setName(string name);
 	void		setLoaded(bool loaded = true) { data_loaded = loaded; }
-	void		setType(EntryType* type, int r = 0) { this->type = type; reliability = r; }
+	void		setType(EntryType* type, int r = 0);
 	void		setState(uint8_t state);
 	void		setEncryption(int enc) { encrypted = enc; }
 	void		unloadData();
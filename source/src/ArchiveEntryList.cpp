@@ -687,18 +687,28 @@ void ArchiveEntryList::labelEdited(int col, int index, string new_label)
 		entry->rename(new_label);
 }
 
-/* ArchiveEntryList::onAnnouncement
+/* ArchiveEntryList::onEvent
  * Called when an announcement is recieved from the archive being
  * managed
  *******************************************************************/
-void ArchiveEntryList::onAnnouncement(Announcer* announcer, string event_name, MemChunk& event_data)
+void ArchiveEntryList::onEvent(Announcer* announcer, int event_id, MemChunk& event_data, AnnouncementData* data)
 {
-	if (announcer == archive && event_name != "closed")
+	if (announcer != archive || event_id == ArchiveEvent::CLOSED)
+		return;
+
+	// During a batch, only update the item count when an entry is removed
+	// (so the list never has more items than entries), everything else is
+	// refreshed when the batch ends
+	if (archive->isBatching())
 	{
-		// Since refreshing the list is relatively fast, just refresh it on any change
-		updateList();
-		applyFilter();
+		if (event_id == ArchiveEvent::ENTRY_REMOVED)
+			updateList();
+		return;
 	}
+
+	// Since refreshing the list is relatively fast, just refresh it on any change
+	updateList();
+	applyFilter();
 }
 
 /* ArchiveEntryList::handleAction
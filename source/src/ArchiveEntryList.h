@@ -60,7 +60,7 @@ public:
 	// Label editing
 	void	labelEdited(int col, int index, string new_label);
 
-	void	onAnnouncement(Announcer* announcer, string event_name, MemChunk& event_data);
+	void	onEvent(Announcer* announcer, int event_id, MemChunk& event_data, AnnouncementData* data);
 
 	// SAction handler
 	bool	handleAction(string id);
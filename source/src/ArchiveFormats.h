@@ -230,6 +230,18 @@ public:
 	}
 };
 
+class SevenZipDataFormat : public EntryDataFormat
+{
+public:
+	SevenZipDataFormat() : EntryDataFormat("archive_7z") {};
+	~SevenZipDataFormat() {}
+
+	int isThisFormat(MemChunk& mc)
+	{
+		return SevenZipArchive::isSevenZipArchive(mc) ? EDF_TRUE : EDF_FALSE;
+	}
+};
+
 class DiskDataFormat : public EntryDataFormat
 {
 public:
@@ -35,7 +35,9 @@
 #include "SplashWindow.h"
 #include "ResourceManager.h"
 #include "GameConfiguration.h"
+#include "Misc.h"
 #include <wx/filename.h>
+#include <wx/thread.h>
 
 
 /*******************************************************************
@@ -43,6 +45,7 @@
  *******************************************************************/
 ArchiveManager* ArchiveManager::instance = NULL;
 CVAR(Int, base_resource, -1, CVAR_SAVE)
+CVAR(Int, archive_data_budget, 512, CVAR_SAVE)	// In MB, 0 for no limit
 
 
 /*******************************************************************
@@ -58,6 +61,12 @@ ArchiveManager::ArchiveManager()
 	res_archive_open = false;
 	base_resource_archive = NULL;
 	open_silent = false;
+	data_lru_first = NULL;
+	data_lru_last = NULL;
+	data_bytes = 0;
+	data_entries = 0;
+	data_evicted = 0;
+	data_evicted_bytes = 0;
 }
 
 /* ArchiveManager::~ArchiveManager
@@ -243,6 +252,8 @@ Archive* ArchiveManager::openArchive(string filename, bool manage, bool silent)
 		new_archive = new BZip2Archive();
 	else if (TarArchive::isTarArchive(filename))
 		new_archive = new TarArchive();
+	else if (SevenZipArchive::isSevenZipArchive(filename))
+		new_archive = new SevenZipArchive();
 	else if (DiskArchive::isDiskArchive(filename))
 		new_archive = new DiskArchive();
 	else
@@ -252,6 +263,10 @@ Archive* ArchiveManager::openArchive(string filename, bool manage, bool silent)
 		return NULL;
 	}
 
+	// If it's going to be shown, its entry types can be detected after
+	// it has been opened
+	new_archive->detectTypesInBackground(manage && !silent);
+
 	// If it opened successfully, add it to the list if needed & return it,
 	// Otherwise, delete it and return NULL
 	if (new_archive->open(filename))
@@ -348,6 +363,8 @@ Archive* ArchiveManager::openArchive(ArchiveEntry* entry, bool manage, bool sile
 		new_archive = new BZip2Archive();
 	else if (TarArchive::isTarArchive(entry->getMCData()))
 		new_archive = new TarArchive();
+	else if (SevenZipArchive::isSevenZipArchive(entry->getMCData()))
+		new_archive = new SevenZipArchive();
 	else if (DiskArchive::isDiskArchive(entry->getMCData()))
 		new_archive = new DiskArchive();
 	else
@@ -564,6 +581,7 @@ string ArchiveManager::getArchiveExtensionsString()
 	string ext_grp = "*.grp;*.GRP;*.Grp;*.prg;*.PRG;*.Prg";		extensions += ext_grp + ";";
 	string ext_rff = "*.rff;*.RFF;*.Rff";						extensions += ext_rff + ";";
 	string ext_disk = "*.disk;*.DISK;*.Disk";					extensions += ext_disk+ ";";
+	string ext_7z = "*.7z;*.7Z";								extensions += ext_7z + ";";
 #ifdef __APPLE__
 	// Cocoa supports filters with file extensions only
 	string ext_wolf =	"*.wl1;*.wl3;*.wl6;"
@@ -595,6 +613,7 @@ string ArchiveManager::getArchiveExtensionsString()
 	extensions += S_FMT("|Blood Rff files (*.rff)|%s",			CHR(ext_rff));
 	extensions += S_FMT("|Wolfenstein 3D files|%s",				CHR(ext_wolf));
 	extensions += S_FMT("|Nerve Software Disk files|%s",		CHR(ext_disk));
+	extensions += S_FMT("|7-Zip files (*.7z)|%s",				CHR(ext_7z));
 
 	return extensions;
 }
@@ -1013,6 +1032,141 @@ ArchiveEntry* ArchiveManager::getBookmark(unsigned index)
 	return bookmarks[index];
 }
 
+/* ArchiveManager::updateTypeDetection
+ * Applies any entry types detected in the background to the entries
+ * of all open archives
+ *******************************************************************/
+void ArchiveManager::updateTypeDetection()
+{
+	for (unsigned a = 0; a < open_archives.size(); a++)
+	{
+		if (open_archives[a].archive->isDetectingTypes())
+			open_archives[a].archive->updateTypeDetection();
+	}
+}
+
+
+/* ArchiveManager::entryDataUsed
+ * Called when [entry]'s loaded data is used. Moves it to the front
+ * of the loaded data list, so that it is the last to be unloaded if
+ * the data budget is exceeded. Only data the entry owns is counted,
+ * views of the archive's source data aren't tracked at all.
+ * Only tracks usage from the main thread, since entry data can only
+ * be loaded from there anyway
+ *******************************************************************/
+void ArchiveManager::entryDataUsed(ArchiveEntry* entry)
+{
+	if (!instance || !wxThread::IsMain())
+		return;
+
+	ArchiveManager* am = instance;
+	MemChunk& data = entry->getMCData(false);
+	uint32_t size = data.getSize();
+
+	// Views share a block owned by the archive (a mapped file or the
+	// parent entry's data), unloading them wouldn't free anything, so
+	// don't count them against the budget
+	if (data.isView())
+		size = 0;
+
+	// Already at the front with the same size, nothing to do
+	if (entry->lru_size > 0 && entry == am->data_lru_first && entry->lru_size == size)
+		return;
+
+	am->untrackEntryData(entry);
+	if (size == 0)
+		return;
+
+	// Add to the front of the list
+	entry->lru_prev = NULL;
+	entry->lru_next = am->data_lru_first;
+	if (am->data_lru_first)
+		am->data_lru_first->lru_prev = entry;
+	else
+		am->data_lru_last = entry;
+	am->data_lru_first = entry;
+	entry->lru_size = size;
+	am->data_bytes += size;
+	am->data_entries++;
+}
+
+/* ArchiveManager::entryDataReleased
+ * Called when [entry]'s data is unloaded or cleared, or the entry
+ * is deleted
+ *******************************************************************/
+void ArchiveManager::entryDataReleased(ArchiveEntry* entry)
+{
+	// (Untracked entries can be released from any thread)
+	if (instance && entry->lru_size > 0)
+		instance->untrackEntryData(entry);
+}
+
+/* ArchiveManager::untrackEntryData
+ * Removes [entry] from the loaded data list, if it is in it
+ *******************************************************************/
+void ArchiveManager::untrackEntryData(ArchiveEntry* entry)
+{
+	if (entry->lru_size == 0)
+		return;
+
+	if (entry->lru_prev)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		data_lru_first = entry->lru_next;
+	if (entry->lru_next)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		data_lru_last = entry->lru_prev;
+
+	data_bytes -= entry->lru_size;
+	data_entries--;
+	entry->lru_prev = entry->lru_next = NULL;
+	entry->lru_size = 0;
+}
+
+/* ArchiveManager::enforceDataBudget
+ * Unloads the data of the least recently used entries until the
+ * total loaded entry data is within the archive_data_budget cvar.
+ * Only unmodified entries that can be cheaply read back from their
+ * archive's source data are unloaded, any others are dropped from
+ * the list until they are used again. This unloads data other code
+ * may still be using, so only call it when nothing else is running
+ * (eg. when the application is idle)
+ *******************************************************************/
+void ArchiveManager::enforceDataBudget()
+{
+	if (archive_data_budget <= 0)
+		return;
+
+	uint64_t budget = (uint64_t)archive_data_budget * 1024 * 1024;
+	while (data_bytes > budget && data_lru_last)
+	{
+		ArchiveEntry* entry = data_lru_last;
+		Archive* archive = entry->getParent();
+		uint32_t size = entry->lru_size;
+		untrackEntryData(entry);
+
+		// Check the data can be unloaded
+		if (!archive || !archive->hasDataSource() || entry->getState() != 0 ||
+		        entry->isLocked() || entry->isEncrypted() || !entry->isLoaded())
+			continue;
+
+		entry->unloadData();
+		data_evicted++;
+		data_evicted_bytes += size;
+	}
+}
+
+/* ArchiveManager::logDataStats
+ * Writes the loaded entry data counters to the log
+ *******************************************************************/
+void ArchiveManager::logDataStats()
+{
+	wxLogMessage("Loaded entry data: %d entries, %s (budget %dMB)", data_entries,
+	             CHR(Misc::sizeAsString(MIN(data_bytes, (uint64_t)0xFFFFFFFF))), (int)archive_data_budget);
+	wxLogMessage("Unloaded to stay within budget: %d entries, %s", data_evicted,
+	             CHR(Misc::sizeAsString(MIN(data_evicted_bytes, (uint64_t)0xFFFFFFFF))));
+}
 
 /* ArchiveManager::onAnnouncement
  * Called when an announcement is recieved from one of the archives
@@ -1069,3 +1223,15 @@ void c_open(vector<string> args)
 		theArchiveManager->openArchive(args[a]);
 }
 ConsoleCommand am_open("open", &c_open, 1, true); // Can't use the macro with this name
+
+/* Console Command - "entry_data"
+ * Shows the loaded entry data counters. Any argument also unloads
+ * data now if over budget
+ *******************************************************************/
+CONSOLE_COMMAND (entry_data, 0, true)
+{
+	if (args.size() > 0)
+		theArchiveManager->enforceDataBudget();
+
+	theArchiveManager->logDataStats();
+}
@@ -27,6 +27,16 @@ private:
 	bool					open_silent;
 	static ArchiveManager*	instance;
 
+	// Loaded entry data, most recently used first (see entryDataUsed)
+	ArchiveEntry*	data_lru_first;
+	ArchiveEntry*	data_lru_last;
+	uint64_t		data_bytes;
+	unsigned		data_entries;
+	unsigned		data_evicted;
+	uint64_t		data_evicted_bytes;
+
+	void	untrackEntryData(ArchiveEntry* entry);
+
 public:
 	ArchiveManager();
 	~ArchiveManager();
@@ -97,6 +107,15 @@ public:
 	ArchiveEntry*	getBookmark(unsigned index);
 	unsigned		numBookmarks() { return bookmarks.size(); }
 
+	// Background entry type detection
+	void	updateTypeDetection();
+
+	// Entry data memory budget
+	static void	entryDataUsed(ArchiveEntry* entry);
+	static void	entryDataReleased(ArchiveEntry* entry);
+	void		enforceDataBudget();
+	void		logDataStats();
+
 	void	onAnnouncement(Announcer* announcer, string event_name, MemChunk& event_data);
 };
 
@@ -41,6 +41,8 @@
 #include "MapThing.h"
 #include "MapLine.h"
 #include "Console.h"
+#include "Misc.h"
+#include "ThreadPool.h"
 #include <map>
 
 
@@ -49,7 +51,36 @@
  *******************************************************************/
 typedef std::map<string, int> StrIntMap;
 typedef std::map<string, vector<ArchiveEntry*> > PathMap;
-typedef std::map<int, vector<ArchiveEntry*> > CRCMap;
+typedef std::map<uint32_t, vector<ArchiveEntry*> > SizeMap;
+typedef std::map<std::pair<uint32_t, uint64_t>, vector<ArchiveEntry*> > HashMap;
+
+// Maximum total size of entry data loaded at once when hashing entries
+const uint32_t DUP_HASH_BATCH = 64 * 1024 * 1024;
+
+
+/*******************************************************************
+ * HASHJOB CLASS
+ *******************************************************************/
+
+/* HashJob class
+ * Hashes the data of a range of (loaded) entries on multiple threads
+ *******************************************************************/
+class HashJob : public ThreadPool::Job
+{
+public:
+	vector<ArchiveEntry*>&	entries;
+	vector<uint64_t>&		hashes;
+	unsigned				start;
+
+	HashJob(vector<ArchiveEntry*>& entries, vector<uint64_t>& hashes, unsigned start)
+		: entries(entries), hashes(hashes), start(start) {}
+
+	void process(unsigned index)
+	{
+		MemChunk& data = entries[start + index]->getMCData(false);
+		hashes[start + index] = Misc::hash64(data.getData(), data.getSize());
+	}
+};
 
 
 /*******************************************************************
@@ -295,20 +326,22 @@ void ArchiveOperations::removeEntriesUnchangedFromIWAD(Archive* archive)
 	msg.ShowModal();
 }
 
-/* ArchiveOperations::checkDuplicateEntryContent
- * Checks [archive] for multiple entries with the same data, and
- * displays a list of the duplicate entries' names if any are found
+/* ArchiveOperations::findDuplicateEntryContent
+ * Finds all sets of entries in [archive] with identical data. Only
+ * entries with the same size as another entry are hashed, and only
+ * entries with the same hash are compared. Entry data that wasn't
+ * loaded beforehand is unloaded again once it has been checked
  *******************************************************************/
-bool ArchiveOperations::checkDuplicateEntryContent(Archive* archive)
+ArchiveOperations::dupreport_t ArchiveOperations::findDuplicateEntryContent(Archive* archive)
 {
-	CRCMap map_entries;
+	dupreport_t report;
 
 	// Get list of all entries in archive
 	vector<ArchiveEntry*> entries;
 	archive->getEntryTreeAsList(entries);
-	string dups = "";
 
-	// Go through list
+	// Group entries by size
+	SizeMap by_size;
 	for (unsigned a = 0; a < entries.size(); a++)
 	{
 		// Skip directory entries
@@ -319,40 +352,135 @@ bool ArchiveOperations::checkDuplicateEntryContent(Archive* archive)
 		if (entries[a]->getType() == EntryType::mapMarkerType() || entries[a]->getSize() == 0)
 			continue;
 
-		// Enqueue entries
-		map_entries[entries[a]->getMCData().crc()].push_back(entries[a]);
+		by_size[entries[a]->getSize()].push_back(entries[a]);
+		report.n_entries++;
 	}
 
-	// Now iterate through the dupes to list the name of the duplicated entries
-	CRCMap::iterator i = map_entries.begin();
-	while (i != map_entries.end())
+	// Only entries with the same size as another entry need hashing
+	vector<ArchiveEntry*> candidates;
+	for (SizeMap::iterator i = by_size.begin(); i != by_size.end(); i++)
 	{
 		if (i->second.size() > 1)
+			candidates.insert(candidates.end(), i->second.begin(), i->second.end());
+	}
+	report.n_hashed = candidates.size();
+
+	// Hash candidates in batches. Entry data can't be loaded from the
+	// worker threads, so each batch is loaded here first
+	vector<uint64_t> hashes(candidates.size(), 0);
+	vector<bool> was_loaded(candidates.size(), false);
+	unsigned a = 0;
+	while (a < candidates.size())
+	{
+		// Load the next batch
+		unsigned start = a;
+		uint32_t batch_size = 0;
+		while (a < candidates.size() && batch_size < DUP_HASH_BATCH)
 		{
-			string name = i->second[0]->getPath(true); name.Remove(0, 1);
-			dups += S_FMT("\n%s\t(%8x) duplicated by", CHR(name), i->first);
-			vector<ArchiveEntry*>::iterator j = i->second.begin() + 1;
-			while (j != i->second.end())
+			was_loaded[a] = candidates[a]->isLoaded();
+			batch_size += candidates[a]->getMCData().getSize();
+			a++;
+		}
+
+		// Hash it
+		HashJob job(candidates, hashes, start);
+		ThreadPool::run(job, a - start);
+
+		// Unload it
+		for (unsigned b = start; b < a; b++)
+		{
+			if (!was_loaded[b])
+				candidates[b]->unloadData();
+		}
+	}
+
+	// Group candidates by size and hash
+	HashMap by_hash;
+	for (unsigned a = 0; a < candidates.size(); a++)
+		by_hash[std::make_pair(candidates[a]->getSize(), hashes[a])].push_back(candidates[a]);
+
+	// Compare the data of entries with matching hashes
+	for (HashMap::iterator i = by_hash.begin(); i != by_hash.end(); i++)
+	{
+		vector<ArchiveEntry*> remaining = i->second;
+		while (remaining.size() > 1)
+		{
+			// Split off all entries identical to the first
+			dupgroup_t group;
+			group.size = i->first.first;
+			group.entries.push_back(remaining[0]);
+			vector<ArchiveEntry*> rest;
+
+			bool first_loaded = remaining[0]->isLoaded();
+			MemChunk& first = remaining[0]->getMCData();
+			for (unsigned b = 1; b < remaining.size(); b++)
+			{
+				bool loaded = remaining[b]->isLoaded();
+				MemChunk& data = remaining[b]->getMCData();
+				if (data.getSize() == first.getSize() && first.getSize() > 0 &&
+				        memcmp(data.getData(), first.getData(), first.getSize()) == 0)
+					group.entries.push_back(remaining[b]);
+				else
+					rest.push_back(remaining[b]);
+
+				if (!loaded)
+					remaining[b]->unloadData();
+			}
+			if (!first_loaded)
+				remaining[0]->unloadData();
+
+			if (group.entries.size() > 1)
 			{
-				name = (*j)->getPath(true); name.Remove(0, 1);
-				dups += S_FMT("\t%s", CHR(name));
-				++j;
+				report.wasted += (uint64_t)group.size * (group.entries.size() - 1);
+				report.groups.push_back(group);
 			}
+			remaining = rest;
 		}
-		++i;
 	}
 
+	return report;
+}
+
+/* ArchiveOperations::checkDuplicateEntryContent
+ * Checks [archive] for multiple entries with the same data, and
+ * displays a list of the duplicate entries' names if any are found
+ *******************************************************************/
+bool ArchiveOperations::checkDuplicateEntryContent(Archive* archive)
+{
+	dupreport_t report = findDuplicateEntryContent(archive);
+
 	// If no duplicates exist, do nothing
-	if (dups.IsEmpty())
+	if (report.groups.empty())
 	{
 		wxMessageBox("No duplicated entry data exist");
 		return false;
 	}
 
+	// List the names of the duplicated entries
+	string dups = "";
+	for (unsigned a = 0; a < report.groups.size(); a++)
+	{
+		vector<ArchiveEntry*>& group = report.groups[a].entries;
+		string name = group[0]->getPath(true); name.Remove(0, 1);
+		dups += S_FMT("\n%s\t(%s) duplicated by", CHR(name), CHR(Misc::sizeAsString(report.groups[a].size)));
+		for (unsigned b = 1; b < group.size(); b++)
+		{
+			name = group[b]->getPath(true); name.Remove(0, 1);
+			dups += S_FMT("\t%s", CHR(name));
+		}
+	}
+
+	// Get total wasted size (can go past 4gb with many large duplicates)
+	string wasted;
+	if (report.wasted > 0xFFFFFFFFULL)
+		wasted = S_FMT("%1.2fmb", (double)report.wasted / (1024*1024));
+	else
+		wasted = Misc::sizeAsString((uint32_t)report.wasted);
+
 	// Display list of duplicate entry names
 	ExtMessageDialog msg(theMainWindow, "Duplicate Entries");
 	msg.setExt(dups);
-	msg.setMessage("The following entry data are duplicated:");
+	msg.setMessage(S_FMT("The following entry data are duplicated (%s in duplicate copies):", CHR(wasted)));
 	msg.ShowModal();
 
 	return true;
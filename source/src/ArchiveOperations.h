@@ -6,9 +6,28 @@
 
 namespace ArchiveOperations
 {
+	// A set of entries with identical data
+	struct dupgroup_t
+	{
+		uint32_t				size;
+		vector<ArchiveEntry*>	entries;
+	};
+
+	// Results of findDuplicateEntryContent
+	struct dupreport_t
+	{
+		vector<dupgroup_t>	groups;
+		unsigned			n_entries;	// Number of entries checked
+		unsigned			n_hashed;	// Number of entries hashed (same size as another entry)
+		uint64_t			wasted;		// Total size of all duplicate copies
+
+		dupreport_t() { n_entries = n_hashed = wasted = 0; }
+	};
+
 	bool	removeUnusedPatches(Archive* archive);
 	bool	checkDuplicateEntryNames(Archive* archive);
 	bool	checkDuplicateEntryContent(Archive* archive);
+	dupreport_t	findDuplicateEntryContent(Archive* archive);
 	void	removeUnusedTextures(Archive* archive);
 	void	removeUnusedFlats(Archive* archive);
 	void	removeEntriesUnchangedFromIWAD(Archive* archive);
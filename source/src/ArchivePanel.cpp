@@ -358,6 +358,7 @@ void ArchivePanel::addMenus()
 		theApp->getAction("arch_check_duplicates")->addToMenu(menu_clean);
 		theApp->getAction("arch_check_duplicates2")->addToMenu(menu_clean);
 		theApp->getAction("arch_replace_maps")->addToMenu(menu_clean);
+		theApp->getAction("arch_compact")->addToMenu(menu_clean);
 		menu_archive->AppendSubMenu(menu_clean, "&Maintenance");
 	}
 	if (!menu_entry)
@@ -658,6 +659,7 @@ bool ArchivePanel::importFiles()
 
 		// Begin recording undo level
 		undo_manager->beginRecord("Import Files");
+		archive->beginBatch();
 
 		// Go through the list of files
 		bool ok = false;
@@ -685,6 +687,7 @@ bool ArchivePanel::importFiles()
 
 			if (index > 0) index++;
 		}
+		archive->endBatch();
 		theSplashWindow->hide();
 		entry_list->Show(true);
 
@@ -761,6 +764,7 @@ bool ArchivePanel::renameEntry(bool each)
 			Misc::doMassRename(names, new_name);
 
 			// Go through the list
+			archive->beginBatch();
 			for (size_t a = 0; a < selection.size(); a++)
 			{
 				ArchiveEntry* entry = selection[a];
@@ -779,6 +783,7 @@ bool ArchivePanel::renameEntry(bool each)
 					archive->renameEntry(entry, fn.GetFullName());	// Rename in archive
 				}
 			}
+			archive->endBatch();
 		}
 	}
 
@@ -849,6 +854,7 @@ bool ArchivePanel::deleteEntry(bool confirm)
 
 	// Begin recording undo level
 	undo_manager->beginRecord("Delete Entry");
+	archive->beginBatch();
 
 	// Go through the selected entries
 	for (int a = selected_entries.size() - 1; a >= 0; a--)
@@ -864,6 +870,7 @@ bool ArchivePanel::deleteEntry(bool confirm)
 		// Remove the selected directory from the archive
 		archive->removeDir(selected_dirs[a]->getName(), entry_list->getCurrentDir());
 	}
+	archive->endBatch();
 
 	// Finish recording undo level
 	undo_manager->endRecord(true);
@@ -1244,6 +1251,7 @@ bool ArchivePanel::pasteEntry()
 	// Go through all clipboard items
 	bool pasted = false;
 	undo_manager->beginRecord("Paste Entry");
+	archive->beginBatch();
 	for (unsigned a = 0; a < theClipboard->nItems(); a++)
 	{
 		// Check item type
@@ -1257,6 +1265,7 @@ bool ArchivePanel::pasteEntry()
 		if (archive->paste(clip->getTree(), index, entry_list->getCurrentDir()))
 			pasted = true;
 	}
+	archive->endBatch();
 	undo_manager->endRecord(true);
 
 	if (pasted)
@@ -2100,6 +2109,26 @@ bool ArchivePanel::handleAction(string id)
 		dlg.ShowModal();
 	}
 
+	// Archive->Maintenance->Compact
+	else if (id == "arch_compact")
+	{
+		if (archive->getType() != ARCHIVE_WAD || !archive->canSave())
+			wxMessageBox("Only saved wad archives can be compacted", "Compact");
+		else
+		{
+			saveEntryChanges();
+			WadArchive* wad = (WadArchive*)archive;
+			uint32_t unused = wad->getUnusedSpace();
+			if (wad->compact())
+			{
+				entry_list->updateList();
+				wxMessageBox(S_FMT("Reclaimed %s", CHR(Misc::sizeAsString(unused))), "Compact");
+			}
+			else
+				wxMessageBox(S_FMT("Error:\n%s", CHR(Global::error)), "Error", wxICON_ERROR);
+		}
+	}
+
 
 	// *************************************************************
 	// ENTRY MENU
@@ -0,0 +1,347 @@
+
+/*******************************************************************
+ * SLADE - It's a Doom Editor
+ * Copyright (C) 2008-2012 Simon Judd
+ *
+ * Email:       sirjuddington@gmail.com
+ * Web:         http://slade.mancubus.net
+ * Filename:    ArchiveSearchIndex.cpp
+ * Description: ArchiveSearchIndex class, indexes an archive's
+ *              entries by type, namespace and name so that entry
+ *              searches don't need to check every entry
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *******************************************************************/
+
+
+/*******************************************************************
+ * INCLUDES
+ *******************************************************************/
+#include "Main.h"
+#include "ArchiveSearchIndex.h"
+#include "Archive.h"
+
+
+/*******************************************************************
+ * FUNCTIONS
+ *******************************************************************/
+
+/* removeFromBucket
+ * Removes [entry] from the [key] set in [map], removing the set
+ * itself if it ends up empty
+ *******************************************************************/
+static void removeFromBucket(EntrySetMap& map, const string& key, ArchiveEntry* entry)
+{
+	EntrySetMap::iterator i = map.find(key);
+	if (i == map.end())
+		return;
+
+	i->second.erase(entry);
+	if (i->second.empty())
+		map.erase(i);
+}
+
+
+/*******************************************************************
+ * ARCHIVESEARCHINDEX CLASS FUNCTIONS
+ *******************************************************************/
+
+/* ArchiveSearchIndex::ArchiveSearchIndex
+ * ArchiveSearchIndex class constructor
+ *******************************************************************/
+ArchiveSearchIndex::ArchiveSearchIndex(Archive* archive)
+{
+	this->archive = archive;
+	rebuild = true;
+	ns_outdated = false;
+
+	listenTo(archive);
+}
+
+/* ArchiveSearchIndex::~ArchiveSearchIndex
+ * ArchiveSearchIndex class destructor
+ *******************************************************************/
+ArchiveSearchIndex::~ArchiveSearchIndex()
+{
+}
+
+/* ArchiveSearchIndex::addRecord
+ * Adds [entry] to the indices
+ *******************************************************************/
+void ArchiveSearchIndex::addRecord(ArchiveEntry* entry)
+{
+	record_t& rec = records[entry];
+	rec.type = entry->getType();
+	rec.name = entry->getName().Lower();
+	rec.name_noext = entry->getName(true).Lower();
+	rec.ns = archive->detectNamespace(entry).Lower();
+
+	by_type[rec.type].insert(entry);
+	by_name[rec.name].insert(entry);
+	by_name_noext[rec.name_noext].insert(entry);
+	by_namespace[rec.ns].insert(entry);
+}
+
+/* ArchiveSearchIndex::removeRecord
+ * Removes [entry] from the indices, if it is in them. [entry] is
+ * only used as a key, so it doesn't need to still exist
+ *******************************************************************/
+void ArchiveSearchIndex::removeRecord(ArchiveEntry* entry)
+{
+	std::map<ArchiveEntry*, record_t>::iterator r = records.find(entry);
+	if (r == records.end())
+		return;
+
+	record_t& rec = r->second;
+	std::map<EntryType*, EntrySet>::iterator t = by_type.find(rec.type);
+	if (t != by_type.end())
+	{
+		t->second.erase(entry);
+		if (t->second.empty())
+			by_type.erase(t);
+	}
+	removeFromBucket(by_name, rec.name, entry);
+	removeFromBucket(by_name_noext, rec.name_noext, entry);
+	removeFromBucket(by_namespace, rec.ns, entry);
+
+	records.erase(r);
+}
+
+/* ArchiveSearchIndex::addTree
+ * Adds all entries in [dir] and its subdirectories to the indices
+ *******************************************************************/
+void ArchiveSearchIndex::addTree(ArchiveTreeNode* dir)
+{
+	for (unsigned a = 0; a < dir->numEntries(); a++)
+		addRecord(dir->getEntry(a));
+
+	for (unsigned a = 0; a < dir->nChildren(); a++)
+		addTree((ArchiveTreeNode*)dir->getChild(a));
+}
+
+/* ArchiveSearchIndex::matches
+ * Returns true if the entry indexed as [rec] matches [type], [ns]
+ * and the [name] wildcard pattern (all lower case, any can be
+ * NULL/empty to ignore them)
+ *******************************************************************/
+bool ArchiveSearchIndex::matches(record_t& rec, EntryType* type, string& ns, string& name, bool ignore_ext)
+{
+	if (type && rec.type != type)
+		return false;
+
+	if (!ns.IsEmpty() && rec.ns != ns)
+		return false;
+
+	if (!name.IsEmpty())
+	{
+		if (ignore_ext)
+			return rec.name_noext.Matches(name);
+		else
+			return rec.name.Matches(name);
+	}
+
+	return true;
+}
+
+/* ArchiveSearchIndex::update
+ * Brings the indices up to date with the archive
+ *******************************************************************/
+void ArchiveSearchIndex::update()
+{
+	if (!rebuild)
+	{
+		// Reindex changed entries (that are still in the archive)
+		for (EntrySet::iterator i = pending.begin(); i != pending.end(); i++)
+		{
+			ArchiveEntry* entry = *i;
+			removeRecord(entry);
+			if (entry->getParent() == archive && entry->getParentDir()->entryIndex(entry) >= 0)
+				addRecord(entry);
+		}
+		pending.clear();
+
+		// Update entry namespaces if the archive structure changed
+		if (ns_outdated)
+		{
+			for (std::map<ArchiveEntry*, record_t>::iterator i = records.begin(); i != records.end(); i++)
+			{
+				string ns = archive->detectNamespace(i->first).Lower();
+				if (ns != i->second.ns)
+				{
+					removeFromBucket(by_namespace, i->second.ns, i->first);
+					by_namespace[ns].insert(i->first);
+					i->second.ns = ns;
+				}
+			}
+			ns_outdated = false;
+		}
+
+		// If entries were added or removed without an announcement, the
+		// indices can't be trusted any more
+		if (records.size() != archive->numEntries())
+		{
+			LOG_MESSAGE(2, "Search index for %s is out of sync, rebuilding", CHR(archive->getFilename(false)));
+			invalidate();
+		}
+	}
+
+	// Rebuild the indices from scratch
+	if (rebuild)
+	{
+		addTree(archive->getRoot());
+		rebuild = false;
+	}
+}
+
+/* ArchiveSearchIndex::invalidate
+ * Clears the indices, they will be rebuilt on the next query
+ *******************************************************************/
+void ArchiveSearchIndex::invalidate()
+{
+	records.clear();
+	by_type.clear();
+	by_name.clear();
+	by_name_noext.clear();
+	by_namespace.clear();
+	pending.clear();
+	rebuild = true;
+	ns_outdated = false;
+}
+
+/* ArchiveSearchIndex::entryChanged
+ * Marks [entry] to be reindexed on the next query
+ *******************************************************************/
+void ArchiveSearchIndex::entryChanged(ArchiveEntry* entry)
+{
+	if (!rebuild)
+		pending.insert(entry);
+}
+
+/* ArchiveSearchIndex::query
+ * Returns all entries of [type] in namespace [ns] with names
+ * matching the [name] wildcard pattern (case-insensitive, without
+ * the extension if [ignore_ext] is true). Any of the criteria can be
+ * NULL/empty to ignore it. The entries are returned in no particular
+ * order
+ *******************************************************************/
+vector<ArchiveEntry*> ArchiveSearchIndex::query(EntryType* type, string ns, string name, bool ignore_ext)
+{
+	vector<ArchiveEntry*> ret;
+	update();
+	ns.MakeLower();
+	name.MakeLower();
+
+	// Find the smallest set of candidate entries the indices can give
+	EntrySet* candidates = NULL;
+	if (type)
+	{
+		std::map<EntryType*, EntrySet>::iterator i = by_type.find(type);
+		if (i == by_type.end())
+			return ret;
+		candidates = &i->second;
+	}
+	if (!name.IsEmpty() && !name.Contains("*") && !name.Contains("?"))
+	{
+		EntrySetMap& names = ignore_ext ? by_name_noext : by_name;
+		EntrySetMap::iterator i = names.find(name);
+		if (i == names.end())
+			return ret;
+		if (!candidates || i->second.size() < candidates->size())
+			candidates = &i->second;
+	}
+	if (!ns.IsEmpty())
+	{
+		EntrySetMap::iterator i = by_namespace.find(ns);
+		if (i == by_namespace.end())
+			return ret;
+		if (!candidates || i->second.size() < candidates->size())
+			candidates = &i->second;
+	}
+
+	// Check candidates against all criteria (or every entry if no
+	// index could narrow them down)
+	if (candidates)
+	{
+		for (EntrySet::iterator i = candidates->begin(); i != candidates->end(); i++)
+		{
+			if (matches(records[*i], type, ns, name, ignore_ext))
+				ret.push_back(*i);
+		}
+	}
+	else
+	{
+		for (std::map<ArchiveEntry*, record_t>::iterator i = records.begin(); i != records.end(); i++)
+		{
+			if (matches(i->second, type, ns, name, ignore_ext))
+				ret.push_back(i->first);
+		}
+	}
+
+	return ret;
+}
+
+/* ArchiveSearchIndex::onEvent
+ * Called when an announcement is recieved from the archive
+ *******************************************************************/
+void ArchiveSearchIndex::onEvent(Announcer* announcer, int event_id, MemChunk& event_data, AnnouncementData* data)
+{
+	if (announcer != archive || rebuild)
+		return;
+
+	// An entry was added, modified or is about to be renamed
+	if (event_id == ArchiveEvent::ENTRY_ADDED || event_id == ArchiveEvent::ENTRY_STATE_CHANGED ||
+	        event_id == ArchiveEvent::ENTRY_RENAMING)
+	{
+		wxUIntPtr ptr;
+		event_data.read(&ptr, sizeof(wxUIntPtr), 4);
+		pending.insert((ArchiveEntry*)wxUIntToPtr(ptr));
+
+		// Namespaces in treeless archives depend on entry positions and names
+		if (archive->isTreeless() && event_id != ArchiveEvent::ENTRY_STATE_CHANGED)
+			ns_outdated = true;
+	}
+
+	// Entries were changed in a batch
+	else if (event_id == ArchiveEvent::ENTRIES_CHANGED)
+	{
+		EntriesChangedData* changes = (EntriesChangedData*)data;
+		pending.insert(changes->entries.begin(), changes->entries.end());
+
+		// Entries were added, removed or moved around
+		if (changes->structure)
+			ns_outdated = true;
+	}
+
+	// An entry is about to be removed (and possibly deleted)
+	else if (event_id == ArchiveEvent::ENTRY_REMOVING)
+	{
+		wxUIntPtr ptr;
+		event_data.read(&ptr, sizeof(wxUIntPtr), sizeof(int));
+		ArchiveEntry* entry = (ArchiveEntry*)wxUIntToPtr(ptr);
+		removeRecord(entry);
+		pending.erase(entry);
+
+		if (archive->isTreeless())
+			ns_outdated = true;
+	}
+
+	// Entries were moved around or a directory was renamed
+	else if (event_id == ArchiveEvent::ENTRIES_SWAPPED || event_id == ArchiveEvent::DIRECTORY_MODIFIED)
+		ns_outdated = true;
+
+	// The archive was closed
+	else if (event_id == ArchiveEvent::CLOSING)
+		invalidate();
+}
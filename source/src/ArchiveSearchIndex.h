@@ -0,0 +1,58 @@
+
+#ifndef __ARCHIVESEARCHINDEX_H__
+#define __ARCHIVESEARCHINDEX_H__
+
+#include "ListenerAnnouncer.h"
+#include <set>
+#include <map>
+
+class Archive;
+class ArchiveEntry;
+class ArchiveTreeNode;
+class EntryType;
+
+typedef std::set<ArchiveEntry*> EntrySet;
+WX_DECLARE_STRING_HASH_MAP(EntrySet, EntrySetMap);
+
+// Secondary indices of an archive's entries by type, namespace and
+// (lower case) name. Kept up to date from the archive's announcements,
+// changed entries are reindexed the next time the index is queried
+class ArchiveSearchIndex : public Listener
+{
+private:
+	struct record_t
+	{
+		EntryType*	type;
+		string		name;		// Lower case
+		string		name_noext;	// Lower case, without extension
+		string		ns;			// Lower case
+	};
+
+	Archive*							archive;
+	std::map<ArchiveEntry*, record_t>	records;
+	std::map<EntryType*, EntrySet>		by_type;
+	EntrySetMap							by_name;
+	EntrySetMap							by_name_noext;
+	EntrySetMap							by_namespace;
+	EntrySet							pending;		// Entries to (re)index before the next query
+	bool								rebuild;		// If true, everything is reindexed before the next query
+	bool								ns_outdated;	// If true, entry namespaces are checked before the next query
+
+	void	addRecord(ArchiveEntry* entry);
+	void	removeRecord(ArchiveEntry* entry);
+	void	addTree(ArchiveTreeNode* dir);
+	bool	matches(record_t& rec, EntryType* type, string& ns, string& name, bool ignore_ext);
+	void	update();
+
+public:
+	ArchiveSearchIndex(Archive* archive);
+	~ArchiveSearchIndex();
+
+	void					invalidate();
+	void					entryChanged(ArchiveEntry* entry);
+	vector<ArchiveEntry*>	query(EntryType* type, string ns = "", string name = "", bool ignore_ext = true);
+
+	void	onEvent(Announcer* announcer, int event_id, MemChunk& event_data, AnnouncementData* data);
+};
+
+#endif//__ARCHIVESEARCHINDEX_H__
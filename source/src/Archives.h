@@ -18,4 +18,5 @@
 #include "GZipArchive.h"
 #include "BZip2Archive.h"
 #include "TarArchive.h"
+#include "SevenZipArchive.h"
 #include "DiskArchive.h"
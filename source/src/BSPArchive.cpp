@@ -74,7 +74,7 @@ uint32_t BSPArchive::getEntryOffset(ArchiveEntry* entry)
 	if (!checkEntry(entry))
 		return 0;
 
-	return (uint32_t)(int)entry->exProp("Offset");
+	return entry->getOffset();
 }
 
 /* BSPArchive::getFileExtensionString
@@ -246,7 +246,7 @@ bool BSPArchive::open(MemChunk& mc)
 			// Create & setup lump
 			ArchiveEntry* nlump = new ArchiveEntry(wxString::FromAscii(name), lumpsize);
 			nlump->setLoaded(false);
-			nlump->exProp("Offset") = (int)(offset + texoffset);
+			nlump->setOffset(offset + texoffset);
 			nlump->setState(0);
 
 			// Add to entry list
@@ -257,27 +257,29 @@ bool BSPArchive::open(MemChunk& mc)
 		}
 	}
 
-	// Detect all entry types
-	MemChunk edata;
+	// Read all entry data
+	vector<ArchiveEntry*> all_entries;
 	theSplashWindow->setProgressMessage("Detecting entry types");
 	for (size_t a = 0; a < numEntries(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)numtex)));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
+		all_entries.push_back(entry);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
 		{
 			// Read the entry data
-			mc.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
-			entry->importMemChunk(edata);
+			readEntryData(entry, mc, getEntryOffset(entry));
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	EntryType::detectEntryTypes(all_entries);
+
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
 
 		// Unload entry data if needed
 		if (!archive_load_data)
@@ -325,6 +327,10 @@ bool BSPArchive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
+	// Read from the source data if possible
+	if (loadEntrySourceData(entry, entry->getOffset()))
+		return true;
+
 	// Open archive file
 	wxFile file(filename);
 
@@ -336,7 +342,7 @@ bool BSPArchive::loadEntryData(ArchiveEntry* entry)
 	}
 
 	// Seek to entry offset in file and read it in
-	file.Seek((int)entry->exProp("Offset"), wxFromStart);
+	file.Seek(entry->getOffset(), wxFromStart);
 	entry->importFileStream(file, entry->getSize());
 
 	// Set the lump to loaded
@@ -35,6 +35,12 @@
 #include <wx/filename.h>
 
 
+/*******************************************************************
+ * EXTERNAL VARIABLES
+ *******************************************************************/
+EXTERN_CVAR(Int, compression_threads)
+
+
 /*******************************************************************
  * BZIP2ARCHIVE CLASS FUNCTIONS
  *******************************************************************/
@@ -130,7 +136,7 @@ bool BZip2Archive::write(MemChunk& mc, bool update)
 {
 	if (numEntries() == 1)
 	{
-		return Compression::BZip2Compress(getEntry(0)->getMCData(), mc);
+		return Compression::BZip2Compress(getEntry(0)->getMCData(), mc, compression_threads);
 	}
 	return false;
 }
@@ -29,7 +29,237 @@
  * INCLUDES
  *******************************************************************/
 #include "Compression.h"
+#include "ThreadPool.h"
+#include "Console.h"
 #include "zreaders/ancientzip.h"
+#include <wx/stopwatch.h>
+
+
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+CVAR(Int, compression_threads, 0, CVAR_SAVE)	// Max threads for compressing large data (0 = all worker threads, 1 = single stream)
+
+const uint32_t DEFLATE_BLOCK = 131072;	// Amount of data deflated by each thread at a time
+const uint32_t DEFLATE_DICT = 32768;	// Amount of preceding data used as a dictionary for a deflate block
+
+// Amount of data compressed by each thread at a time, always fits in one bzip2 block
+// (level 9 blocks hold 899981 bytes, after the initial RLE which expands data by 5/4 at most)
+const uint32_t BZIP2_BLOCK = 700000;
+
+
+/*******************************************************************
+ * DEFLATEBLOCKSJOB CLASS
+ *******************************************************************
+ * Deflates blocks of data on multiple threads. Each block is a part
+ * of one raw deflate stream, using the end of the previous block as
+ * a dictionary and ending with a sync flush (except the last), so
+ * the blocks can simply be joined together (as pigz does)
+ */
+class DeflateBlocksJob : public ThreadPool::Job
+{
+public:
+	struct block_t
+	{
+		uint8_t*	data;
+		uint32_t	size;
+		uint32_t	check;	// CRC-32 (gzip) or Adler-32 (zlib) of the block's input
+		bool		ok;
+	};
+
+	const uint8_t*	in;
+	uint32_t		in_size;
+	int				level;
+	bool			gzip;
+	vector<block_t>	blocks;
+
+	DeflateBlocksJob(const uint8_t* in, uint32_t in_size, int level, bool gzip, unsigned n_blocks)
+	{
+		this->in = in;
+		this->in_size = in_size;
+		this->level = level;
+		this->gzip = gzip;
+
+		block_t empty = { NULL, 0, 0, false };
+		blocks.resize(n_blocks, empty);
+	}
+
+	~DeflateBlocksJob()
+	{
+		for (unsigned a = 0; a < blocks.size(); a++)
+			delete[] blocks[a].data;
+	}
+
+	void process(unsigned index)
+	{
+		block_t& block = blocks[index];
+		uint32_t start = index * DEFLATE_BLOCK;
+		uint32_t len = MIN(DEFLATE_BLOCK, in_size - start);
+		bool last = (index == blocks.size() - 1);
+
+		z_stream strm;
+		memset(&strm, 0, sizeof(z_stream));
+		if (deflateInit2(&strm, level, Z_DEFLATED, -MAX_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+			return;
+
+		// Let matches reach back into the previous block, as they would
+		// in a single stream
+		if (start > 0)
+		{
+			uint32_t dict = MIN(DEFLATE_DICT, start);
+			deflateSetDictionary(&strm, in + start - dict, dict);
+		}
+
+		// Deflate the block (the bound doesn't include the sync flush marker)
+		uLong bound = deflateBound(&strm, len) + 16;
+		block.data = new uint8_t[bound];
+		strm.next_in = (Bytef*)(in + start);
+		strm.avail_in = len;
+		strm.next_out = block.data;
+		strm.avail_out = bound;
+		int ret = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+		block.ok = (ret == (last ? Z_STREAM_END : Z_OK) && strm.avail_in == 0 && strm.avail_out > 0);
+		block.size = strm.total_out;
+		deflateEnd(&strm);
+
+		if (gzip)
+			block.check = crc32(0, in + start, len);
+		else
+			block.check = adler32(1, in + start, len);
+	}
+};
+
+
+/*******************************************************************
+ * BZIP2BLOCKSJOB CLASS
+ *******************************************************************
+ * Compresses blocks of data as separate bzip2 streams on multiple
+ * threads. Each stream holds a single bzip2 block, the bits of which
+ * are then joined into one stream (as lbzip2 does)
+ */
+class BZip2BlocksJob : public ThreadPool::Job
+{
+public:
+	struct block_t
+	{
+		char*		data;
+		unsigned	size;
+		uint64_t	end;	// Bit position of the end of the block
+		uint32_t	crc;
+		bool		ok;
+	};
+
+	const uint8_t*	in;
+	uint32_t		in_size;
+	vector<block_t>	blocks;
+
+	BZip2BlocksJob(const uint8_t* in, uint32_t in_size, unsigned n_blocks)
+	{
+		this->in = in;
+		this->in_size = in_size;
+
+		block_t empty = { NULL, 0, 0, 0, false };
+		blocks.resize(n_blocks, empty);
+	}
+
+	~BZip2BlocksJob()
+	{
+		for (unsigned a = 0; a < blocks.size(); a++)
+			delete[] blocks[a].data;
+	}
+
+	// Reads [count] (up to 32) bits at bit position [pos] in [data]
+	static uint32_t readBits(const uint8_t* data, uint64_t pos, unsigned count)
+	{
+		uint32_t value = 0;
+		for (unsigned a = 0; a < count; a++, pos++)
+			value = (value << 1) | ((data[pos >> 3] >> (7 - (pos & 7))) & 1);
+		return value;
+	}
+
+	void process(unsigned index)
+	{
+		block_t& block = blocks[index];
+		uint32_t start = index * BZIP2_BLOCK;
+		uint32_t len = MIN(BZIP2_BLOCK, in_size - start);
+
+		// Compress the block (with the same buffer size as BZip2Compress)
+		block.size = len + (len >> 6) + 1024;
+		block.data = new char[block.size];
+		if (BZ2_bzBuffToBuffCompress(block.data, &block.size, (char*)(in + start), len, 9, 0, 0) != BZ_OK)
+			return;
+
+		// Check the stream header and the start of the block (at bit 32)
+		const uint8_t* data = (const uint8_t*)block.data;
+		if (block.size < 24 || memcmp(data, "BZh9", 4) != 0 ||
+		        readBits(data, 32, 24) != 0x314159 || readBits(data, 56, 24) != 0x265359)
+			return;
+
+		// Find the end of stream marker, followed by the stream CRC (the same
+		// as the block CRC, with only one block) and 0-7 bits of padding
+		for (unsigned pad = 0; pad < 8; pad++)
+		{
+			uint64_t end = (uint64_t)block.size * 8 - pad;
+			if (readBits(data, end - 80, 24) == 0x177245 && readBits(data, end - 56, 24) == 0x385090)
+			{
+				block.end = end - 80;
+				block.crc = readBits(data, end - 32, 32);
+				block.ok = true;
+				return;
+			}
+		}
+	}
+};
+
+/* bitwriter_t
+ * Writes bits (most significant first) to a buffer, for joining
+ * bzip2 blocks
+ *******************************************************************/
+struct bitwriter_t
+{
+	uint8_t*	data;
+	uint32_t	pos;
+	uint32_t	bits;
+	unsigned	n_bits;
+};
+
+/* putBits
+ * Writes the low [count] (up to 24) bits of [value] with [writer]
+ *******************************************************************/
+static void putBits(bitwriter_t& writer, uint32_t value, unsigned count)
+{
+	writer.bits = (writer.bits << count) | (value & ((1 << count) - 1));
+	writer.n_bits += count;
+	while (writer.n_bits >= 8)
+	{
+		writer.n_bits -= 8;
+		writer.data[writer.pos++] = (writer.bits >> writer.n_bits) & 0xFF;
+	}
+}
+
+/* copyBits
+ * Writes the bits of [data] from bit position [start] up to [end]
+ * with [writer]
+ *******************************************************************/
+static void copyBits(bitwriter_t& writer, const uint8_t* data, uint64_t start, uint64_t end)
+{
+	// Whole bytes (not necessarily aligned in [data])
+	uint64_t pos = start;
+	unsigned shift = pos & 7;
+	for (; end - pos >= 8; pos += 8)
+	{
+		const uint8_t* byte = data + (pos >> 3);
+		if (shift)
+			putBits(writer, (byte[0] << shift) | (byte[1] >> (8 - shift)), 8);
+		else
+			putBits(writer, byte[0], 8);
+	}
+
+	// Remaining bits
+	if (pos < end)
+		putBits(writer, BZip2BlocksJob::readBits(data, pos, end - pos), end - pos);
+}
+
 
 /*******************************************************************
  * FUNCTIONS
@@ -56,6 +286,31 @@ bool Compression::GenericInflate(MemChunk& in, MemChunk& out, int windowbits, co
 	return (stream.Status == Z_OK || stream.Status == Z_STREAM_END);
 }
 
+/* Compression::Inflate
+ * Inflates the (zlib, gzip or raw deflate depending on <windowbits>,
+ * see inflateInit2) stream at <in> directly to <out>, which must be
+ * exactly <out_size> bytes. Stops at the end of the stream, so
+ * <in_size> only needs to be an upper limit. Much faster than
+ * GenericInflate if the inflated size is known
+ *******************************************************************/
+bool Compression::Inflate(const uint8_t* in, uint32_t in_size, uint8_t* out, uint32_t out_size, int windowbits)
+{
+	z_stream strm;
+	memset(&strm, 0, sizeof(z_stream));
+	if (inflateInit2(&strm, windowbits) != Z_OK)
+		return false;
+
+	strm.next_in = (Bytef*)in;
+	strm.avail_in = in_size;
+	strm.next_out = out;
+	strm.avail_out = out_size;
+	int ret = inflate(&strm, Z_FINISH);
+	bool ok = (ret == Z_STREAM_END && strm.total_out == out_size);
+
+	inflateEnd(&strm);
+	return ok;
+}
+
 /* Compression::GenericDeflate
  * Basically a copy of zpipe.
  * Deflates the content of <in> to <out>
@@ -137,6 +392,16 @@ bool Compression::ZipInflate(MemChunk& in, MemChunk& out, size_t maxsize)
 	return ret;
 }
 
+/* Compression::ZipInflate
+ * Inflates <in_size> bytes of zip stream data at <in> directly to
+ * <out>, which must be exactly <out_size> bytes. Much faster than
+ * the above if the inflated size is known
+ *******************************************************************/
+bool Compression::ZipInflate(const uint8_t* in, uint32_t in_size, uint8_t* out, uint32_t out_size)
+{
+	return Compression::Inflate(in, in_size, out, out_size, -MAX_WBITS);
+}
+
 /* Compression::GZipInflate
  * Deflates the content of <in> as a gzip stream to <out>
  * GZip streams use a windowbits size of MAX_WBITS (15)
@@ -147,6 +412,35 @@ bool Compression::ZipDeflate(MemChunk& in, MemChunk& out, int level)
 	return Compression::GenericDeflate(in, out, level, -MAX_WBITS, "ZipDeflate");
 }
 
+/* Compression::ZipDeflate
+ * Deflates <in_size> bytes at <in> as a zip stream to <out>, in one
+ * step rather than in chunks
+ *******************************************************************/
+bool Compression::ZipDeflate(const uint8_t* in, uint32_t in_size, MemChunk& out, int level)
+{
+	z_stream strm;
+	memset(&strm, 0, sizeof(z_stream));
+	if (deflateInit2(&strm, level, Z_DEFLATED, -MAX_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+
+	// Compress to a buffer big enough for the worst case
+	uLong bound = deflateBound(&strm, in_size);
+	uint8_t* buf = new uint8_t[bound];
+	strm.next_in = (Bytef*)in;
+	strm.avail_in = in_size;
+	strm.next_out = buf;
+	strm.avail_out = bound;
+	int ret = deflate(&strm, Z_FINISH);
+	deflateEnd(&strm);
+
+	bool ok = (ret == Z_STREAM_END);
+	if (ok)
+		out.importMem(buf, strm.total_out);
+	delete[] buf;
+
+	return ok;
+}
+
 /* Compression::GZipInflate
  * Inflates the content of <in> as a gzip stream to <out>
  * GZip streams use a windowbits size of MAX_WBITS (15)
@@ -166,9 +460,14 @@ bool Compression::GZipInflate(MemChunk& in, MemChunk& out, size_t maxsize)
  * Deflates the content of <in> as a gzip stream to <out>
  * GZip streams use a windowbits size of MAX_WBITS (15)
  * The +16 tells zlib to use a gzip header
+ * If <threads> isn't 1, large data is deflated in blocks on up to
+ * that many threads (see ParallelDeflate)
  *******************************************************************/
-bool Compression::GZipDeflate(MemChunk& in, MemChunk& out, int level)
+bool Compression::GZipDeflate(MemChunk& in, MemChunk& out, int level, int threads)
 {
+	if (threads != 1 && in.getSize() > DEFLATE_BLOCK)
+		return Compression::ParallelDeflate(in.getData(), in.getSize(), out, level, true, threads);
+
 	return Compression::GenericDeflate(in, out, level, 16 + MAX_WBITS, "GZipDeflate");
 }
 
@@ -188,14 +487,108 @@ bool Compression::ZlibInflate(MemChunk& in, MemChunk& out, size_t maxsize)
 	return ret;
 }
 
+/* Compression::ZlibInflate
+ * Inflates the zlib stream at <in> directly to <out>, which must be
+ * exactly <out_size> bytes (see Compression::Inflate)
+ *******************************************************************/
+bool Compression::ZlibInflate(const uint8_t* in, uint32_t in_size, uint8_t* out, uint32_t out_size)
+{
+	return Compression::Inflate(in, in_size, out, out_size, MAX_WBITS);
+}
+
 /* Compression::ZlibDeflate
  * Deflates the content of <in> as a zlib stream to <out>
+ * If <threads> isn't 1, large data is deflated in blocks on up to
+ * that many threads (see ParallelDeflate)
  *******************************************************************/
-bool Compression::ZlibDeflate(MemChunk& in, MemChunk& out, int level)
+bool Compression::ZlibDeflate(MemChunk& in, MemChunk& out, int level, int threads)
 {
+	if (threads != 1 && in.getSize() > DEFLATE_BLOCK)
+		return Compression::ParallelDeflate(in.getData(), in.getSize(), out, level, false, threads);
+
 	return Compression::GenericDeflate(in, out, level, 0, "ZlibDeflate");
 }
 
+/* Compression::ParallelDeflate
+ * Deflates <in_size> bytes at <in> as a gzip (if <gzip> is true) or
+ * zlib stream to <out>, splitting it into blocks deflated on up to
+ * <threads> threads (all worker threads if 0 or less). The result is
+ * a single ordinary stream, only slightly bigger than one deflated
+ * in one go
+ *******************************************************************/
+bool Compression::ParallelDeflate(const uint8_t* in, uint32_t in_size, MemChunk& out, int level, bool gzip, int threads)
+{
+	// Deflate all blocks
+	unsigned n_blocks = MAX((uint32_t)1, (in_size + DEFLATE_BLOCK - 1) / DEFLATE_BLOCK);
+	DeflateBlocksJob job(in, in_size, level, gzip, n_blocks);
+	ThreadPool::run(job, n_blocks, 2, MAX(0, threads));
+
+	// Get the total size and checksum
+	uint32_t size = gzip ? 18 : 6;
+	uint32_t check = gzip ? crc32(0, Z_NULL, 0) : adler32(0, Z_NULL, 0);
+	for (unsigned a = 0; a < n_blocks; a++)
+	{
+		if (!job.blocks[a].ok)
+		{
+			wxLogMessage("ParallelDeflate: Unable to deflate block %d", a);
+			return false;
+		}
+
+		uint32_t len = MIN(DEFLATE_BLOCK, in_size - a * DEFLATE_BLOCK);
+		if (gzip)
+			check = crc32_combine(check, job.blocks[a].check, len);
+		else
+			check = adler32_combine(check, job.blocks[a].check, len);
+		size += job.blocks[a].size;
+	}
+
+	// Write the header
+	uint8_t* data = new uint8_t[size];
+	uint32_t pos = 0;
+	if (gzip)
+	{
+		// No mtime, extra flags for the fastest/best compression level and unknown OS
+		const uint8_t header[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, (uint8_t)(level == 9 ? 2 : (level == 1 ? 4 : 0)), 0xFF };
+		memcpy(data, header, 10);
+		pos = 10;
+	}
+	else
+	{
+		// Deflate with a 32kb window, and the compression level
+		uint8_t cmf = 0x78;
+		uint8_t flg = (level == 1 ? 0 : (level >= 2 && level <= 5 ? 1 : (level == 6 || level < 0 ? 2 : 3))) << 6;
+		flg += 31 - ((cmf * 256 + flg) % 31);
+		data[pos++] = cmf;
+		data[pos++] = flg;
+	}
+
+	// Write the blocks
+	for (unsigned a = 0; a < n_blocks; a++)
+	{
+		memcpy(data + pos, job.blocks[a].data, job.blocks[a].size);
+		pos += job.blocks[a].size;
+	}
+
+	// Write the trailer (little endian CRC and size for gzip, big endian Adler-32 for zlib)
+	if (gzip)
+	{
+		uint32_t trailer[2] = { wxUINT32_SWAP_ON_BE(check), wxUINT32_SWAP_ON_BE(in_size) };
+		memcpy(data + pos, trailer, 8);
+	}
+	else
+	{
+		check = wxUINT32_SWAP_ON_LE(check);
+		memcpy(data + pos, &check, 4);
+	}
+
+	// Let <out> have the data
+	MemBlock* block = MemBlock::fromData(data, size);
+	out.importBlock(block);
+	block->release();
+
+	return true;
+}
+
 /* Compression::ZipExplode
  * Explodes the content of <in> as a zip stream to <out>
  * This is one of the ZIP protocols not supported by wxWidgets
@@ -267,9 +660,14 @@ bool Compression::BZip2Decompress(MemChunk& in, MemChunk& out, size_t maxsize)
 
 /* Compression::BZip2Decompress
  * Compress the content of <in> as a bzip2 stream to <out>
+ * If <threads> isn't 1, large data is compressed in blocks on up to
+ * that many threads (see ParallelBZip2Compress)
  *******************************************************************/
-bool Compression::BZip2Compress(MemChunk& in, MemChunk& out)
+bool Compression::BZip2Compress(MemChunk& in, MemChunk& out, int threads)
 {
+	if (threads != 1 && in.getSize() > BZIP2_BLOCK)
+		return Compression::ParallelBZip2Compress(in.getData(), in.getSize(), out, threads);
+
 	// Clear out
 	out.clear();
 
@@ -288,6 +686,59 @@ bool Compression::BZip2Compress(MemChunk& in, MemChunk& out)
 	return (ok == BZ_OK);
 }
 
+/* Compression::ParallelBZip2Compress
+ * Compresses <in_size> bytes at <in> as a bzip2 stream to <out>,
+ * splitting it into blocks compressed on up to <threads> threads
+ * (all worker threads if 0 or less). The result is a single ordinary
+ * stream, much the same as one compressed in one go
+ *******************************************************************/
+bool Compression::ParallelBZip2Compress(const uint8_t* in, uint32_t in_size, MemChunk& out, int threads)
+{
+	// Compress all blocks
+	unsigned n_blocks = MAX((uint32_t)1, (in_size + BZIP2_BLOCK - 1) / BZIP2_BLOCK);
+	BZip2BlocksJob job(in, in_size, n_blocks);
+	ThreadPool::run(job, n_blocks, 2, MAX(0, threads));
+
+	// Get the maximum size
+	uint32_t size = 16;
+	for (unsigned a = 0; a < n_blocks; a++)
+	{
+		if (!job.blocks[a].ok)
+		{
+			wxLogMessage("ParallelBZip2Compress: Unable to compress block %d", a);
+			return false;
+		}
+		size += job.blocks[a].size;
+	}
+
+	// Write the stream header, then the bits of each block (without the
+	// header of its own stream), combining the block CRCs
+	bitwriter_t writer = { new uint8_t[size], 0, 0, 0 };
+	memcpy(writer.data, "BZh9", 4);
+	writer.pos = 4;
+	uint32_t crc = 0;
+	for (unsigned a = 0; a < n_blocks; a++)
+	{
+		copyBits(writer, (const uint8_t*)job.blocks[a].data, 32, job.blocks[a].end);
+		crc = ((crc << 1) | (crc >> 31)) ^ job.blocks[a].crc;
+	}
+
+	// Write the end of stream marker and the combined CRC, then pad to a byte
+	putBits(writer, 0x177245, 24);
+	putBits(writer, 0x385090, 24);
+	putBits(writer, crc >> 16, 16);
+	putBits(writer, crc & 0xFFFF, 16);
+	if (writer.n_bits > 0)
+		putBits(writer, 0, 8 - writer.n_bits);
+
+	// Let <out> have the data
+	MemBlock* block = MemBlock::fromData(writer.data, writer.pos);
+	out.importBlock(block);
+	block->release();
+
+	return true;
+}
+
 /* Compression::LZMADecompress
  * Decompress the content of <in> as an LZMA stream to <out>
  *******************************************************************/
@@ -309,3 +760,60 @@ bool Compression::LZMADecompress(MemChunk& in, MemChunk& out, size_t size)
 	return false;
 }
 
+
+
+/*******************************************************************
+ * CONSOLE COMMANDS
+ *******************************************************************/
+
+/* Console Command - "compression_bench"
+ * Compresses the given file as gzip, zlib and bzip2 on 1 to the given
+ * number of threads (all worker threads by default), checks the
+ * result decompresses to the original and shows the throughput
+ *******************************************************************/
+CONSOLE_COMMAND(compression_bench, 1, false)
+{
+	MemChunk in;
+	if (!in.importFile(args[0]))
+	{
+		wxLogMessage("Unable to read file %s", CHR(args[0]));
+		return;
+	}
+
+	long max_threads = ThreadPool::numThreads();
+	if (args.size() > 1)
+		args[1].ToLong(&max_threads);
+
+	const char* formats[] = { "gzip", "zlib", "bzip2" };
+	for (int f = 0; f < 3; f++)
+	{
+		for (long t = 1; t <= max_threads; t++)
+		{
+			// Compress
+			MemChunk out, check;
+			wxStopWatch sw;
+			bool ok;
+			if (f == 2)
+				ok = Compression::ParallelBZip2Compress(in.getData(), in.getSize(), out, t);
+			else
+				ok = Compression::ParallelDeflate(in.getData(), in.getSize(), out, 9, f == 0, t);
+			long time = sw.Time();
+
+			// Decompress and compare
+			if (ok)
+			{
+				if (f == 0)
+					ok = Compression::GZipInflate(out, check);
+				else if (f == 1)
+					ok = Compression::ZlibInflate(out, check);
+				else
+					ok = Compression::BZip2Decompress(out, check);
+				ok = ok && check.getSize() == in.getSize() && memcmp(check.getData(), in.getData(), in.getSize()) == 0;
+			}
+
+			double mb_sec = time > 0 ? (double)in.getSize() / 1048576 * 1000 / time : 0;
+			wxLogMessage("%s, %d thread(s): %ldms, %1.1fMB/s, %1.1f%% of original size%s", formats[f], (int)t, time, mb_sec,
+			             in.getSize() > 0 ? (double)out.getSize() * 100 / in.getSize() : 0, ok ? "" : " (FAILED)");
+		}
+	}
+}
@@ -9,16 +9,22 @@ namespace Compression
 {
 	bool GenericInflate(MemChunk& in, MemChunk& out, int windowbits, const char* function);
 	bool GenericDeflate(MemChunk& in, MemChunk& out, int level, int windowbits, const char* function);
+	bool Inflate(const uint8_t* in, uint32_t in_size, uint8_t* out, uint32_t out_size, int windowbits);
 	bool GZipInflate(MemChunk& in, MemChunk& out, size_t maxsize = 0);
-	bool GZipDeflate(MemChunk& in, MemChunk& out, int level = -1);
+	bool GZipDeflate(MemChunk& in, MemChunk& out, int level = -1, int threads = 1);
 	bool ZipInflate(MemChunk& in, MemChunk& out, size_t maxsize = 0);
+	bool ZipInflate(const uint8_t* in, uint32_t in_size, uint8_t* out, uint32_t out_size);
 	bool ZipDeflate(MemChunk& in, MemChunk& out, int level = -1);
+	bool ZipDeflate(const uint8_t* in, uint32_t in_size, MemChunk& out, int level = -1);
 	bool ZlibInflate(MemChunk& in, MemChunk& out, size_t maxsize = 0);
-	bool ZlibDeflate(MemChunk& in, MemChunk& out, int level = -1);
+	bool ZlibInflate(const uint8_t* in, uint32_t in_size, uint8_t* out, uint32_t out_size);
+	bool ZlibDeflate(MemChunk& in, MemChunk& out, int level = -1, int threads = 1);
+	bool ParallelDeflate(const uint8_t* in, uint32_t in_size, MemChunk& out, int level, bool gzip, int threads);
 	bool ZipExplode(MemChunk& in, MemChunk& out, size_t size, int flags);
 	bool ZipUnshrink(MemChunk& in, MemChunk& out, size_t maxsize);
 	bool BZip2Decompress(MemChunk& in, MemChunk& out, size_t maxsize = 0);
-	bool BZip2Compress(MemChunk& in, MemChunk& out);
+	bool BZip2Compress(MemChunk& in, MemChunk& out, int threads = 1);
+	bool ParallelBZip2Compress(const uint8_t* in, uint32_t in_size, MemChunk& out, int threads);
 	bool LZMADecompress(MemChunk& in, MemChunk& out, size_t size);
 }
 
@@ -59,7 +59,7 @@ DatArchive::~DatArchive()
  *******************************************************************/
 uint32_t DatArchive::getEntryOffset(ArchiveEntry* entry)
 {
-	return uint32_t((int)entry->exProp("Offset"));
+	return entry->getOffset();
 }
 
 /* DatArchive::setEntryOffset
@@ -67,7 +67,7 @@ uint32_t DatArchive::getEntryOffset(ArchiveEntry* entry)
  *******************************************************************/
 void DatArchive::setEntryOffset(ArchiveEntry* entry, uint32_t offset)
 {
-	entry->exProp("Offset") = (int)offset;
+	entry->setOffset(offset);
 }
 
 
@@ -167,7 +167,7 @@ bool DatArchive::open(MemChunk& mc)
 		// Create & setup lump
 		ArchiveEntry* nlump = new ArchiveEntry(myname, size);
 		nlump->setLoaded(false);
-		nlump->exProp("Offset") = (int)offset;
+		nlump->setOffset(offset);
 		nlump->setState(0);
 
 		if (flags & 1) nlump->setEncryption(ENC_SCRLE0);
@@ -190,27 +190,29 @@ bool DatArchive::open(MemChunk& mc)
 		getRoot()->addEntry(nlump);
 	}
 
-	// Detect all entry types
-	MemChunk edata;
+	// Read all entry data
+	vector<ArchiveEntry*> all_entries;
 	theSplashWindow->setProgressMessage("Detecting entry types");
 	for (size_t a = 0; a < numEntries(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_lumps)));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
+		all_entries.push_back(entry);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
 		{
 			// Read the entry data
-			mc.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
-			entry->importMemChunk(edata);
+			readEntryData(entry, mc, getEntryOffset(entry));
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	EntryType::detectEntryTypes(all_entries);
+
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
 
 		// Set entry to unchanged
 		entry->setState(0);
@@ -466,6 +468,16 @@ bool DatArchive::moveEntry(ArchiveEntry* entry, unsigned position, ArchiveTreeNo
  * Returns true if successful, false otherwise
  *******************************************************************/
 bool DatArchive::write(MemChunk& mc, bool update)
+{
+	MemChunkOutputStream out(mc);
+	return write(out, update);
+}
+
+/* DatArchive::write
+ * Writes the dat archive to [out]
+ * Returns true if successful, false otherwise
+ *******************************************************************/
+bool DatArchive::write(wxOutputStream& out, bool update)
 {
 	// Only two bytes are used for storing entry amount,
 	// so abort for excessively large files:
@@ -473,16 +485,20 @@ bool DatArchive::write(MemChunk& mc, bool update)
 		return false;
 
 	// Determine directory offset, name offsets & individual lump offsets
+	// (entry offsets aren't updated until the lumps have been written,
+	// as unloaded lumps are read from their current offset)
+	uint32_t num_lumps = numEntries();
 	uint32_t dir_offset = 10;
-	uint16_t name_offset = numEntries() * 12;
+	uint16_t name_offset = num_lumps * 12;
 	uint32_t name_size = 0;
 	string previousname = "";
-	uint16_t* nameoffsets = new uint16_t[numEntries()];
+	vector<uint16_t> nameoffsets(num_lumps);
+	vector<uint32_t> offsets(num_lumps);
 	ArchiveEntry* entry = NULL;
-	for (uint16_t l = 0; l < numEntries(); l++)
+	for (uint16_t l = 0; l < num_lumps; l++)
 	{
 		entry = getEntry(l);
-		setEntryOffset(entry, dir_offset);
+		offsets[l] = dir_offset;
 		dir_offset += entry->getSize();
 
 		// Does the entry has a name?
@@ -504,24 +520,23 @@ bool DatArchive::write(MemChunk& mc, bool update)
 		}
 	}
 
-	// Clear/init MemChunk
-	mc.clear();
-	mc.seek(0, SEEK_SET);
-	mc.reSize(dir_offset + name_size + numEntries() * 12);
-
 	// Write the header
-	uint16_t num_lumps = wxINT16_SWAP_ON_BE(numEntries());
-	dir_offset = wxINT32_SWAP_ON_BE(dir_offset);
+	uint16_t header_lumps = wxINT16_SWAP_ON_BE((uint16_t)num_lumps);
+	uint32_t header_dir = wxINT32_SWAP_ON_BE(dir_offset);
 	uint32_t unknown = 0;
-	mc.write(&num_lumps, 2);
-	mc.write(&dir_offset, 4);
-	mc.write(&unknown, 4);
+	out.Write(&header_lumps, 2);
+	out.Write(&header_dir, 4);
+	out.Write(&unknown, 4);
 
 	// Write the lumps
-	for (uint16_t l = 0; l < numEntries(); l++)
+	for (uint16_t l = 0; l < num_lumps; l++)
 	{
 		entry = getEntry(l);
-		mc.write(entry->getData(), entry->getSize());
+		if (!writeEntryData(out, entry, getEntryOffset(entry)))
+		{
+			Global::error = "Unable to write lump data";
+			return false;
+		}
 	}
 
 	// Write the directory
@@ -529,21 +544,15 @@ bool DatArchive::write(MemChunk& mc, bool update)
 	{
 		entry = getEntry(l);
 
-		uint32_t offset = wxINT32_SWAP_ON_BE(getEntryOffset(entry));
+		uint32_t offset = wxINT32_SWAP_ON_BE(offsets[l]);
 		uint32_t size = wxINT32_SWAP_ON_BE(entry->getSize());
 		uint16_t nameofs = wxINT16_SWAP_ON_BE(nameoffsets[l]);
 		uint16_t flags = wxINT16_SWAP_ON_BE((entry->isEncrypted() == ENC_SCRLE0) ? 1 : 0);
 
-		mc.write(&offset,	4);		// Offset
-		mc.write(&size,		4);		// Size
-		mc.write(&nameofs,	2);		// Name offset
-		mc.write(&flags,	2);		// Flags
-
-		if (update)
-		{
-			entry->setState(0);
-			entry->exProp("Offset") = (int)wxINT32_SWAP_ON_BE(offset);
-		}
+		out.Write(&offset,	4);		// Offset
+		out.Write(&size,	4);		// Size
+		out.Write(&nameofs,	2);		// Name offset
+		out.Write(&flags,	2);		// Flags
 	}
 
 	// Write the names
@@ -553,13 +562,26 @@ bool DatArchive::write(MemChunk& mc, bool update)
 		entry = getEntry(l);
 		if (nameoffsets[l])
 		{
-			mc.write(entry->getName(), entry->getName().length());
-			mc.write(&zero, 1);
+			out.Write(CHR(entry->getName()), entry->getName().length());
+			out.Write(&zero, 1);
 		}
 	}
+	if (!out.IsOk())
+	{
+		Global::error = "Unable to write dat directory";
+		return false;
+	}
 
-	// Clean-up
-	delete[] nameoffsets;
+	// Update entries
+	if (update)
+	{
+		for (uint16_t l = 0; l < num_lumps; l++)
+		{
+			entry = getEntry(l);
+			entry->setState(0);
+			entry->setOffset(offsets[l]);
+		}
+	}
 
 	// Finished!
 	return true;
@@ -583,6 +605,10 @@ bool DatArchive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
+	// Read from the source data if possible
+	if (loadEntrySourceData(entry, getEntryOffset(entry)))
+		return true;
+
 	// Open wadfile
 	wxFile file(filename);
 
@@ -26,7 +26,8 @@ public:
 
 	// Opening/writing
 	bool	open(MemChunk& mc);							// Open from MemChunk
-	bool	write(MemChunk& mc, bool update = true);	// Write to MemChunk
+	bool	write(MemChunk& mc, bool update = true);		// Write to MemChunk
+	bool	write(wxOutputStream& out, bool update = true);	// Write to stream
 
 	// Misc
 	bool		loadEntryData(ArchiveEntry* entry);
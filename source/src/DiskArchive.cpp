@@ -148,7 +148,7 @@ bool DiskArchive::open(MemChunk& mc)
 
 		// Create entry
 		ArchiveEntry* entry = new ArchiveEntry(fn.GetFullName(), dent.length);
-		entry->exProp("Offset") = (int)dent.offset;
+		entry->setOffset(dent.offset);
 		entry->setLoaded(false);
 		entry->setState(0);
 
@@ -156,32 +156,29 @@ bool DiskArchive::open(MemChunk& mc)
 		dir->addEntry(entry);
 	}
 
-	// Detect all entry types
-	MemChunk edata;
+	// Entry data is loaded from the source data when needed, if there is
+	// no source data it has to be read now
 	vector<ArchiveEntry*> all_entries;
 	getEntryTreeAsList(all_entries);
-	theSplashWindow->setProgressMessage("Detecting entry types");
-	for (size_t a = 0; a < all_entries.size(); a++)
+	if (!data_source)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_entries)));
-
-		// Get entry
-		ArchiveEntry* entry = all_entries[a];
-
-		// Read entry data if it isn't zero-sized
-		if (entry->getSize() > 0)
+		for (size_t a = 0; a < all_entries.size(); a++)
 		{
-			// Read the entry data
-			mc.exportMemChunk(edata, (int)entry->exProp("Offset"), entry->getSize());
-			entry->importMemChunk(edata);
+			if (all_entries[a]->getSize() > 0)
+				readEntryData(all_entries[a], mc, all_entries[a]->getOffset());
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	theSplashWindow->setProgressMessage("Detecting entry types");
+	detectEntryTypes(all_entries);
+
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
 
-		// Unload entry data if needed
-		if (!archive_load_data)
+		// Unload entry data if needed (can only be reloaded from the source data)
+		if (!archive_load_data && data_source)
 			entry->unloadData();
 
 		// Set entry to unchanged
@@ -246,7 +243,7 @@ bool DiskArchive::write(MemChunk& mc, bool update)
 		if (update)
 		{
 			entries[a]->setState(0);
-			entries[a]->exProp("Offset") = (int)offset;
+			entries[a]->setOffset(offset);
 		}
 
 		// Check entry name
@@ -324,6 +321,10 @@ bool DiskArchive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
+	// Read from the source data if possible
+	if (loadEntrySourceData(entry, entry->getOffset()))
+		return true;
+
 	// Open archive file
 	wxFile file(filename);
 
@@ -335,7 +336,7 @@ bool DiskArchive::loadEntryData(ArchiveEntry* entry)
 	}
 
 	// Seek to entry offset in file and read it in
-	file.Seek((int)entry->exProp("Offset"), wxFromStart);
+	file.Seek(entry->getOffset(), wxFromStart);
 	entry->importFileStream(file, entry->getSize());
 
 	// Set the lump to loaded
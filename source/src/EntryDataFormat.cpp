@@ -254,6 +254,7 @@ void EntryDataFormat::initBuiltinFormats()
 	new GZipDataFormat();
 	new BZip2DataFormat();
 	new TarDataFormat();
+	new SevenZipDataFormat();
 	new DiskDataFormat();
 	new MUSDataFormat();
 	new MIDIDataFormat();
@@ -37,6 +37,9 @@
 #include "BinaryControlLump.h"
 #include "Parser.h"
 #include "ConsoleHelpers.h"
+#include "ThreadPool.h"
+#include "EntryTypeCache.h"
+#include "Misc.h"
 #include <wx/dir.h>
 #include <wx/filename.h>
 
@@ -46,6 +49,16 @@
  *******************************************************************/
 vector<EntryType*>	entry_types;		// The big list of all entry types
 vector<string>		entry_categories;	// All entry type categories
+uint64_t			etypes_hash = 0;	// Hash of all loaded entry type definitions
+
+// Compiled entry type index (see EntryType::buildTypeIndex)
+typedef std::map<string, vector<unsigned> > TypeNameIndex;
+typedef std::map<uint32_t, vector<unsigned> > TypeSizeIndex;
+bool				etypes_indexed = false;
+vector<unsigned>	etype_index_any;	// Types that could match any entry
+TypeNameIndex		etype_index_ext;	// Types that require one of a set of extensions
+TypeNameIndex		etype_index_name;	// Types that require one of a set of (non-wildcard) names
+TypeSizeIndex		etype_index_size;	// Types that require one of a set of sizes
 
 // Special entry types
 EntryType			etype_unknown;	// The default, 'unknown' entry type
@@ -78,6 +91,7 @@ EntryType::EntryType(string id)
 	size_limit[0] = -1;
 	size_limit[1] = -1;
 	detectable = true;
+	matchextorname = false;
 	section = "none";
 }
 
@@ -100,6 +114,7 @@ void EntryType::addToList()
 {
 	entry_types.push_back(this);
 	index = entry_types.size() - 1;
+	etypes_indexed = false;
 }
 
 /* EntryType::dump
@@ -171,6 +186,115 @@ string EntryType::getFileFilterString()
 	return ret;
 }
 
+/* EntryType::matchinfo_t
+ * Info about an entry that is being checked against entry types.
+ * Anything that doesn't depend on the type (name, extension, format
+ * checks etc.) is only worked out once, and shared between all the
+ * types it is checked against
+ *******************************************************************/
+struct EntryType::matchinfo_t
+{
+	ArchiveEntry*	entry;
+	MemChunk*		data;			// The entry data (if NULL, read from the entry)
+	uint32_t		size;
+	string			name;			// Lowercase name, excluding extension
+	string			ext;			// Lowercase extension
+	bool			has_ext;
+	Archive*		archive;
+	string			archive_format;
+	int				text;			// -1 if not checked yet
+	string			section;
+	bool			section_checked;
+	vector<EntryDataFormat*>	formats;		// Formats checked so far
+	vector<int>					format_results;	// ...and their results
+
+	matchinfo_t(ArchiveEntry* entry)
+	{
+		this->entry = entry;
+		data = NULL;
+		size = entry->getSize();
+		archive = entry->getParent();
+		if (archive)
+			archive_format = archive->getFormat();
+		text = -1;
+		section_checked = false;
+		setName(entry->getName());
+	}
+
+	// Info for an entry named [name] with [data], in section [section] of
+	// an archive of [archive_format] (the entry itself isn't needed)
+	matchinfo_t(MemChunk& data, string name, string archive_format, string section)
+	{
+		entry = NULL;
+		this->data = &data;
+		size = data.getSize();
+		archive = NULL;
+		this->archive_format = archive_format;
+		text = -1;
+		this->section = section;
+		section_checked = true;
+		setName(name);
+	}
+
+	// Sets the lowercase name and extension from [entry_name]
+	void setName(string entry_name)
+	{
+		// Split at first extension separator
+		string fn = entry_name.Lower();
+		size_t ext_sep = fn.find_first_of('.', 0);
+		has_ext = (ext_sep != wxString::npos);
+		if (has_ext)
+		{
+			name = fn.Left(ext_sep);
+			ext = fn.Mid(ext_sep+1);
+		}
+		else
+			name = fn;
+	}
+
+	// Returns the result of checking the entry data against [format]
+	int checkFormat(EntryDataFormat* format)
+	{
+		for (unsigned a = 0; a < formats.size(); a++)
+		{
+			if (formats[a] == format)
+				return format_results[a];
+		}
+
+		int r = format->isThisFormat(data ? *data : entry->getMCData());
+		formats.push_back(format);
+		format_results.push_back(r);
+		return r;
+	}
+
+	// Returns true if the entry data looks like text (no null bytes)
+	bool isText()
+	{
+		if (text < 0)
+		{
+			// Hack for identifying ACS script sources despite DB2 apparently appending
+			// two null bytes to them, which make the memchr test fail.
+			size_t end = size - 1;
+			if (end > 3) end -= 2;
+			text = (size > 0 && memchr(data ? data->getData() : entry->getData(), 0, end) != NULL) ? 0 : 1;
+		}
+
+		return text > 0;
+	}
+
+	// Returns the entry's section (namespace) within its archive
+	string& getSection()
+	{
+		if (!section_checked)
+		{
+			section = archive->detectNamespace(entry);
+			section_checked = true;
+		}
+
+		return section;
+	}
+};
+
 /* EntryType::isThisType
  * Returns true if [entry] matches the EntryType's criteria, false
  * otherwise
@@ -181,16 +305,26 @@ int EntryType::isThisType(ArchiveEntry* entry)
 	if (!entry)
 		return EDF_FALSE;
 
+	matchinfo_t info(entry);
+	return isThisType(info);
+}
+
+/* EntryType::isThisType
+ * Returns true if the entry in [info] matches the EntryType's
+ * criteria, false otherwise
+ *******************************************************************/
+int EntryType::isThisType(matchinfo_t& info)
+{
 	// Check type is detectable
 	if (!detectable)
 		return EDF_FALSE;
 
 	// Check min size
-	if (size_limit[0] >= 0 && entry->getSize() < (unsigned)size_limit[0])
+	if (size_limit[0] >= 0 && info.size < (unsigned)size_limit[0])
 		return EDF_FALSE;
 
 	// Check max size
-	if (size_limit[1] >= 0 && entry->getSize() > (unsigned)size_limit[1])
+	if (size_limit[1] >= 0 && info.size > (unsigned)size_limit[1])
 		return EDF_FALSE;
 
 	// Check for archive match if needed
@@ -199,7 +333,7 @@ int EntryType::isThisType(ArchiveEntry* entry)
 		bool match = false;
 		for (size_t a = 0; a < match_archive.size(); a++)
 		{
-			if (entry->getParent() && entry->getParent()->getFormat() == match_archive[a])
+			if (!info.archive_format.IsEmpty() && info.archive_format == match_archive[a])
 			{
 				match = true;
 				break;
@@ -215,7 +349,7 @@ int EntryType::isThisType(ArchiveEntry* entry)
 		bool match = false;
 		for (size_t a = 0; a < match_size.size(); a++)
 		{
-			if (entry->getSize() == match_size[a])
+			if (info.size == match_size[a])
 			{
 				match = true;
 				break;
@@ -230,18 +364,14 @@ int EntryType::isThisType(ArchiveEntry* entry)
 	int r = EDF_TRUE;
 	if (format == EntryDataFormat::textFormat())
 	{
-		// Hack for identifying ACS script sources despite DB2 apparently appending
-		// two null bytes to them, which make the memchr test fail.
-		size_t end = entry->getSize() - 1;
-		if (end > 3) end -= 2;
 		// Text is a special case, as other data formats can sometimes be detected as 'text',
 		// we'll only check for it if text data is specified in the entry type
-		if (entry->getSize() > 0 && memchr(entry->getData(), 0, end) != NULL)
+		if (!info.isText())
 			return EDF_FALSE;
 	}
-	else if (format != EntryDataFormat::anyFormat() && entry->getSize() > 0)
+	else if (format != EntryDataFormat::anyFormat() && info.size > 0)
 	{
-		r = format->isThisFormat(entry->getMCData());
+		r = info.checkFormat(format);
 		if (r == EDF_FALSE)
 			return EDF_FALSE;
 	}
@@ -252,7 +382,7 @@ int EntryType::isThisType(ArchiveEntry* entry)
 		bool match = false;
 		for (size_t a = 0; a < size_multiple.size(); a++)
 		{
-			if (entry->getSize() % size_multiple[a] == 0)
+			if (info.size % size_multiple[a] == 0)
 			{
 				match = true;
 				break;
@@ -273,21 +403,13 @@ int EntryType::isThisType(ArchiveEntry* entry)
 	// Entry name related stuff
 	if (!match_name.empty() || !match_extension.empty())
 	{
-		// Get entry name (lowercase), find extension separator
-		string fn = entry->getName().Lower();
-		size_t ext_sep = fn.find_first_of('.', 0);
-
 		// Check for name match if needed
 		if (!match_name.empty())
 		{
-			string name = fn;
-			if (ext_sep != wxString::npos)
-				name = fn.Left(ext_sep);
-
 			bool match = false;
 			for (size_t a = 0; a < match_name.size(); a++)
 			{
-				if (name.Matches(match_name[a]))
+				if (info.name.Matches(match_name[a]))
 				{
 					match = true;
 					break;
@@ -303,12 +425,11 @@ int EntryType::isThisType(ArchiveEntry* entry)
 		if (!match_extension.empty())
 		{
 			bool match = false;
-			if (ext_sep != wxString::npos)
+			if (info.has_ext)
 			{
-				string ext = fn.Mid(ext_sep+1);
 				for (size_t a = 0; a < match_extension.size(); a++)
 				{
-					if (ext == match_extension[a])
+					if (info.ext == match_extension[a])
 					{
 						match = true;
 						break;
@@ -361,12 +482,10 @@ int EntryType::isThisType(ArchiveEntry* entry)
 	if (section != "none")
 	{
 		// Check entry is part of an archive (if not it can't be in a section)
-		if (!entry->getParent())
+		if (info.archive_format.IsEmpty())
 			return EDF_FALSE;
 
-		string e_section = entry->getParent()->detectNamespace(entry);
-
-		if (e_section != section)
+		if (info.getSection() != section)
 			return EDF_FALSE;
 	}
 
@@ -598,9 +717,12 @@ bool EntryType::loadEntryTypes()
 
 	// Read in each file in the directory
 	bool etypes_read = false;
+	etypes_hash = 0;
 	for (unsigned a = 0; a < et_dir->numEntries(); a++)
 	{
-		if (readEntryTypeDefinition(et_dir->getEntry(a)->getMCData()))
+		MemChunk& mc = et_dir->getEntry(a)->getMCData();
+		etypes_hash = Misc::hash64(mc.getData(), mc.getSize(), etypes_hash);
+		if (readEntryTypeDefinition(mc))
 			etypes_read = true;
 	}
 
@@ -628,12 +750,16 @@ bool EntryType::loadEntryTypes()
 		mc.importFile(res_dir.GetName() + "/" + filename);
 
 		// Parse file
+		etypes_hash = Misc::hash64(mc.getData(), mc.getSize(), etypes_hash);
 		readEntryTypeDefinition(mc);
 
 		// Next file
 		files = res_dir.GetNext(&filename);
 	}
 
+	// Build type lookup index
+	buildTypeIndex();
+
 	return true;
 }
 
@@ -653,34 +779,322 @@ bool EntryType::detectEntryType(ArchiveEntry* entry)
 		return true;
 	}
 
-	// Reset entry type
-	entry->setType(&etype_unknown);
+	// Detect and set entry type
+	int r = 0;
+	EntryType* type = findEntryType(entry, r);
+	entry->setType(type, r);
 
-	// Go through all registered types
-	for (size_t a = 0; a < entry_types.size(); a++)
+	// Return t/f depending on if a matching type was found
+	if (type == &etype_unknown)
+		return false;
+	else
+		return true;
+}
+
+/* EntryType::buildTypeIndex
+ * Sorts all detectable entry types into lookup tables by the
+ * criteria that rule out the most types cheaply: a type that
+ * requires particular extensions is listed under each of them,
+ * otherwise one that requires particular (non-wildcard) names is
+ * listed under each name, otherwise one that requires particular
+ * sizes is listed under each size. Any other type could match
+ * any entry
+ *******************************************************************/
+void EntryType::buildTypeIndex()
+{
+	etype_index_any.clear();
+	etype_index_ext.clear();
+	etype_index_name.clear();
+	etype_index_size.clear();
+
+	for (unsigned a = 0; a < entry_types.size(); a++)
 	{
+		EntryType* type = entry_types[a];
+
+		// Skip types that can't be detected
+		if (!type->detectable)
+			continue;
+
+		// Check if the type needs an extension/name match (ie. not either/or)
+		bool extorname = (type->matchextorname && !type->match_name.empty() && !type->match_extension.empty());
+		bool literal_names = !type->match_name.empty() && !extorname;
+		for (unsigned n = 0; n < type->match_name.size(); n++)
+		{
+			if (type->match_name[n].find_first_of("*?") != string::npos)
+				literal_names = false;
+		}
+
+		if (!type->match_extension.empty() && !extorname)
+		{
+			for (unsigned e = 0; e < type->match_extension.size(); e++)
+				etype_index_ext[type->match_extension[e]].push_back(a);
+		}
+		else if (literal_names)
+		{
+			for (unsigned n = 0; n < type->match_name.size(); n++)
+				etype_index_name[type->match_name[n]].push_back(a);
+		}
+		else if (!type->match_size.empty())
+		{
+			for (unsigned s = 0; s < type->match_size.size(); s++)
+				etype_index_size[(uint32_t)type->match_size[s]].push_back(a);
+		}
+		else
+			etype_index_any.push_back(a);
+	}
+
+	// Remove any duplicates (if a type lists the same extension twice etc.)
+	for (TypeNameIndex::iterator i = etype_index_ext.begin(); i != etype_index_ext.end(); ++i)
+		i->second.erase(std::unique(i->second.begin(), i->second.end()), i->second.end());
+	for (TypeNameIndex::iterator i = etype_index_name.begin(); i != etype_index_name.end(); ++i)
+		i->second.erase(std::unique(i->second.begin(), i->second.end()), i->second.end());
+	for (TypeSizeIndex::iterator i = etype_index_size.begin(); i != etype_index_size.end(); ++i)
+		i->second.erase(std::unique(i->second.begin(), i->second.end()), i->second.end());
+
+	etypes_indexed = true;
+}
+
+/* EntryType::indexTypes
+ * Builds the type index if it isn't already built. Needs to be
+ * called (on the main thread) before detecting types on any other
+ * thread
+ *******************************************************************/
+void EntryType::indexTypes()
+{
+	if (!etypes_indexed)
+		buildTypeIndex();
+}
+
+/* EntryType::getCandidateTypes
+ * Adds the (entry_types) indices of all types that could possibly
+ * match the entry in [info] to [list], in type order
+ *******************************************************************/
+void EntryType::getCandidateTypes(matchinfo_t& info, vector<unsigned>& list)
+{
+	list = etype_index_any;
+
+	if (info.has_ext)
+	{
+		TypeNameIndex::iterator i = etype_index_ext.find(info.ext);
+		if (i != etype_index_ext.end())
+			list.insert(list.end(), i->second.begin(), i->second.end());
+	}
+
+	TypeNameIndex::iterator n = etype_index_name.find(info.name);
+	if (n != etype_index_name.end())
+		list.insert(list.end(), n->second.begin(), n->second.end());
+
+	TypeSizeIndex::iterator s = etype_index_size.find(info.size);
+	if (s != etype_index_size.end())
+		list.insert(list.end(), s->second.begin(), s->second.end());
+
+	// Each type is only in one table, so no duplicates, just sort
+	std::sort(list.begin(), list.end());
+}
+
+/* EntryType::findEntryType
+ * Returns the type [entry] is detected as (or the unknown type if
+ * none match), and the match reliability in [reliability]. Doesn't
+ * modify the entry, but may look up its section in its archive, so
+ * this should only be called from the main thread (see the
+ * MemChunk version below for other threads)
+ *******************************************************************/
+EntryType* EntryType::findEntryType(ArchiveEntry* entry, int& reliability)
+{
+	matchinfo_t info(entry);
+	return findEntryType(info, reliability);
+}
+
+/* EntryType::findEntryType
+ * Returns the type an entry named [name] with [data] would be
+ * detected as, if it were in section [section] of an archive of
+ * [archive_format] (empty if not in an archive). Only reads the
+ * given data, so it can be called from any thread as long as the
+ * type index is built
+ *******************************************************************/
+EntryType* EntryType::findEntryType(MemChunk& data, string name, string archive_format, string section, int& reliability)
+{
+	matchinfo_t info(data, name, archive_format, section);
+	return findEntryType(info, reliability);
+}
+
+/* EntryType::findEntryType
+ * Returns the type matching [info] (or the unknown type if none
+ * match), and the match reliability in [reliability]
+ *******************************************************************/
+EntryType* EntryType::findEntryType(matchinfo_t& info, int& reliability)
+{
+	EntryType* type = &etype_unknown;
+	int type_reliability = 0;
+	reliability = 0;
+
+	// Get all types that could possibly match the entry
+	if (!etypes_indexed)
+		buildTypeIndex();
+	vector<unsigned> candidates;
+	getCandidateTypes(info, candidates);
+
+	// Go through candidate types, in the same order as the full list.
+	// Types that can't match wouldn't change the result so this is
+	// the same as checking every type
+	for (size_t c = 0; c < candidates.size(); c++)
+	{
+		EntryType* etype = entry_types[candidates[c]];
+
 		// If the current type is more 'reliable' than this one, skip it
-		if (entry->getTypeReliability() >= entry_types[a]->getReliability())
+		if (type_reliability >= etype->getReliability())
 			continue;
 
 		// Check for possible type match
-		int r = entry_types[a]->isThisType(entry);
+		int r = etype->isThisType(info);
 		if (r > 0)
 		{
-			// Type matches, set it
-			entry->setType(entry_types[a], r);
+			// Type matches
+			type = etype;
+			reliability = r;
+			type_reliability = type->getReliability() * r / 255;
 
 			// No need to continue if the identification is 100% reliable
-			if (entry->getTypeReliability() >= 255)
-				return true;
+			if (type_reliability >= 255)
+				break;
 		}
 	}
 
-	// Return t/f depending on if a matching type was found
-	if (entry->getType() == &etype_unknown)
-		return false;
-	else
-		return true;
+	return type;
+}
+
+/* DetectJob class
+ * Detects the types of a list of entries on multiple threads, keeping
+ * the results to be applied afterwards. If a type cache is given,
+ * entries found in it aren't detected. The entries' names and
+ * sections are got beforehand, so the threads only read entry data
+ *******************************************************************/
+class DetectJob : public ThreadPool::Job
+{
+public:
+	vector<ArchiveEntry*>&	entries;
+	vector<uint32_t>&		offsets;
+	EntryTypeCache*			cache;
+	string					archive_format;
+	vector<string>			names;
+	vector<string>			sections;
+	vector<EntryType*>		types;
+	vector<int>				reliabilities;
+	vector<uint64_t>		hashes;
+	vector<uint8_t>			cached;		// Not vector<bool>, it is written from multiple threads
+
+	DetectJob(vector<ArchiveEntry*>& entries, vector<uint32_t>& offsets, EntryTypeCache* cache)
+		: entries(entries), offsets(offsets), cache(cache)
+	{
+		types.resize(entries.size(), NULL);
+		reliabilities.resize(entries.size(), 0);
+		hashes.resize(entries.size(), 0);
+		cached.resize(entries.size(), 0);
+
+		for (unsigned a = 0; a < entries.size(); a++)
+		{
+			Archive* archive = entries[a]->getParent();
+			if (archive && archive_format.IsEmpty())
+				archive_format = archive->getFormat();
+			names.push_back(entries[a]->getName());
+			sections.push_back(archive ? archive->detectNamespace(entries[a]) : "");
+		}
+	}
+
+	void process(unsigned index)
+	{
+		ArchiveEntry* entry = entries[index];
+
+		// Check the cache first
+		if (cache)
+		{
+			hashes[index] = Misc::hash64(entry->getData(false), entry->getSize());
+			types[index] = cache->lookup(index, offsets[index], entry->getSize(), hashes[index], reliabilities[index]);
+			if (types[index])
+			{
+				cached[index] = 1;
+				return;
+			}
+		}
+
+		types[index] = EntryType::findEntryType(entry->getMCData(false), names[index], archive_format, sections[index], reliabilities[index]);
+	}
+};
+
+/* EntryType::detectEntryTypes
+ * Detects the types of all [entries], split over multiple threads.
+ * The results are the same as calling detectEntryType on each entry
+ *******************************************************************/
+void EntryType::detectEntryTypes(vector<ArchiveEntry*>& entries)
+{
+	// Make sure the type index is built before detecting on other threads
+	indexTypes();
+
+	// Get entries that need detection
+	vector<ArchiveEntry*> detect;
+	vector<uint32_t> offsets;
+	EntryTypeCache* cache = NULL;
+	for (unsigned a = 0; a < entries.size(); a++)
+	{
+		ArchiveEntry* entry = entries[a];
+
+		// Do nothing if the entry is a folder or a map marker
+		if (!entry || entry->getType() == &etype_folder || entry->getType() == &etype_map)
+			continue;
+
+		// Use the type cache of the archive being opened, if it has one
+		if (!cache && entry->getParent())
+			cache = entry->getParent()->getTypeCache();
+
+		// If the entry's size is zero, set it to marker type
+		if (entry->getSize() == 0)
+		{
+			entry->setType(&etype_marker);
+			continue;
+		}
+
+		// Entry data can't be loaded from the worker threads, so load it now
+		// (if it can't be loaded, detect it here as normal)
+		entry->getMCData();
+		if (entry->isLoaded())
+		{
+			detect.push_back(entry);
+			if (entry->hasOffset())
+				offsets.push_back(entry->getOffset());
+			else
+				offsets.push_back(0);
+		}
+		else
+			detectEntryType(entry);
+	}
+
+	// Detect types (the job gets the entry sections here, on this thread)
+	DetectJob job(detect, offsets, cache);
+	ThreadPool::run(job, detect.size(), 64);
+
+	// Apply detected types (in order), adding any newly detected ones to the cache
+	unsigned n_cached = 0;
+	for (unsigned a = 0; a < detect.size(); a++)
+	{
+		detect[a]->setType(job.types[a], job.reliabilities[a]);
+
+		if (job.cached[a])
+			n_cached++;
+		else if (cache)
+			cache->store(a, offsets[a], detect[a]->getSize(), job.hashes[a], job.types[a], job.reliabilities[a]);
+	}
+
+	if (cache)
+		LOG_MESSAGE(2, "Entry type cache: %d of %d entries found", n_cached, (int)detect.size());
+}
+
+/* EntryType::definitionsHash
+ * Returns a hash of all loaded entry type definitions, which changes
+ * if any of them are modified (used to invalidate cached types)
+ *******************************************************************/
+uint64_t EntryType::definitionsHash()
+{
+	return etypes_hash;
 }
 
 /* EntryType::getType
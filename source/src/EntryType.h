@@ -9,6 +9,8 @@ class ArchiveEntry;
 class EntryType
 {
 private:
+	struct matchinfo_t;
+
 	// Type info
 	string		id;
 	string		name;
@@ -65,11 +67,24 @@ public:
 
 	// Magic goes here
 	int		isThisType(ArchiveEntry* entry);
+private:
+	int		isThisType(matchinfo_t& info);
+
+	static void	buildTypeIndex();
+	static void	getCandidateTypes(matchinfo_t& info, vector<unsigned>& list);
+	static EntryType*	findEntryType(matchinfo_t& info, int& reliability);
+
+public:
 
 	// Static functions
 	static bool 				readEntryTypeDefinition(MemChunk& mc);
 	static bool 				loadEntryTypes();
+	static EntryType*			findEntryType(ArchiveEntry* entry, int& reliability);
+	static EntryType*			findEntryType(MemChunk& data, string name, string archive_format, string section, int& reliability);
+	static void					indexTypes();
 	static bool 				detectEntryType(ArchiveEntry* entry);
+	static void					detectEntryTypes(vector<ArchiveEntry*>& entries);
+	static uint64_t				definitionsHash();
 	static EntryType*			getType(string id);
 	static EntryType*			unknownType();
 	static EntryType*			folderType();
@@ -0,0 +1,234 @@
+
+/*******************************************************************
+ * SLADE - It's a Doom Editor
+ * Copyright (C) 2008-2012 Simon Judd
+ *
+ * Email:       sirjuddington@gmail.com
+ * Web:         http://slade.mancubus.net
+ * Filename:    EntryTypeCache.cpp
+ * Description: EntryTypeCache class, stores entry type detection
+ *              results for an archive file in the user directory
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *******************************************************************/
+
+
+/*******************************************************************
+ * INCLUDES
+ *******************************************************************/
+#include "Main.h"
+#include "EntryTypeCache.h"
+#include "EntryType.h"
+#include "Misc.h"
+#include <wx/filename.h>
+
+
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+namespace
+{
+	// Cache file format version, increase this if the file layout or
+	// the detection code itself changes in a way that affects results
+	const uint32_t CACHE_VERSION = 1;
+}
+
+
+/*******************************************************************
+ * ENTRYTYPECACHE CLASS FUNCTIONS
+ *******************************************************************/
+
+/* EntryTypeCache::EntryTypeCache
+ * EntryTypeCache class constructor. Reads any existing cache for the
+ * archive file at [archive_path]
+ *******************************************************************/
+EntryTypeCache::EntryTypeCache(string archive_path)
+{
+	wxFileName fn(archive_path);
+	fn.MakeAbsolute();
+	this->archive_path = fn.GetFullPath();
+	archive_mtime = fn.FileExists() ? (int64_t)fn.GetModificationTime().GetTicks() : 0;
+	archive_size = fn.FileExists() ? (uint64_t)fn.GetSize().GetValue() : 0;
+	modified = false;
+
+	// Cache files are named by a hash of the archive path
+	wxCharBuffer path_utf8 = this->archive_path.ToUTF8();
+	uint64_t path_hash = Misc::hash64((const uint8_t*)path_utf8.data(), strlen(path_utf8.data()));
+	cache_file = appPath(S_FMT("cache/%08x%08x.etcache", (uint32_t)(path_hash >> 32), (uint32_t)path_hash), DIR_USER);
+
+	// Read existing cache
+	if (!read())
+		entries.clear();
+}
+
+/* EntryTypeCache::~EntryTypeCache
+ * EntryTypeCache class destructor
+ *******************************************************************/
+EntryTypeCache::~EntryTypeCache()
+{
+}
+
+/* EntryTypeCache::read
+ * Reads the cache file. Returns false if it doesn't exist, is
+ * invalid or is out of date (the archive file or entry type
+ * definitions have changed since it was written)
+ *******************************************************************/
+bool EntryTypeCache::read()
+{
+	// Read the cache file
+	MemChunk mc;
+	if (!wxFileExists(cache_file) || !mc.importFile(cache_file))
+		return false;
+
+	// Check header
+	char magic[4] = "";
+	uint32_t version = 0;
+	uint64_t types_hash = 0;
+	int64_t mtime = 0;
+	uint64_t size = 0;
+	mc.read(magic, 4);
+	mc.read(&version, 4);
+	mc.read(&types_hash, 8);
+	mc.read(&mtime, 8);
+	mc.read(&size, 8);
+	if (magic[0] != 'S' || magic[1] != 'E' || magic[2] != 'T' || magic[3] != 'C' ||
+	        version != CACHE_VERSION || types_hash != EntryType::definitionsHash() ||
+	        mtime != archive_mtime || size != archive_size)
+		return false;
+
+	// Check archive path (in case of a path hash collision)
+	uint32_t len = 0;
+	if (!mc.read(&len, 4) || len > mc.getSize() - mc.currentPos())
+		return false;
+	string path = wxString::FromUTF8((const char*)mc.getData() + mc.currentPos(), len);
+	if (path != archive_path)
+		return false;
+	mc.seek(len, SEEK_CUR);
+
+	// Read entries
+	uint32_t count = 0;
+	if (!mc.read(&count, 4))
+		return false;
+	for (uint32_t a = 0; a < count; a++)
+	{
+		centry_t entry;
+		uint8_t id_len = 0;
+		if (!mc.read(&entry.offset, 4) || !mc.read(&entry.size, 4) || !mc.read(&entry.hash, 8) ||
+		        !mc.read(&entry.reliability, 1) || !mc.read(&id_len, 1) ||
+		        id_len > mc.getSize() - mc.currentPos())
+			return false;
+		entry.type = wxString::FromUTF8((const char*)mc.getData() + mc.currentPos(), id_len);
+		mc.seek(id_len, SEEK_CUR);
+		entries.push_back(entry);
+	}
+
+	return true;
+}
+
+/* EntryTypeCache::lookup
+ * Returns the cached type of the [index]th detected entry, if the
+ * cached [offset], [size] and data [hash] all match (and writes its
+ * detection reliability to [reliability]). Returns NULL otherwise.
+ * Doesn't modify the cache, so can be called from any thread
+ *******************************************************************/
+EntryType* EntryTypeCache::lookup(unsigned index, uint32_t offset, uint32_t size, uint64_t hash, int& reliability)
+{
+	if (index >= entries.size())
+		return NULL;
+
+	centry_t& entry = entries[index];
+	if (entry.offset != offset || entry.size != size || entry.hash != hash || entry.type.IsEmpty())
+		return NULL;
+
+	reliability = entry.reliability;
+	return EntryType::getType(entry.type);
+}
+
+/* EntryTypeCache::store
+ * Stores the detected [type] of the [index]th detected entry
+ *******************************************************************/
+void EntryTypeCache::store(unsigned index, uint32_t offset, uint32_t size, uint64_t hash, EntryType* type, int reliability)
+{
+	if (!type)
+		return;
+
+	if (index >= entries.size())
+	{
+		centry_t blank;
+		blank.offset = blank.size = 0;
+		blank.hash = 0;
+		blank.reliability = 0;
+		entries.resize(index + 1, blank);
+	}
+
+	centry_t& entry = entries[index];
+	entry.offset = offset;
+	entry.size = size;
+	entry.hash = hash;
+	entry.type = type->getId();
+	entry.reliability = (uint8_t)reliability;
+	modified = true;
+}
+
+/* EntryTypeCache::save
+ * Writes the cache file, if anything new was stored
+ *******************************************************************/
+bool EntryTypeCache::save()
+{
+	if (!modified)
+		return true;
+
+	// If the cache directory doesn't exist create it
+	if (!wxDirExists(appPath("cache", DIR_USER)))
+		wxMkdir(appPath("cache", DIR_USER));
+
+	// Write header
+	MemChunk mc;
+	uint32_t version = CACHE_VERSION;
+	uint64_t types_hash = EntryType::definitionsHash();
+	mc.write("SETC", 4);
+	mc.write(&version, 4);
+	mc.write(&types_hash, 8);
+	mc.write(&archive_mtime, 8);
+	mc.write(&archive_size, 8);
+
+	// Write archive path
+	wxCharBuffer path_utf8 = archive_path.ToUTF8();
+	uint32_t len = strlen(path_utf8.data());
+	mc.write(&len, 4);
+	mc.write(path_utf8.data(), len);
+
+	// Write entries
+	uint32_t count = entries.size();
+	mc.write(&count, 4);
+	for (uint32_t a = 0; a < count; a++)
+	{
+		wxCharBuffer id_utf8 = entries[a].type.ToUTF8();
+		size_t id_size = strlen(id_utf8.data());
+		uint8_t id_len = (uint8_t)MIN(id_size, 255);
+		mc.write(&entries[a].offset, 4);
+		mc.write(&entries[a].size, 4);
+		mc.write(&entries[a].hash, 8);
+		mc.write(&entries[a].reliability, 1);
+		mc.write(&id_len, 1);
+		mc.write(id_utf8.data(), id_len);
+	}
+
+	if (!mc.exportFile(cache_file))
+		return false;
+
+	modified = false;
+	return true;
+}
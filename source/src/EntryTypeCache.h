@@ -0,0 +1,40 @@
+
+#ifndef __ENTRYTYPECACHE_H__
+#define __ENTRYTYPECACHE_H__
+
+class EntryType;
+
+// Keeps the entry type detection results for an archive file on disk,
+// so its entries don't need to be detected again the next time it is
+// opened (as long as neither the file nor the entry types changed)
+class EntryTypeCache
+{
+private:
+	struct centry_t
+	{
+		uint32_t	offset;
+		uint32_t	size;
+		uint64_t	hash;
+		uint8_t		reliability;
+		string		type;
+	};
+
+	string				archive_path;
+	string				cache_file;
+	int64_t				archive_mtime;
+	uint64_t			archive_size;
+	vector<centry_t>	entries;
+	bool				modified;
+
+	bool	read();
+
+public:
+	EntryTypeCache(string archive_path);
+	~EntryTypeCache();
+
+	EntryType*	lookup(unsigned index, uint32_t offset, uint32_t size, uint64_t hash, int& reliability);
+	void		store(unsigned index, uint32_t offset, uint32_t size, uint64_t hash, EntryType* type, int reliability);
+	bool		save();
+};
+
+#endif//__ENTRYTYPECACHE_H__
@@ -0,0 +1,363 @@
+
+/*******************************************************************
+ * SLADE - It's a Doom Editor
+ * Copyright (C) 2008-2012 Simon Judd
+ *
+ * Email:       sirjuddington@gmail.com
+ * Web:         http://slade.mancubus.net
+ * Filename:    EntryTypeDetector.cpp
+ * Description: EntryTypeDetector class, detects the types of an
+ *              archive's entries on a background thread and applies
+ *              them to the entries as they are detected
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *******************************************************************/
+
+
+/*******************************************************************
+ * INCLUDES
+ *******************************************************************/
+#include "Main.h"
+#include "EntryTypeDetector.h"
+#include "EntryTypeCache.h"
+#include "Archive.h"
+#include "ThreadPool.h"
+#include "Misc.h"
+#include "Compression.h"
+#include <wx/app.h>
+
+
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+#define DETECT_BATCH	1024	// Number of entries detected between progress updates
+#define APPLY_INTERVAL	250		// Minimum time (ms) between applying batches of detected types
+
+
+/*******************************************************************
+ * DETECTITEMSJOB CLASS
+ *******************************************************************
+ * Detects the types of a batch of a detector's items on multiple
+ * threads
+ */
+class DetectItemsJob : public ThreadPool::Job
+{
+private:
+	EntryTypeDetector*	detector;
+	unsigned			first;
+
+public:
+	DetectItemsJob(EntryTypeDetector* detector, unsigned first)
+	{
+		this->detector = detector;
+		this->first = first;
+	}
+
+	void process(unsigned index)
+	{
+		detector->detectItem(first + index);
+	}
+};
+
+
+/*******************************************************************
+ * ENTRYTYPEDETECTOR CLASS FUNCTIONS
+ *******************************************************************/
+
+/* EntryTypeDetector::EntryTypeDetector
+ * EntryTypeDetector class constructor. Gets everything needed to
+ * detect the types of [entries] in [archive], which must be called
+ * on the main thread. Entries that aren't loaded are given to the
+ * thread as their compressed data if the archive can provide it
+ * (see Archive::getCompressedEntryData), otherwise they are loaded
+ * here. Entries that can't be detected in the background (zero-sized
+ * or unable to be loaded) are detected here. Takes ownership of
+ * [cache], if given
+ *******************************************************************/
+EntryTypeDetector::EntryTypeDetector(Archive* archive, vector<ArchiveEntry*>& entries, EntryTypeCache* cache)
+	: wxThread(wxTHREAD_JOINABLE)
+{
+	this->archive = archive;
+	this->cache = cache;
+	archive_format = archive->getFormat();
+	n_done = 0;
+	n_applied = 0;
+	last_applied = 0;
+	cancelled = false;
+	running = false;
+
+	// The type index can only be built on the main thread
+	EntryType::indexTypes();
+
+	for (unsigned a = 0; a < entries.size(); a++)
+	{
+		ArchiveEntry* entry = entries[a];
+
+		// Do nothing if the entry is a folder or a map marker
+		if (!entry || entry->getType() == EntryType::folderType() || entry->getType() == EntryType::mapMarkerType())
+			continue;
+
+		// Zero-sized entries are always markers, so just detect them now
+		if (entry->getSize() == 0)
+		{
+			EntryType::detectEntryType(entry);
+			continue;
+		}
+
+		// Keep a view of the entry data (or its compressed data), so it
+		// stays available to the thread even if the entry is modified or
+		// unloaded meanwhile
+		item_t item;
+		item.entry = entry;
+		item.data = new MemChunk();
+		item.method = 0;
+		if (entry->isLoaded() || !archive->getCompressedEntryData(entry, *item.data, item.method))
+		{
+			// Entries without data need it loaded, detect them now if it can't be
+			entry->getMCData();
+			if (!entry->isLoaded())
+			{
+				delete item.data;
+				EntryType::detectEntryType(entry);
+				continue;
+			}
+			item.data->importView(entry->getMCData());
+			item.method = 0;
+		}
+		item.name = entry->getName();
+		item.section = archive->detectNamespace(entry);
+		item.offset = entry->hasOffset() ? entry->getOffset() : 0;
+		item.size = entry->getSize();
+		item.hash = 0;
+		item.type = NULL;
+		item.reliability = 0;
+		item.cached = false;
+
+		item_index[entry] = items.size();
+		items.push_back(item);
+	}
+}
+
+/* EntryTypeDetector::~EntryTypeDetector
+ * EntryTypeDetector class destructor
+ *******************************************************************/
+EntryTypeDetector::~EntryTypeDetector()
+{
+	for (unsigned a = 0; a < items.size(); a++)
+	{
+		if (items[a].data)
+			delete items[a].data;
+	}
+
+	if (cache)
+		delete cache;
+}
+
+/* EntryTypeDetector::detectItem
+ * Detects the type of the item at [index], from the type cache if
+ * possible. Called from the detection threads
+ *******************************************************************/
+void EntryTypeDetector::detectItem(unsigned index)
+{
+	item_t& item = items[index];
+
+	// Decompress the data first if needed (it can't be detected otherwise)
+	if (item.method == 8)
+	{
+		uint8_t* buf = new uint8_t[item.size];
+		if (!Compression::ZipInflate(item.data->getData(), item.data->getSize(), buf, item.size))
+		{
+			delete[] buf;
+			item.type = EntryType::unknownType();
+			return;
+		}
+		MemBlock* block = MemBlock::fromData(buf, item.size);
+		item.data->importBlock(block);
+		block->release();
+		item.method = 0;
+	}
+
+	// Check the cache first
+	if (cache)
+	{
+		item.hash = Misc::hash64(item.data->getData(), item.size);
+		item.type = cache->lookup(index, item.offset, item.size, item.hash, item.reliability);
+		if (item.type)
+		{
+			item.cached = true;
+			return;
+		}
+	}
+
+	item.type = EntryType::findEntryType(*item.data, item.name, archive_format, item.section, item.reliability);
+}
+
+/* EntryTypeDetector::Entry
+ * Detects the types of all items, a batch at a time (each batch split
+ * over multiple threads), until done or cancelled
+ *******************************************************************/
+wxThread::ExitCode EntryTypeDetector::Entry()
+{
+	unsigned next = 0;
+	while (next < items.size())
+	{
+		// Check for cancellation
+		{
+			wxCriticalSectionLocker locker(lock);
+			if (cancelled)
+				break;
+		}
+
+		// Detect the next batch
+		unsigned count = MIN(DETECT_BATCH, items.size() - next);
+		DetectItemsJob job(this, next);
+		ThreadPool::run(job, count, 64);
+		next += count;
+
+		// Let the main thread know the batch is ready to apply
+		{
+			wxCriticalSectionLocker locker(lock);
+			n_done = next;
+		}
+		wxWakeUpIdle();
+	}
+
+	return 0;
+}
+
+/* EntryTypeDetector::start
+ * Starts detecting in the background. If the thread can't be
+ * started, all items are detected before returning. Returns false
+ * in that case, true otherwise
+ *******************************************************************/
+bool EntryTypeDetector::start()
+{
+	timer.Start();
+
+	if (Create() == wxTHREAD_NO_ERROR && Run() == wxTHREAD_NO_ERROR)
+	{
+		running = true;
+		return true;
+	}
+
+	LOG_MESSAGE(1, "Unable to start entry type detection thread, detecting types now");
+	Entry();
+	return false;
+}
+
+/* EntryTypeDetector::update
+ * Applies any types detected since the last update to their entries
+ * (unless the last update was very recent, since everything showing
+ * the archive is refreshed after each update). The type of an entry
+ * isn't changed if it was already set (eg. as a map lump) or if the
+ * entry was removed. Must be called on the main thread. Returns true
+ * if all types have been applied
+ *******************************************************************/
+bool EntryTypeDetector::update()
+{
+	unsigned done;
+	{
+		wxCriticalSectionLocker locker(lock);
+		done = n_done;
+	}
+	if (done < items.size() && timer.Time() - last_applied < APPLY_INTERVAL)
+		return false;
+	last_applied = timer.Time();
+
+	for (; n_applied < done; n_applied++)
+	{
+		item_t& item = items[n_applied];
+		if (item.entry && item.entry->getType() == EntryType::unknownType())
+			item.entry->setType(item.type, item.reliability);
+
+		// The thread is done with the data
+		delete item.data;
+		item.data = NULL;
+	}
+
+	if (n_applied < items.size())
+		return false;
+
+	// All done, wait for the thread to exit
+	if (running)
+	{
+		Wait();
+		running = false;
+	}
+
+	// Add newly detected types to the cache
+	unsigned n_cached = 0;
+	if (cache)
+	{
+		for (unsigned a = 0; a < items.size(); a++)
+		{
+			if (items[a].cached)
+				n_cached++;
+			else
+				cache->store(a, items[a].offset, items[a].size, items[a].hash, items[a].type, items[a].reliability);
+		}
+		cache->save();
+	}
+
+	LOG_MESSAGE(1, "Detected types of %d entries in %s in the background in %ldms (%d cached)",
+	            (int)items.size(), CHR(archive->getFilename(false)), timer.Time(), n_cached);
+
+	return true;
+}
+
+/* EntryTypeDetector::wait
+ * Waits for all types to be detected (they still need to be applied
+ * with update)
+ *******************************************************************/
+void EntryTypeDetector::wait()
+{
+	if (running)
+	{
+		Wait();
+		running = false;
+	}
+}
+
+/* EntryTypeDetector::cancel
+ * Stops detecting (after the current batch) and waits for the thread
+ * to exit. Types that haven't been applied yet are discarded
+ *******************************************************************/
+void EntryTypeDetector::cancel()
+{
+	{
+		wxCriticalSectionLocker locker(lock);
+		cancelled = true;
+	}
+
+	if (running)
+	{
+		Wait();
+		running = false;
+	}
+
+	LOG_MESSAGE(1, "Cancelled entry type detection for %s (%d of %d entries applied)",
+	            CHR(archive->getFilename(false)), n_applied, (int)items.size());
+}
+
+/* EntryTypeDetector::entryRemoved
+ * Called when [entry] is removed from the archive, so its type won't
+ * be applied
+ *******************************************************************/
+void EntryTypeDetector::entryRemoved(ArchiveEntry* entry)
+{
+	std::map<ArchiveEntry*, unsigned>::iterator i = item_index.find(entry);
+	if (i != item_index.end())
+		items[i->second].entry = NULL;
+}
@@ -0,0 +1,70 @@
+
+#ifndef __ENTRYTYPEDETECTOR_H__
+#define __ENTRYTYPEDETECTOR_H__
+
+#include <wx/thread.h>
+#include <wx/stopwatch.h>
+#include <map>
+
+class Archive;
+class ArchiveEntry;
+class EntryType;
+class EntryTypeCache;
+
+// Detects the types of an archive's entries on a background thread,
+// so the archive can be shown while they are being detected. The name,
+// section and data (as a shared view) of each entry are copied first,
+// so the thread never touches the archive or its entries. Detected
+// types are applied to the entries on the main thread by update()
+class EntryTypeDetector : public wxThread
+{
+	friend class DetectItemsJob;
+private:
+	struct item_t
+	{
+		ArchiveEntry*	entry;			// NULL if the entry was removed
+		MemChunk*		data;			// NULL once the type is applied
+		uint16_t		method;			// Zip compression method of data (0 if not compressed)
+		string			name;
+		string			section;
+		uint32_t		offset;
+		uint32_t		size;
+		uint64_t		hash;
+		EntryType*		type;
+		int				reliability;
+		bool			cached;
+	};
+
+	Archive*							archive;
+	string								archive_format;
+	vector<item_t>						items;
+	std::map<ArchiveEntry*, unsigned>	item_index;
+	EntryTypeCache*						cache;
+	unsigned							n_done;		// Items detected by the thread so far
+	unsigned							n_applied;	// Items applied to their entries so far
+	long								last_applied;
+	bool								cancelled;
+	bool								running;
+	wxCriticalSection					lock;		// Locks n_done and cancelled
+	wxStopWatch							timer;
+
+	void	detectItem(unsigned index);
+
+protected:
+	ExitCode	Entry();
+
+public:
+	EntryTypeDetector(Archive* archive, vector<ArchiveEntry*>& entries, EntryTypeCache* cache);
+	~EntryTypeDetector();
+
+	unsigned	numItems() { return items.size(); }
+	unsigned	numApplied() { return n_applied; }
+
+	bool	start();
+	bool	update();
+	void	wait();
+	void	cancel();
+	void	entryRemoved(ArchiveEntry* entry);
+};
+
+#endif//__ENTRYTYPEDETECTOR_H__
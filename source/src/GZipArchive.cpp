@@ -35,6 +35,13 @@
 #include <wx/filename.h>
 
 
+/*******************************************************************
+ * EXTERNAL VARIABLES
+ *******************************************************************/
+EXTERN_CVAR(Bool, archive_load_data)
+EXTERN_CVAR(Int, compression_threads)
+
+
 /*******************************************************************
  * CONSTANTS
  *******************************************************************/
@@ -191,22 +198,44 @@ bool GZipArchive::open(MemChunk& mc)
 	if (mds > size || mc.currentPos() + 8 > size)
 		return false;
 
+	// The deflate stream starts here
+	uint32_t data_offset = mc.currentPos();
+
+	// Read the uncompressed size (modulo 2^32) from the footer
+	uint32_t isize;
+	memcpy(&isize, mc.getData() + size - 4, 4);
+	isize = wxUINT32_SWAP_ON_BE(isize);
+
 	// Let's create the entry
 	setMuted(true);
-	ArchiveEntry* entry = new ArchiveEntry(name, size - mds);
-	MemChunk  xdata;
-	if (Compression::GZipInflate(mc, xdata))
+	ArchiveEntry* entry;
+	if (!archive_load_data && data_source && isize > 0)
 	{
-		entry->importMemChunk(xdata);
+		// The deflate stream can be read from the source data, so leave
+		// it to be inflated when the entry data is first needed. The
+		// entry type is detected when the entry is opened
+		entry = new ArchiveEntry(name, isize);
+		entry->setLoaded(false);
 	}
 	else
 	{
-		delete entry;
-		setMuted(false);
-		return false;
+		entry = new ArchiveEntry(name, size - mds);
+		MemChunk  xdata;
+		if (Compression::GZipInflate(mc, xdata))
+		{
+			entry->importMemChunk(xdata);
+		}
+		else
+		{
+			delete entry;
+			setMuted(false);
+			return false;
+		}
 	}
+	entry->setOffset(data_offset);
 	getRoot()->addEntry(entry);
-	EntryType::detectEntryType(entry);
+	if (entry->isLoaded())
+		EntryType::detectEntryType(entry);
 	entry->setState(0);
 
 	setMuted(false);
@@ -229,7 +258,7 @@ bool GZipArchive::write(MemChunk& mc, bool update)
 	if (numEntries() == 1)
 	{
 		MemChunk stream;
-		if (Compression::GZipDeflate(getEntry(0)->getMCData(), stream, 9))
+		if (Compression::GZipDeflate(getEntry(0)->getMCData(), stream, 9, compression_threads))
 		{
 			const uint8_t* data = stream.getData();
 			uint32_t working = 0;
@@ -287,6 +316,10 @@ bool GZipArchive::write(MemChunk& mc, bool update)
 				mc.write(&hcrc, 2);
 			}
 
+			// Update the entry offset to the start of the deflate stream
+			if (update)
+				getEntry(0)->setOffset(mc.currentPos());
+
 			// Now that the pleasantries are dispensed with,
 			// let's get with the meat of the matter
 			return mc.write(data + 10, size - 10);
@@ -312,12 +345,12 @@ bool GZipArchive::renameEntry(ArchiveEntry* entry, string name)
 }
 
 /* GZipArchive::loadEntryData
- * Loads an entry's data from the gzip file
+ * Loads an entry's data by inflating the deflate stream in the
+ * archive's source data
  * Returns true if successful, false otherwise
  *******************************************************************/
 bool GZipArchive::loadEntryData(ArchiveEntry* entry)
 {
-	return false;
 	// Check the entry is valid and part of this archive
 	if (!checkEntry(entry))
 		return false;
@@ -330,21 +363,43 @@ bool GZipArchive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
-	// Open gzip file
-	wxFile file(filename);
-
-	// Check if opening the file failed
-	if (!file.IsOpened())
+	// Get the deflate stream (and footer) from the source data, and
+	// inflate it to a new block of memory for the entry to view
+	MemChunk cdata;
+	uint32_t size = entry->getSize();
+	uint8_t* buf = NULL;
+	if (entry->hasOffset() && getSourceData(cdata, entry->getOffset(), 0))
 	{
-		wxLogMessage("GZipArchive::loadEntryData: Failed to open gzip file %s", filename.c_str());
-		return false;
+		buf = new uint8_t[size];
+		if (!Compression::ZipInflate(cdata.getData(), cdata.getSize(), buf, size))
+		{
+			delete[] buf;
+			buf = NULL;
+		}
 	}
 
-	// Seek to lump offset in file and read it in
-	entry->importFileStream(file, entry->getSize());
+	if (buf)
+	{
+		MemBlock* block = MemBlock::fromData(buf, size);
+		MemChunk mc;
+		mc.importBlock(block);
+		block->release();
+		readEntryData(entry, mc, 0);
+	}
+	else
+	{
+		// The size in the footer is only the uncompressed size modulo
+		// 2^32 (and could be wrong), so inflate the whole gzip data
+		MemChunk gzdata, xdata;
+		if (!getSourceData(gzdata, 0, 0) || !Compression::GZipInflate(gzdata, xdata))
+		{
+			wxLogMessage("GZipArchive::loadEntryData: Unable to inflate entry \"%s\"", CHR(entry->getName()));
+			return false;
+		}
+		entry->importMemChunk(xdata);
+		entry->setLoaded();
+	}
 
-	// Set the lump to loaded
-	entry->setLoaded();
 	entry->setState(0);
 
 	return true;
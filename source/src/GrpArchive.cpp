@@ -67,7 +67,7 @@ uint32_t GrpArchive::getEntryOffset(ArchiveEntry* entry)
 	if (!checkEntry(entry))
 		return 0;
 
-	return (uint32_t)(int)entry->exProp("Offset");
+	return entry->getOffset();
 }
 
 /* GrpArchive::setEntryOffset
@@ -79,7 +79,7 @@ void GrpArchive::setEntryOffset(ArchiveEntry* entry, uint32_t offset)
 	if (!checkEntry(entry))
 		return;
 
-	entry->exProp("Offset") = (int)offset;
+	entry->setOffset(offset);
 }
 
 /* GrpArchive::getFileExtensionString
@@ -170,41 +170,40 @@ bool GrpArchive::open(MemChunk& mc)
 		// Create & setup lump
 		ArchiveEntry* nlump = new ArchiveEntry(wxString::FromAscii(name), size);
 		nlump->setLoaded(false);
-		nlump->exProp("Offset") = (int)offset;
+		nlump->setOffset(offset);
 		nlump->setState(0);
 
 		// Add to entry list
 		getRoot()->addEntry(nlump);
 	}
 
-	// Detect all entry types
-	MemChunk edata;
+	// Read all entry data
+	vector<ArchiveEntry*> all_entries;
 	theSplashWindow->setProgressMessage("Detecting entry types");
 	for (size_t a = 0; a < numEntries(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_lumps)));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
+		all_entries.push_back(entry);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
-		{
-			// Read the entry data
-			mc.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
-			entry->importMemChunk(edata);
-		}
+			readEntryData(entry, mc, getEntryOffset(entry));
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	EntryType::detectEntryTypes(all_entries);
 
-		// Unload entry data if needed
-		if (!archive_load_data)
-			entry->unloadData();
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
 
 		// Set entry to unchanged
 		entry->setState(0);
+
+		// Unload entry data if needed (can only be reloaded from the mapped file)
+		if (!archive_load_data && data_source)
+			entry->unloadData();
 	}
 
 	// Detect maps (will detect map entry types)
@@ -227,43 +226,60 @@ bool GrpArchive::open(MemChunk& mc)
  *******************************************************************/
 bool GrpArchive::write(MemChunk& mc, bool update)
 {
-	// Clear/init MemChunk
-	mc.clear();
-	mc.seek(0, SEEK_SET);
-	mc.reSize((1 + numEntries()) * 16);
+	MemChunkOutputStream out(mc);
+	return write(out, update);
+}
+
+/* GrpArchive::write
+ * Writes the grp archive to [out]
+ * Returns true if successful, false otherwise
+ *******************************************************************/
+bool GrpArchive::write(wxOutputStream& out, bool update)
+{
 	ArchiveEntry* entry = NULL;
 
 	// Write the header
 	uint32_t num_lumps = numEntries();
-	mc.write("KenSilverman", 12);
-	mc.write(&num_lumps, 4);
+	uint32_t header_lumps = wxINT32_SWAP_ON_BE(num_lumps);
+	out.Write("KenSilverman", 12);
+	out.Write(&header_lumps, 4);
 
 	// Write the directory
 	for (uint32_t l = 0; l < num_lumps; l++)
 	{
 		entry = getEntry(l);
 		char name[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-		long size = entry->getSize();
+		uint32_t size = wxINT32_SWAP_ON_BE(entry->getSize());
 
 		for (size_t c = 0; c < entry->getName().length() && c < 12; c++)
 			name[c] = entry->getName()[c];
 
-		mc.write(name, 12);
-		mc.write(&size, 4);
-
-		if (update)
-		{
-			long offset = getEntryOffset(entry);
-			entry->setState(0);
-			entry->exProp("Offset") = (int)offset;
-		}
+		out.Write(name, 12);
+		out.Write(&size, 4);
 	}
 
 	// Write the lumps
 	for (uint32_t l = 0; l < num_lumps; l++)
 	{
 		entry = getEntry(l);
-		mc.write(entry->getData(), entry->getSize());
+		if (!writeEntryData(out, entry, getEntryOffset(entry)))
+		{
+			Global::error = "Unable to write lump data";
+			return false;
+		}
+	}
+
+	// Update entry offsets (after writing, as unloaded lumps are read from their current offset)
+	if (update)
+	{
+		uint32_t offset = 16 * (1 + num_lumps);
+		for (uint32_t l = 0; l < num_lumps; l++)
+		{
+			entry = getEntry(l);
+			entry->setState(0);
+			entry->setOffset(offset);
+			offset += entry->getSize();
+		}
 	}
 
 	return true;
@@ -287,6 +303,10 @@ bool GrpArchive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
+	// Read from the mapped file if possible
+	if (loadEntrySourceData(entry, getEntryOffset(entry)))
+		return true;
+
 	// Open grpfile
 	wxFile file(filename);
 
@@ -67,7 +67,7 @@ uint32_t HogArchive::getEntryOffset(ArchiveEntry* entry)
 	if (!checkEntry(entry))
 		return 0;
 
-	return (uint32_t)(int)entry->exProp("Offset");
+	return entry->getOffset();
 }
 
 /* HogArchive::setEntryOffset
@@ -79,7 +79,7 @@ void HogArchive::setEntryOffset(ArchiveEntry* entry, uint32_t offset)
 	if (!checkEntry(entry))
 		return;
 
-	entry->exProp("Offset") = (int)offset;
+	entry->setOffset(offset);
 }
 
 /* HogArchive::getFileExtensionString
@@ -151,7 +151,7 @@ bool HogArchive::open(MemChunk& mc)
 		// Create & setup lump
 		ArchiveEntry* nlump = new ArchiveEntry(wxString::FromAscii(name), size);
 		nlump->setLoaded(false);
-		nlump->exProp("Offset") = (int)offset;
+		nlump->setOffset(offset);
 		nlump->setState(0);
 
 		// Add to entry list
@@ -161,27 +161,29 @@ bool HogArchive::open(MemChunk& mc)
 		iter_offset = offset + size;
 	}
 
-	// Detect all entry types
-	MemChunk edata;
+	// Read all entry data
+	vector<ArchiveEntry*> all_entries;
 	theSplashWindow->setProgressMessage("Detecting entry types");
 	for (size_t a = 0; a < numEntries(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_lumps)));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
+		all_entries.push_back(entry);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
 		{
 			// Read the entry data
-			mc.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
-			entry->importMemChunk(edata);
+			readEntryData(entry, mc, getEntryOffset(entry));
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	EntryType::detectEntryTypes(all_entries);
+
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
 
 		// Unload entry data if needed
 		if (!archive_load_data)
@@ -218,7 +220,7 @@ bool HogArchive::write(MemChunk& mc, bool update)
 		if (update)
 		{
 			entry->setState(0);
-			entry->exProp("Offset") = (int)offset;
+			entry->setOffset(offset);
 		}
 		offset += entry->getSize();
 	}
@@ -275,6 +277,10 @@ bool HogArchive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
+	// Read from the source data if possible
+	if (loadEntrySourceData(entry, getEntryOffset(entry)))
+		return true;
+
 	// Open hogfile
 	wxFile file(filename);
 
@@ -67,7 +67,7 @@ uint32_t LfdArchive::getEntryOffset(ArchiveEntry* entry)
 	if (!checkEntry(entry))
 		return 0;
 
-	return (uint32_t)(int)entry->exProp("Offset");
+	return entry->getOffset();
 }
 
 /* LfdArchive::setEntryOffset
@@ -79,7 +79,7 @@ void LfdArchive::setEntryOffset(ArchiveEntry* entry, uint32_t offset)
 	if (!checkEntry(entry))
 		return;
 
-	entry->exProp("Offset") = (int)offset;
+	entry->setOffset(offset);
 }
 
 /* LfdArchive::getFileExtensionString
@@ -172,7 +172,7 @@ bool LfdArchive::open(MemChunk& mc)
 		fn.SetExt(type);
 		ArchiveEntry* nlump = new ArchiveEntry(fn.GetFullName(), length);
 		nlump->setLoaded(false);
-		nlump->exProp("Offset") = (int)offset;
+		nlump->setOffset(offset);
 		nlump->setState(0);
 
 		// Add to entry list
@@ -186,27 +186,29 @@ bool LfdArchive::open(MemChunk& mc)
 	if (num_lumps != numEntries())
 		wxLogMessage("Warning: computed %i lumps, but actually %i entries", num_lumps, numEntries());
 
-	// Detect all entry types
-	MemChunk edata;
+	// Read all entry data
+	vector<ArchiveEntry*> all_entries;
 	theSplashWindow->setProgressMessage("Detecting entry types");
 	for (size_t a = 0; a < numEntries(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_lumps)));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
+		all_entries.push_back(entry);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
 		{
 			// Read the entry data
-			mc.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
-			entry->importMemChunk(edata);
+			readEntryData(entry, mc, getEntryOffset(entry));
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	EntryType::detectEntryTypes(all_entries);
+
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
 
 		// Unload entry data if needed
 		if (!archive_load_data)
@@ -244,7 +246,7 @@ bool LfdArchive::write(MemChunk& mc, bool update)
 		if (update)
 		{
 			entry->setState(0);
-			entry->exProp("Offset") = (int)total_size;
+			entry->setOffset(total_size);
 		}
 		total_size += entry->getSize();
 	}
@@ -323,6 +325,10 @@ bool LfdArchive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
+	// Read from the source data if possible
+	if (loadEntrySourceData(entry, getEntryOffset(entry)))
+		return true;
+
 	// Open lfdfile
 	wxFile file(filename);
 
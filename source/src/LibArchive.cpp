@@ -35,8 +35,10 @@
 
 
 /*******************************************************************
- * VARIABLES
+ * EXTERNAL VARIABLES
  *******************************************************************/
+EXTERN_CVAR(Bool, archive_load_data)
+
 
 /*******************************************************************
  * LIBARCHIVE CLASS FUNCTIONS
@@ -67,7 +69,7 @@ uint32_t LibArchive::getEntryOffset(ArchiveEntry* entry)
 	if (!checkEntry(entry))
 		return 0;
 
-	return (uint32_t)(int)entry->exProp("Offset");
+	return entry->getOffset();
 }
 
 /* LibArchive::setEntryOffset
@@ -79,7 +81,7 @@ void LibArchive::setEntryOffset(ArchiveEntry* entry, uint32_t offset)
 	if (!checkEntry(entry))
 		return;
 
-	entry->exProp("Offset") = (int)offset;
+	entry->setOffset(offset);
 }
 
 /* LibArchive::getFileExtensionString
@@ -153,7 +155,7 @@ bool LibArchive::open(MemChunk& mc)
 		// Create & setup lump
 		ArchiveEntry* nlump = new ArchiveEntry(wxString::FromAscii(myname), size);
 		nlump->setLoaded(false);
-		nlump->exProp("Offset") = (int)offset;
+		nlump->setOffset(offset);
 		nlump->setState(0);
 
 		// Add to entry list
@@ -161,30 +163,33 @@ bool LibArchive::open(MemChunk& mc)
 		//entries.push_back(nlump);
 	}
 
-	// Detect all entry types
-	MemChunk edata;
+	// Read all entry data
+	vector<ArchiveEntry*> all_entries;
 	theSplashWindow->setProgressMessage("Detecting entry types");
 	for (size_t a = 0; a < numEntries(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_lumps)));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
+		all_entries.push_back(entry);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
-		{
-			// Read the entry data
-			mc.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
-			entry->importMemChunk(edata);
-		}
+			readEntryData(entry, mc, getEntryOffset(entry));
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	EntryType::detectEntryTypes(all_entries);
+
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
 
 		// Set entry to unchanged
 		entry->setState(0);
+
+		// Unload entry data if needed (can only be reloaded from the mapped file)
+		if (!archive_load_data && data_source)
+			entry->unloadData();
 	}
 
 	// Detect maps (will detect map entry types)
@@ -212,13 +217,17 @@ bool LibArchive::write(MemChunk& mc, bool update)
 	if (numEntries() > 65535)
 		return false;
 
+	// Determine individual file offsets
+	// (entry offsets aren't updated until the files have been written,
+	// as unloaded files are read from their current offset)
 	uint16_t num_files = numEntries();
 	uint32_t dir_offset = 0;
 	ArchiveEntry* entry = NULL;
+	vector<uint32_t> offsets(num_files);
 	for (uint16_t l = 0; l < num_files; l++)
 	{
 		entry = getEntry(l);
-		setEntryOffset(entry, dir_offset);
+		offsets[l] = dir_offset;
 		dir_offset += entry->getSize();
 	}
 
@@ -239,7 +248,7 @@ bool LibArchive::write(MemChunk& mc, bool update)
 	{
 		entry = getEntry(l);
 		char name[13] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-		long offset = wxINT32_SWAP_ON_BE(getEntryOffset(entry));
+		long offset = wxINT32_SWAP_ON_BE(offsets[l]);
 		long size = wxINT32_SWAP_ON_BE(entry->getSize());
 
 		for (size_t c = 0; c < entry->getName().length() && c < 12; c++)
@@ -252,7 +261,7 @@ bool LibArchive::write(MemChunk& mc, bool update)
 		if (update)
 		{
 			entry->setState(0);
-			entry->exProp("Offset") = (int)wxINT32_SWAP_ON_BE(offset);
+			entry->setOffset(wxINT32_SWAP_ON_BE(offset));
 		}
 	}
 
@@ -282,6 +291,10 @@ bool LibArchive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
+	// Read from the mapped file if possible
+	if (loadEntrySourceData(entry, getEntryOffset(entry)))
+		return true;
+
 	// Open wadfile
 	wxFile file(filename);
 
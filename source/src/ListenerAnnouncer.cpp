@@ -34,6 +34,36 @@
 #include "ListenerAnnouncer.h"
 
 
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+WX_DECLARE_STRING_HASH_MAP(int, EventIdMap);
+
+
+/*******************************************************************
+ * FUNCTIONS
+ *******************************************************************/
+
+/* eventIds
+ * Returns the map of event names to their ids (created on first use,
+ * since ids are looked up during static initialisation)
+ *******************************************************************/
+static EventIdMap& eventIds()
+{
+	static EventIdMap ids;
+	return ids;
+}
+
+/* eventNames
+ * Returns the list of event names, indexed by id
+ *******************************************************************/
+static vector<string>& eventNames()
+{
+	static vector<string> names;
+	return names;
+}
+
+
 /*******************************************************************
  * LISTENER CLASS FUNCTIONS
  *******************************************************************/
@@ -88,6 +118,17 @@ void Listener::onAnnouncement(Announcer* announcer, string event_name, MemChunk&
 {
 }
 
+/* Listener::onEvent
+ * Called when an announcer that this listener is listening to
+ * announces the event [event_id], with any typed [data] the event
+ * sends. By default this passes the event on to onAnnouncement by
+ * name, listeners can override it to compare event ids instead
+ *******************************************************************/
+void Listener::onEvent(Announcer* announcer, int event_id, MemChunk& event_data, AnnouncementData* data)
+{
+	onAnnouncement(announcer, Announcer::eventName(event_id), event_data);
+}
+
 
 /*******************************************************************
  * ANNOUNCER CLASS FUNCTIONS
@@ -134,10 +175,12 @@ void Announcer::removeListener(Listener* l)
 }
 
 /* Announcer::announce
- * 'Announces' an event to all listeners currently in the listeners
- * list, ie all Listeners that are 'listening' to this announcer.
+ * 'Announces' event [event_id] to all listeners currently in the
+ * listeners list, ie all Listeners that are 'listening' to this
+ * announcer. [data] is any typed data the event sends (see
+ * AnnouncementData), it only needs to exist during the call
  *******************************************************************/
-void Announcer::announce(string event_name, MemChunk& event_data)
+void Announcer::announce(int event_id, MemChunk& event_data, AnnouncementData* data)
 {
 	if (isMuted())
 		return;
@@ -145,10 +188,28 @@ void Announcer::announce(string event_name, MemChunk& event_data)
 	for (size_t a = 0; a < listeners.size(); a++)
 	{
 		if (!listeners[a]->isDeaf())
-			listeners[a]->onAnnouncement(this, event_name, event_data);
+			listeners[a]->onEvent(this, event_id, event_data, data);
 	}
 }
 
+/* Announcer::announce
+ * 'Announces' event [event_id] to all listeners, for events that
+ * don't require any extra data
+ *******************************************************************/
+void Announcer::announce(int event_id)
+{
+	MemChunk mc;
+	announce(event_id, mc);
+}
+
+/* Announcer::announce
+ * 'Announces' the event named [event_name] to all listeners
+ *******************************************************************/
+void Announcer::announce(string event_name, MemChunk& event_data)
+{
+	announce(eventId(event_name), event_data);
+}
+
 /* Announcer::announce
  * 'Announces' an event to all listeners currently in the listeners
  * list, ie all Listeners that are 'listening' to this announcer.
@@ -157,5 +218,41 @@ void Announcer::announce(string event_name, MemChunk& event_data)
 void Announcer::announce(string event_name)
 {
 	MemChunk mc;
-	announce(event_name, mc);
+	announce(eventId(event_name), mc);
+}
+
+
+/*******************************************************************
+ * ANNOUNCER CLASS STATIC FUNCTIONS
+ *******************************************************************/
+
+/* Announcer::eventId
+ * Returns the id of the event named [event_name], registering it
+ * if it hasn't been used before. Ids are only valid while the
+ * program is running, so they shouldn't be saved anywhere. Like
+ * announcing, this isn't thread safe
+ *******************************************************************/
+int Announcer::eventId(string event_name)
+{
+	EventIdMap& ids = eventIds();
+	EventIdMap::iterator i = ids.find(event_name);
+	if (i != ids.end())
+		return i->second;
+
+	int id = eventNames().size();
+	eventNames().push_back(event_name);
+	ids[event_name] = id;
+	return id;
+}
+
+/* Announcer::eventName
+ * Returns the name of the event with [event_id], or an empty string
+ * if there is no such event
+ *******************************************************************/
+string Announcer::eventName(int event_id)
+{
+	if (event_id < 0 || (unsigned)event_id >= eventNames().size())
+		return "";
+
+	return eventNames()[event_id];
 }
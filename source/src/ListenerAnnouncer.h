@@ -4,6 +4,15 @@
 
 class Announcer;
 
+// Typed data sent with an announcement, for events that need more than
+// a few values in the event data. Each event that sends it documents
+// the type listeners should cast it to
+class AnnouncementData
+{
+public:
+	virtual ~AnnouncementData() {}
+};
+
 class Listener
 {
 private:
@@ -18,6 +27,7 @@ public:
 	void stopListening(Announcer* a);
 	void clearAnnouncers() { announcers.clear(); }
 	virtual void onAnnouncement(Announcer* announcer, string event_name, MemChunk& event_data);
+	virtual void onEvent(Announcer* announcer, int event_id, MemChunk& event_data, AnnouncementData* data);
 
 	bool	isDeaf() { return deaf; }
 	void	setDeaf(bool d) { deaf = d; }
@@ -35,11 +45,17 @@ public:
 
 	void addListener(Listener* l);
 	void removeListener(Listener* l);
+	void announce(int event_id, MemChunk& event_data, AnnouncementData* data = NULL);
+	void announce(int event_id);
 	void announce(string event_name, MemChunk& event_data);
 	void announce(string event_name);
 
 	bool	isMuted() { return muted; }
 	void	setMuted(bool m) { muted = m; }
+
+	// Event ids
+	static int		eventId(string event_name);
+	static string	eventName(int event_id);
 };
 
 #endif //__LISTENERANNOUNCER_H__
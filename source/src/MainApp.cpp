@@ -455,6 +455,7 @@ void MainApp::initActions()
 	new SAction("arch_check_duplicates", "Check Duplicate Entry Names", "", "Checks the archive for any entries sharing the same name");
 	new SAction("arch_check_duplicates2", "Check Duplicate Entry Content", "", "Checks the archive for any entries sharing the same data");
 	new SAction("arch_clean_iwaddupes", "Remove Entries Duplicated from IWAD", "", "Remove entries that are exact duplicates of entries from the base resource archive");
+	new SAction("arch_compact", "&Compact", "", "Rewrite the archive file to reclaim space left unused by previous saves");
 	new SAction("arch_replace_maps", "Replace in Maps", "", "Tool to find and replace thing types, specials and textures in all maps");
 	new SAction("arch_entry_rename", "Rename", "t_rename", "Rename the selected entries");
 	new SAction("arch_entry_rename_each", "Rename Each", "t_renameeach", "Rename separately all the selected entries");
@@ -732,6 +733,7 @@ bool MainApp::OnInit()
 
 	// Bind events
 	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainApp::onMenu, this);
+	Bind(wxEVT_IDLE, &MainApp::onIdle, this);
 
 	return true;
 }
@@ -1021,6 +1023,21 @@ void MainApp::onMenu(wxCommandEvent& e)
 		e.Skip();
 }
 
+/* MainApp::onIdle
+ * Called when the application is idle
+ *******************************************************************/
+void MainApp::onIdle(wxIdleEvent& e)
+{
+	// Apply any entry types detected in the background
+	theArchiveManager->updateTypeDetection();
+
+	// Unload entry data if over the memory budget (it's safe to do so
+	// now, as nothing can be using it)
+	theArchiveManager->enforceDataBudget();
+
+	e.Skip();
+}
+
 
 CONSOLE_COMMAND (crash, 0, false)
 {
@@ -70,6 +70,7 @@ public:
 	void		toggleAction(string id);
 
 	void	onMenu(wxCommandEvent& e);
+	void	onIdle(wxIdleEvent& e);
 };
 
 #define theApp ((MainApp*)wxTheApp)
@@ -8,6 +8,8 @@
  * Filename:    MemChunk.cpp
  * Description: MemChunk class, a simple data structure for
  *              storing/handling arbitrary sized chunks of memory.
+ *              Also contains MemBlock, a shared read-only block of
+ *              memory that MemChunks can view without copying it.
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License
@@ -32,6 +34,108 @@
 #include "MemChunk.h"
 #include "Misc.h"
 #include <wx/log.h>
+#ifndef __WXMSW__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+/*******************************************************************
+ * MEMBLOCK CLASS FUNCTIONS
+ *******************************************************************/
+
+/* MemBlock::MemBlock
+ * MemBlock class constructor. The block starts with a single
+ * reference, held by whoever created it
+ *******************************************************************/
+MemBlock::MemBlock(uint8_t* data, uint32_t size, bool mapped)
+{
+	this->data = data;
+	this->size = size;
+	this->mapped = mapped;
+	this->refs = 1;
+}
+
+/* MemBlock::~MemBlock
+ * MemBlock class destructor
+ *******************************************************************/
+MemBlock::~MemBlock()
+{
+#ifndef __WXMSW__
+	if (mapped)
+	{
+		munmap(data, size);
+		return;
+	}
+#endif
+
+	delete[] data;
+}
+
+/* MemBlock::addRef
+ * Adds a reference to the block
+ *******************************************************************/
+void MemBlock::addRef()
+{
+	wxAtomicInc(refs);
+}
+
+/* MemBlock::release
+ * Removes a reference to the block, deleting it if it was the last
+ *******************************************************************/
+void MemBlock::release()
+{
+	if (wxAtomicDec(refs) == 0)
+		delete this;
+}
+
+/* MemBlock::mapFile
+ * Maps [filename] into memory read-only. Returns the new block or
+ * NULL if the file couldn't be mapped (mapping isn't used on Windows
+ * as a mapped file can't be replaced when saving)
+ *******************************************************************/
+MemBlock* MemBlock::mapFile(string filename)
+{
+#ifdef __WXMSW__
+	return NULL;
+#else
+	// Open the file
+	int fd = ::open(filename.fn_str(), O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	// Get the file size, empty or >4gb files can't be mapped
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size <= 0 || (uint64_t)info.st_size > 0xFFFFFFFF)
+	{
+		::close(fd);
+		return NULL;
+	}
+
+	// Map it (the mapping stays valid after the file is closed)
+	void* ptr = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (ptr == MAP_FAILED)
+	{
+		wxLogMessage("MemBlock::mapFile: Unable to map file %s", CHR(filename));
+		return NULL;
+	}
+
+	return new MemBlock((uint8_t*)ptr, (uint32_t)info.st_size, true);
+#endif
+}
+
+
+/* MemBlock::fromData
+ * Creates a new block that takes ownership of [data] (which must
+ * have been allocated with new[])
+ *******************************************************************/
+MemBlock* MemBlock::fromData(uint8_t* data, uint32_t size)
+{
+	return new MemBlock(data, size, false);
+}
 
 
 /*******************************************************************
@@ -46,6 +150,7 @@ MemChunk::MemChunk(uint32_t size)
 	// Init variables
 	this->size = size;
 	this->cur_ptr = 0;
+	this->block = NULL;
 
 	// If a size is specified, allocate that much memory
 	if (size)
@@ -63,6 +168,7 @@ MemChunk::MemChunk(const uint8_t* data, uint32_t size)
 	this->cur_ptr = 0;
 	this->data = NULL;
 	this->size = size;
+	this->block = NULL;
 
 	// Load given data
 	importMem(data, size);
@@ -74,7 +180,9 @@ MemChunk::MemChunk(const uint8_t* data, uint32_t size)
 MemChunk::~MemChunk()
 {
 	// Free memory
-	if (data)
+	if (block)
+		block->release();
+	else if (data)
 		delete[] data;
 }
 
@@ -89,6 +197,21 @@ bool MemChunk::hasData()
 		return false;
 }
 
+/* MemChunk::shareData
+ * Moves the data into a shared block if it isn't already (without
+ * copying it) and returns the block, or NULL if there is no data
+ *******************************************************************/
+MemBlock* MemChunk::shareData()
+{
+	if (!hasData())
+		return NULL;
+
+	if (!block)
+		block = MemBlock::fromData(data, size);
+
+	return block;
+}
+
 /* MemChunk::clear
  * Deletes the memory chunk.
  * Returns false if no data exists, true otherwise.
@@ -97,7 +220,13 @@ bool MemChunk::clear()
 {
 	if (hasData())
 	{
-		delete[] data;
+		if (block)
+		{
+			block->release();
+			block = NULL;
+		}
+		else
+			delete[] data;
 		data = NULL;
 		size = 0;
 		cur_ptr = 0;
@@ -123,6 +252,9 @@ bool MemChunk::reSize(uint32_t new_size, bool preserve_data)
 	// Resize data
 	if (preserve_data)
 	{
+		// Get a private copy of the data first if it's shared
+		detach();
+
 		uint8_t* ndata = (uint8_t*)realloc(data, new_size);
 		if (ndata)
 			data = ndata;
@@ -260,6 +392,83 @@ bool MemChunk::importMem(const uint8_t* start, uint32_t len)
 	return true;
 }
 
+/* MemChunk::importBlock
+ * Makes the MemChunk a read-only view of [len] bytes at [offset] in
+ * [block] (to the end of the block if [len] is 0). The data isn't
+ * copied until the MemChunk is modified.
+ * Returns false if [offset] is invalid, true otherwise
+ *******************************************************************/
+bool MemChunk::importBlock(MemBlock* block, uint32_t offset, uint32_t len)
+{
+	// Check parameters
+	if (!block || offset > block->getSize())
+		return false;
+
+	// If length isn't specified or exceeds the block size,
+	// only view to the end of the block
+	if (len == 0 || offset + len > block->getSize())
+		len = block->getSize() - offset;
+
+	// Add reference before clearing, in case we already view this block
+	block->addRef();
+	clear();
+
+	// Nothing to view
+	if (len == 0)
+	{
+		block->release();
+		return true;
+	}
+
+	// Setup view
+	this->block = block;
+	data = (uint8_t*)block->getData() + offset;
+	size = len;
+	cur_ptr = 0;
+
+	return true;
+}
+
+/* MemChunk::importView
+ * Makes the MemChunk a read-only view of [len] bytes at [offset] in
+ * [mc] (to the end of [mc] if [len] is 0), without copying any data.
+ * If [mc] isn't already a view its data is moved into a shared block
+ * first, so both MemChunks will copy it if modified afterwards.
+ * Returns false if [offset] is invalid, true otherwise
+ *******************************************************************/
+bool MemChunk::importView(MemChunk& mc, uint32_t offset, uint32_t len)
+{
+	// Check parameters
+	if (&mc == this || !mc.hasData() || offset >= mc.size)
+		return false;
+
+	// If length isn't specified or exceeds the chunk size,
+	// only view to the end of the chunk
+	if (len == 0 || offset + len > mc.size)
+		len = mc.size - offset;
+
+	// Share the other chunk's data if it isn't already shared
+	mc.shareData();
+
+	return importBlock(mc.block, (mc.data - mc.block->getData()) + offset, len);
+}
+
+/* MemChunk::importFileMapped
+ * Maps a file into memory and makes the MemChunk a read-only view
+ * of it. Falls back to importFile if the file can't be mapped.
+ * Returns false if file couldn't be opened, true otherwise
+ *******************************************************************/
+bool MemChunk::importFileMapped(string filename)
+{
+	MemBlock* mapping = MemBlock::mapFile(filename);
+	if (!mapping)
+		return importFile(filename);
+
+	bool ok = importBlock(mapping);
+	mapping->release();
+	return ok;
+}
+
 /* MemChunk::exportFile
  * Writes the MemChunk data to a new file of [filename], starting
  * from [start] to [start+size]. If [size] is 0, writes from [start]
@@ -333,6 +542,9 @@ bool MemChunk::write(const void* data, uint32_t size)
 	if (cur_ptr + size > this->size)
 		reSize(cur_ptr + size, true);
 
+	// Can't write to shared data
+	detach();
+
 	// Write the data and move to the byte after what was written
 	memcpy(this->data + cur_ptr, data, size);
 	cur_ptr += size;
@@ -449,12 +661,30 @@ bool MemChunk::fillData(uint8_t val)
 		return false;
 
 	// Fill data with value
+	detach();
 	memset(data, val, size);
 
 	// Success
 	return true;
 }
 
+/* MemChunk::detach
+ * If the MemChunk is a view into a shared MemBlock, copies the
+ * viewed data into a private buffer so it can be modified
+ *******************************************************************/
+void MemChunk::detach()
+{
+	// Nothing to do if the data isn't shared
+	if (!block)
+		return;
+
+	uint8_t* ndata = new uint8_t[size];
+	memcpy(ndata, data, size);
+	block->release();
+	block = NULL;
+	data = ndata;
+}
+
 /* MemChunk::crc
  * Calculates the 32bit CRC value of the data. Returns the CRC or 0
  * if no data is present
@@ -466,3 +696,68 @@ uint32_t MemChunk::crc()
 	else
 		return 0;
 }
+
+
+/*******************************************************************
+ * MEMCHUNKOUTPUTSTREAM CLASS FUNCTIONS
+ *******************************************************************/
+
+/* MemChunkOutputStream::MemChunkOutputStream
+ * MemChunkOutputStream class constructor
+ *******************************************************************/
+MemChunkOutputStream::MemChunkOutputStream(MemChunk& mc) : mc(mc)
+{
+	mc.clear();
+	length = 0;
+}
+
+/* MemChunkOutputStream::~MemChunkOutputStream
+ * MemChunkOutputStream class destructor. The MemChunk grows in
+ * doubling steps while writing, so shrink it to what was written
+ *******************************************************************/
+MemChunkOutputStream::~MemChunkOutputStream()
+{
+	if (length == 0)
+		mc.clear();
+	else if (mc.getSize() > length)
+		mc.reSize(length, true);
+}
+
+/* MemChunkOutputStream::OnSysWrite
+ * Writes [size] bytes from [buffer] to the MemChunk at the current
+ * position, growing it if needed
+ *******************************************************************/
+size_t MemChunkOutputStream::OnSysWrite(const void* buffer, size_t size)
+{
+	uint64_t end = (uint64_t)mc.currentPos() + size;
+	if (end > 0xFFFFFFFF)
+	{
+		m_lasterror = wxSTREAM_WRITE_ERROR;
+		return 0;
+	}
+
+	// Grow the chunk if needed
+	if (end > mc.getSize())
+	{
+		uint64_t new_size = MAX(end, (uint64_t)mc.getSize() * 2);
+		if (!mc.reSize((uint32_t)MIN(new_size, 0xFFFFFFFF), true))
+		{
+			m_lasterror = wxSTREAM_WRITE_ERROR;
+			return 0;
+		}
+	}
+
+	mc.write(buffer, size);
+	if (mc.currentPos() > length)
+		length = mc.currentPos();
+
+	return size;
+}
+
+/* MemChunkOutputStream::OnSysTell
+ * Returns the current write position
+ *******************************************************************/
+wxFileOffset MemChunkOutputStream::OnSysTell() const
+{
+	return mc.currentPos();
+}
@@ -2,25 +2,59 @@
 #ifndef __MEMCHUNK_H__
 #define __MEMCHUNK_H__
 
+#include <wx/atomic.h>
+#include <wx/stream.h>
+
+// A reference counted, read-only block of memory (usually a memory
+// mapped file) that can be shared between any number of MemChunks
+class MemBlock
+{
+private:
+	uint8_t*	data;
+	uint32_t	size;
+	bool		mapped;
+	wxAtomicInt	refs;
+
+	MemBlock(uint8_t* data, uint32_t size, bool mapped);
+	~MemBlock();
+
+public:
+	const uint8_t*	getData() { return data; }
+	uint32_t		getSize() { return size; }
+	bool			isMapped() { return mapped; }
+
+	void	addRef();
+	void	release();
+
+	static MemBlock*	mapFile(string filename);
+	static MemBlock*	fromData(uint8_t* data, uint32_t size);
+};
+
 class MemChunk
 {
 protected:
 	uint8_t*	data;
 	uint32_t	cur_ptr;
 	uint32_t	size;
+	MemBlock*	block;	// If not NULL, data is a read-only view into this block
+
+	void	detach();
 
 public:
 	MemChunk(uint32_t size = 0);
 	MemChunk(const uint8_t* data, uint32_t size);
 	~MemChunk();
 
-	uint8_t& operator[](int a) { return data[a]; }
+	uint8_t operator[](int a) { return data[a]; }
 
 	// Accessors
 	const uint8_t*	getData() { return data; }
 	uint32_t		getSize() { return size; }
+	bool			isView() { return block != NULL; }
+	MemBlock*		getBlock() { return block; }
 
-	bool hasData();
+	bool		hasData();
+	MemBlock*	shareData();
 
 	bool clear();
 	bool reSize(uint32_t new_size, bool preserve_data = true);
@@ -29,6 +63,9 @@ public:
 	bool	importFile(string filename, uint32_t offset = 0, uint32_t len = 0);
 	bool	importFileStream(wxFile& file, uint32_t len = 0);
 	bool	importMem(const uint8_t* start, uint32_t len);
+	bool	importBlock(MemBlock* block, uint32_t offset = 0, uint32_t len = 0);
+	bool	importView(MemChunk& mc, uint32_t offset = 0, uint32_t len = 0);
+	bool	importFileMapped(string filename);
 
 	// Data export
 	bool	exportFile(string filename, uint32_t start = 0, uint32_t size = 0);
@@ -50,4 +87,20 @@ public:
 	uint32_t	crc();
 };
 
+// A wxOutputStream that writes to a MemChunk (which is cleared first)
+class MemChunkOutputStream : public wxOutputStream
+{
+private:
+	MemChunk&	mc;
+	uint32_t	length;
+
+public:
+	MemChunkOutputStream(MemChunk& mc);
+	~MemChunkOutputStream();
+
+protected:
+	size_t			OnSysWrite(const void* buffer, size_t size);
+	wxFileOffset	OnSysTell() const;
+};
+
 #endif //__MEMCHUNK_H__
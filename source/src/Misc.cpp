@@ -644,6 +644,52 @@ uint32_t Misc::crc(const uint8_t* buf, uint32_t len)
 	return update_crc(0xffffffffL, buf, len) ^ 0xffffffffL;
 }
 
+/* Misc::hash64
+ * Returns a fast 64-bit (non-cryptographic) hash of the bytes
+ * buf[0..len-1], starting from [seed] (MurmurHash64A)
+ *******************************************************************/
+uint64_t Misc::hash64(const uint8_t* buf, uint32_t len, uint64_t seed)
+{
+	const uint64_t m = wxULL(0xc6a4a7935bd1e995);
+	const int r = 47;
+	uint64_t h = seed ^ (len * m);
+
+	// Mix in 8 bytes at a time
+	const uint8_t* end = buf + (len & ~7);
+	while (buf != end)
+	{
+		uint64_t k;
+		memcpy(&k, buf, 8);
+		buf += 8;
+
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+
+		h ^= k;
+		h *= m;
+	}
+
+	// Mix in remaining bytes
+	switch (len & 7)
+	{
+	case 7: h ^= uint64_t(buf[6]) << 48;
+	case 6: h ^= uint64_t(buf[5]) << 40;
+	case 5: h ^= uint64_t(buf[4]) << 32;
+	case 4: h ^= uint64_t(buf[3]) << 24;
+	case 3: h ^= uint64_t(buf[2]) << 16;
+	case 2: h ^= uint64_t(buf[1]) << 8;
+	case 1: h ^= uint64_t(buf[0]);
+		h *= m;
+	};
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+
+	return h;
+}
+
 
 /* Misc::findJaguarTextureDimensions
  * Find the given name in a texture lump and returns a point2_t
@@ -141,7 +141,7 @@ bool PakArchive::open(MemChunk& mc)
 
 		// Create entry
 		ArchiveEntry* entry = new ArchiveEntry(fn.GetFullName(), size);
-		entry->exProp("Offset") = (int)offset;
+		entry->setOffset(offset);
 		entry->setLoaded(false);
 		entry->setState(0);
 
@@ -149,36 +149,33 @@ bool PakArchive::open(MemChunk& mc)
 		dir->addEntry(entry);
 	}
 
-	// Detect all entry types
-	MemChunk edata;
+	// Read all entry data
 	vector<ArchiveEntry*> all_entries;
 	getEntryTreeAsList(all_entries);
 	theSplashWindow->setProgressMessage("Detecting entry types");
 	for (size_t a = 0; a < all_entries.size(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_entries)));
-
 		// Get entry
 		ArchiveEntry* entry = all_entries[a];
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
-		{
-			// Read the entry data
-			mc.exportMemChunk(edata, (int)entry->exProp("Offset"), entry->getSize());
-			entry->importMemChunk(edata);
-		}
+			readEntryData(entry, mc, entry->getOffset());
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	EntryType::detectEntryTypes(all_entries);
 
-		// Unload entry data if needed
-		if (!archive_load_data)
-			entry->unloadData();
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
 
 		// Set entry to unchanged
 		entry->setState(0);
+
+		// Unload entry data if needed (can only be reloaded from the mapped file)
+		if (!archive_load_data && data_source)
+			entry->unloadData();
 	}
 
 	// Setup variables
@@ -197,16 +194,23 @@ bool PakArchive::open(MemChunk& mc)
  *******************************************************************/
 bool PakArchive::write(MemChunk& mc, bool update)
 {
-	// Clear current data
-	mc.clear();
+	MemChunkOutputStream out(mc);
+	return write(out, update);
+}
 
+/* PakArchive::write
+ * Writes the pak archive to [out]
+ * Returns true if successful, false otherwise
+ *******************************************************************/
+bool PakArchive::write(wxOutputStream& out, bool update)
+{
 	// Get archive tree as a list
 	vector<ArchiveEntry*> entries;
 	getEntryTreeAsList(entries);
 
 	// Process entry list
-	long dir_offset = 12;
-	long dir_size = 0;
+	uint32_t dir_offset = 12;
+	uint32_t dir_size = 0;
 	for (unsigned a = 0; a < entries.size(); a++)
 	{
 		// Ignore folder entries
@@ -218,31 +222,36 @@ bool PakArchive::write(MemChunk& mc, bool update)
 		dir_size += 64;
 	}
 
-	// Init data size
-	mc.reSize(dir_offset + dir_size, false);
-
 	// Write header
 	char pack[4] = { 'P', 'A', 'C', 'K' };
-	mc.seek(0, SEEK_SET);
-	mc.write(pack, 4);
-	mc.write(&dir_offset, 4);
-	mc.write(&dir_size, 4);
+	uint32_t header_offset = wxINT32_SWAP_ON_BE(dir_offset);
+	uint32_t header_size = wxINT32_SWAP_ON_BE(dir_size);
+	out.Write(pack, 4);
+	out.Write(&header_offset, 4);
+	out.Write(&header_size, 4);
 
-	// Write directory
-	mc.seek(dir_offset, SEEK_SET);
-	long offset = 12;
+	// Write entry data
 	for (unsigned a = 0; a < entries.size(); a++)
 	{
 		// Skip folders
 		if (entries[a]->getType() == EntryType::folderType())
 			continue;
 
-		// Update entry
-		if (update)
+		// Write data
+		if (!writeEntryData(out, entries[a], entries[a]->getOffset()))
 		{
-			entries[a]->setState(0);
-			entries[a]->exProp("Offset") = (int)offset;
+			Global::error = "Unable to write entry data";
+			return false;
 		}
+	}
+
+	// Write directory
+	uint32_t offset = 12;
+	for (unsigned a = 0; a < entries.size(); a++)
+	{
+		// Skip folders
+		if (entries[a]->getType() == EntryType::folderType())
+			continue;
 
 		// Check entry name
 		string name = entries[a]->getPath(true);
@@ -260,29 +269,40 @@ bool PakArchive::write(MemChunk& mc, bool update)
 		char name_data[56];
 		memset(name_data, 0, 56);
 		memcpy(name_data, CHR(name), name.Length());
-		mc.write(name_data, 56);
+		out.Write(name_data, 56);
 
 		// Write entry offset
-		mc.write(&offset, 4);
+		uint32_t entry_offset = wxINT32_SWAP_ON_BE(offset);
+		out.Write(&entry_offset, 4);
 
 		// Write entry size
-		long size = entries[a]->getSize();
-		mc.write(&size, 4);
+		uint32_t size = entries[a]->getSize();
+		uint32_t entry_size = wxINT32_SWAP_ON_BE(size);
+		out.Write(&entry_size, 4);
 
 		// Increment/update offset
 		offset += size;
 	}
+	if (!out.IsOk())
+	{
+		Global::error = "Unable to write pak directory";
+		return false;
+	}
 
-	// Write entry data
-	mc.seek(12, SEEK_SET);
-	for (unsigned a = 0; a < entries.size(); a++)
+	// Update entries (after writing, as unloaded entries are read from their current offset)
+	if (update)
 	{
-		// Skip folders
-		if (entries[a]->getType() == EntryType::folderType())
-			continue;
+		offset = 12;
+		for (unsigned a = 0; a < entries.size(); a++)
+		{
+			// Skip folders
+			if (entries[a]->getType() == EntryType::folderType())
+				continue;
 
-		// Write data
-		mc.write(entries[a]->getData(), entries[a]->getSize());
+			entries[a]->setState(0);
+			entries[a]->setOffset(offset);
+			offset += entries[a]->getSize();
+		}
 	}
 
 	return true;
@@ -306,6 +326,10 @@ bool PakArchive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
+	// Read from the mapped file if possible
+	if (loadEntrySourceData(entry, entry->getOffset()))
+		return true;
+
 	// Open archive file
 	wxFile file(filename);
 
@@ -317,7 +341,7 @@ bool PakArchive::loadEntryData(ArchiveEntry* entry)
 	}
 
 	// Seek to entry offset in file and read it in
-	file.Seek((int)entry->exProp("Offset"), wxFromStart);
+	file.Seek(entry->getOffset(), wxFromStart);
 	entry->importFileStream(file, entry->getSize());
 
 	// Set the lump to loaded
@@ -1056,7 +1056,8 @@ bool PaletteEntryPanel::generateColormaps()
 			}
 			rgba[0] = rgb.r; rgba[1] = rgb.g; rgba[2] = rgb.b;
 			imc.write(&rgba, 4);
-			mc[(256*l)+c] = palettes[0]->nearestColour(rgb);
+			uint8_t index = palettes[0]->nearestColour(rgb);
+			mc.write(&index, 1, (256*l)+c);
 		}
 	}
 #if 0
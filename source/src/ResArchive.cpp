@@ -66,7 +66,7 @@ uint32_t ResArchive::getEntryOffset(ArchiveEntry* entry)
 	if (!checkEntry(entry))
 		return 0;
 
-	return (uint32_t)(int)entry->exProp("Offset");
+	return entry->getOffset();
 }
 
 /* ResArchive::setEntryOffset
@@ -78,7 +78,7 @@ void ResArchive::setEntryOffset(ArchiveEntry* entry, uint32_t offset)
 	if (!checkEntry(entry))
 		return;
 
-	entry->exProp("Offset") = (int)offset;
+	entry->setOffset(offset);
 }
 
 /* ResArchive::getFileExtensionString
@@ -161,16 +161,14 @@ bool ResArchive::readDirectory(MemChunk& mc, size_t dir_offset, size_t num_lumps
 		// Create & setup lump
 		ArchiveEntry* nlump = new ArchiveEntry(wxString::FromAscii(name), size);
 		nlump->setLoaded(false);
-		nlump->exProp("Offset") = (int)offset;
+		nlump->setOffset(offset);
 		nlump->setState(0);
 
 		// Read entry data if it isn't zero-sized
 		if (nlump->getSize() > 0)
 		{
 			// Read the entry data
-			MemChunk edata;
-			mc.exportMemChunk(edata, offset, size);
-			nlump->importMemChunk(edata);
+			readEntryData(nlump, mc, offset);
 		}
 
 		// What if the entry is a directory?
@@ -317,7 +315,7 @@ bool ResArchive::write(MemChunk& mc, bool update)
 
 			if (update) {
 				entry->setState(0);
-				entry->exProp("Offset") = (int)offset;
+				entry->setOffset(offset);
 			}
 		}
 	*/
@@ -342,6 +340,10 @@ bool ResArchive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
+	// Read from the source data if possible
+	if (loadEntrySourceData(entry, getEntryOffset(entry)))
+		return true;
+
 	// Open resfile
 	wxFile file(filename);
 
@@ -169,6 +169,7 @@ int TextureResource::length()
  *******************************************************************/
 ResourceManager::ResourceManager()
 {
+	updated_pending = false;
 }
 
 /* ResourceManager::~ResourceManager
@@ -741,15 +742,18 @@ CTexture* ResourceManager::getTexture(string texture, Archive* priority, Archive
 		return NULL;
 }
 
-/* ResourceManager::onAnnouncement
- * Called when an announcement is recieved from any managed archive
+/* ResourceManager::onEvent
+ * Called when an announcement is recieved from any managed archive.
+ * Changes during a batch are only announced as 'resources_updated'
+ * once, when the batch ends
  *******************************************************************/
-void ResourceManager::onAnnouncement(Announcer* announcer, string event_name, MemChunk& event_data)
+void ResourceManager::onEvent(Announcer* announcer, int event_id, MemChunk& event_data, AnnouncementData* data)
 {
 	event_data.seek(0, SEEK_SET);
+	Archive* archive = (Archive*)announcer;
 
 	// An entry is modified
-	if (event_name == "entry_state_changed")
+	if (event_id == ArchiveEvent::ENTRY_STATE_CHANGED)
 	{
 		wxUIntPtr ptr;
 		event_data.read(&ptr, sizeof(wxUIntPtr), 4);
@@ -759,18 +763,48 @@ void ResourceManager::onAnnouncement(Announcer* announcer, string event_name, Me
 		announce("resources_updated");
 	}
 
+	// Entry types were detected after the archive was opened
+	if (event_id == ArchiveEvent::ENTRY_TYPES_DETECTED)
+	{
+		vector<ArchiveEntry*> entries;
+		((Archive*)announcer)->getEntryTreeAsList(entries);
+		for (unsigned a = 0; a < entries.size(); a++)
+		{
+			removeEntry(entries[a]);
+			addEntry(entries[a]);
+		}
+		announce("resources_updated");
+	}
+
 	// An entry is removed or renamed
-	if (event_name == "entry_removing" || event_name == "entry_renaming")
+	if (event_id == ArchiveEvent::ENTRY_REMOVING || event_id == ArchiveEvent::ENTRY_RENAMING)
 	{
 		wxUIntPtr ptr;
 		event_data.read(&ptr, sizeof(wxUIntPtr), sizeof(int));
 		ArchiveEntry* entry = (ArchiveEntry*)wxUIntToPtr(ptr);
 		removeEntry(entry);
-		announce("resources_updated");
+		if (archive->isBatching())
+			updated_pending = true;
+		else
+			announce("resources_updated");
+	}
+
+	// Entries were changed in a batch
+	if (event_id == ArchiveEvent::ENTRIES_CHANGED)
+	{
+		EntriesChangedData* changes = (EntriesChangedData*)data;
+		for (unsigned a = 0; a < changes->entries.size(); a++)
+		{
+			removeEntry(changes->entries[a]);
+			addEntry(changes->entries[a]);
+		}
+		if (!changes->entries.empty() || updated_pending)
+			announce("resources_updated");
+		updated_pending = false;
 	}
 
 	// An entry is added
-	if (event_name == "entry_added")
+	if (event_id == ArchiveEvent::ENTRY_ADDED)
 	{
 		wxUIntPtr ptr;
 		event_data.read(&ptr, sizeof(wxUIntPtr), 4);
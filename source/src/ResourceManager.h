@@ -73,6 +73,7 @@ private:
 	EntryResourceMap	flats;
 	EntryResourceMap	satextures;	// Stand Alone textures (e.g., between TX_ or T_ markers)
 	TextureResourceMap	textures;	// Composite textures (defined in a TEXTUREx/TEXTURES lump)
+	bool				updated_pending;	// Resources changed during an archive's batch (see Archive::beginBatch)
 
 	static ResourceManager*	instance;
 	static string Doom64HashTable[65536];
@@ -112,7 +113,7 @@ public:
 	string			getTextureName(uint16_t hash) { return Doom64HashTable[hash]; }
 	uint16_t		getTextureHash(string name);
 
-	void	onAnnouncement(Announcer* announcer, string event_name, MemChunk& event_data);
+	void	onEvent(Announcer* announcer, int event_id, MemChunk& event_data, AnnouncementData* data);
 };
 
 // Define for less cumbersome ResourceManager::getInstance()
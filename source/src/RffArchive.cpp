@@ -134,7 +134,7 @@ uint32_t RffArchive::getEntryOffset(ArchiveEntry* entry)
 	if (!checkEntry(entry))
 		return 0;
 
-	return (uint32_t)(int)entry->exProp("Offset");
+	return entry->getOffset();
 }
 
 /* RffArchive::setEntryOffset
@@ -146,7 +146,7 @@ void RffArchive::setEntryOffset(ArchiveEntry* entry, uint32_t offset)
 	if (!checkEntry(entry))
 		return;
 
-	entry->exProp("Offset") = (int)offset;
+	entry->setOffset(offset);
 }
 
 /* RffArchive::getFileExtensionString
@@ -240,7 +240,7 @@ bool RffArchive::open(MemChunk& mc)
 		// Create & setup lump
 		ArchiveEntry* nlump = new ArchiveEntry(wxString::FromAscii(name), size);
 		nlump->setLoaded(false);
-		nlump->exProp("Offset") = (int)offset;
+		nlump->setOffset(offset);
 		nlump->setState(0);
 
 		// Is the entry encrypted?
@@ -252,16 +252,15 @@ bool RffArchive::open(MemChunk& mc)
 	}
 	delete[] lumps;
 
-	// Detect all entry types
+	// Read all entry data
 	MemChunk edata;
+	vector<ArchiveEntry*> all_entries;
 	theSplashWindow->setProgressMessage("Detecting entry types");
 	for (size_t a = 0; a < numEntries(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_lumps)));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
+		all_entries.push_back(entry);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
@@ -283,9 +282,14 @@ bool RffArchive::open(MemChunk& mc)
 			// Import data
 			entry->importMemChunk(edata);
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	EntryType::detectEntryTypes(all_entries);
+
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
 
 		// Unload entry data if needed
 		if (!archive_load_data)
@@ -448,7 +452,6 @@ bool RffArchive::isRffArchive(MemChunk& mc)
 	// Compute total size
 	RFFLump* lumps = new RFFLump[num_lumps];
 	mc.seek(dir_offset, SEEK_SET);
-	theSplashWindow->setProgressMessage("Reading rff archive data");
 	mc.read (lumps, num_lumps * sizeof(RFFLump));
 	BloodCrypt (lumps, dir_offset, num_lumps * sizeof(RFFLump));
 	uint32_t totalsize = 12 + num_lumps * sizeof(RFFLump);
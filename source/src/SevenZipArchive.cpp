@@ -0,0 +1,503 @@
+
+/*******************************************************************
+ * SLADE - It's a Doom Editor
+ * Copyright (C) 2008-2012 Simon Judd
+ *
+ * Email:       sirjuddington@gmail.com
+ * Web:         http://slade.mancubus.net
+ * Filename:    SevenZipArchive.cpp
+ * Description: SevenZipArchive, archive class to read 7z archives
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *******************************************************************/
+
+
+/*******************************************************************
+ * INCLUDES
+ *******************************************************************/
+#include "Main.h"
+#include "SevenZipArchive.h"
+#include "SplashWindow.h"
+#include "Misc.h"
+#include "lzma/C/7zCrc.h"
+#include <wx/filename.h>
+#include <wx/stopwatch.h>
+
+
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+CVAR(Int, archive_7z_block_cache, 128, CVAR_SAVE)	// Max MB of decompressed solid blocks kept by each 7z archive
+
+
+/*******************************************************************
+ * EXTERNAL VARIABLES
+ *******************************************************************/
+EXTERN_CVAR(Bool, archive_load_data)
+
+
+/*******************************************************************
+ * 7Z STUFF
+ *******************************************************************/
+
+// Allocation functions for the 7z decoder
+static void* szAlloc(void* p, size_t size) { return size ? malloc(size) : NULL; }
+static void szFree(void* p, void* address) { free(address); }
+static ISzAlloc sz_alloc = { szAlloc, szFree };
+
+// A 7z decoder input stream reading directly from memory
+struct memstream_t
+{
+	ILookInStream	s;	// Must be first
+	const Byte*		data;
+	size_t			size;
+	size_t			pos;
+};
+
+static SRes memLook(void* p, const void** buf, size_t* size)
+{
+	memstream_t* stream = (memstream_t*)p;
+	if (*size > stream->size - stream->pos)
+		*size = stream->size - stream->pos;
+	*buf = stream->data + stream->pos;
+	return SZ_OK;
+}
+
+static SRes memSkip(void* p, size_t offset)
+{
+	memstream_t* stream = (memstream_t*)p;
+	stream->pos = MIN(stream->pos + offset, stream->size);
+	return SZ_OK;
+}
+
+static SRes memRead(void* p, void* buf, size_t* size)
+{
+	memstream_t* stream = (memstream_t*)p;
+	if (*size > stream->size - stream->pos)
+		*size = stream->size - stream->pos;
+	memcpy(buf, stream->data + stream->pos, *size);
+	stream->pos += *size;
+	return SZ_OK;
+}
+
+static SRes memSeek(void* p, Int64* pos, ESzSeek origin)
+{
+	memstream_t* stream = (memstream_t*)p;
+	Int64 base = 0;
+	if (origin == SZ_SEEK_CUR)
+		base = stream->pos;
+	else if (origin == SZ_SEEK_END)
+		base = stream->size;
+
+	if (base + *pos < 0 || base + *pos > (Int64)stream->size)
+		return SZ_ERROR_READ;
+
+	stream->pos = (size_t)(base + *pos);
+	*pos = stream->pos;
+	return SZ_OK;
+}
+
+static void initMemStream(memstream_t& stream, MemChunk& mc)
+{
+	stream.s.Look = memLook;
+	stream.s.Skip = memSkip;
+	stream.s.Read = memRead;
+	stream.s.Seek = memSeek;
+	stream.data = mc.getData();
+	stream.size = mc.getSize();
+	stream.pos = 0;
+}
+
+
+/*******************************************************************
+ * SEVENZIPARCHIVE CLASS FUNCTIONS
+ *******************************************************************/
+
+/* SevenZipArchive::SevenZipArchive
+ * SevenZipArchive class constructor
+ *******************************************************************/
+SevenZipArchive::SevenZipArchive() : Archive(ARCHIVE_7Z)
+{
+	SzArEx_Init(&db);
+	db_open = false;
+	cache_size = 0;
+}
+
+/* SevenZipArchive::~SevenZipArchive
+ * SevenZipArchive class destructor
+ *******************************************************************/
+SevenZipArchive::~SevenZipArchive()
+{
+	clearBlockCache();
+	SzArEx_Free(&db, &sz_alloc);
+}
+
+/* SevenZipArchive::getFileExtensionString
+ * Returns the file extension string to use in the file open dialog
+ *******************************************************************/
+string SevenZipArchive::getFileExtensionString()
+{
+	return "7-Zip Files (*.7z)|*.7z";
+}
+
+/* SevenZipArchive::getFormat
+ * Returns the string id for the 7z EntryDataFormat
+ *******************************************************************/
+string SevenZipArchive::getFormat()
+{
+	return "archive_7z";
+}
+
+/* SevenZipArchive::getBlock
+ * Returns the decompressed data of [folder] (a solid block), from
+ * the block cache if possible. Returns NULL if it couldn't be
+ * decompressed. The block is only valid until the next call unless
+ * a reference is added to it
+ *******************************************************************/
+MemBlock* SevenZipArchive::getBlock(uint32_t folder)
+{
+	// Check the cache
+	for (unsigned a = 0; a < block_cache.size(); a++)
+	{
+		if (block_cache[a].folder == folder)
+		{
+			// Move it to the front
+			block_t block = block_cache[a];
+			block_cache.erase(block_cache.begin() + a);
+			block_cache.insert(block_cache.begin(), block);
+			return block.data;
+		}
+	}
+
+	// Get the archive data
+	MemChunk mc;
+	if (!getSourceData(mc, 0, 0))
+	{
+		wxLogMessage("SevenZipArchive::getBlock: No 7z data to decompress from");
+		return NULL;
+	}
+
+	// Check the block size
+	CSzFolder* f = db.db.Folders + folder;
+	UInt64 size = SzFolder_GetUnpackSize(f);
+	if (size == 0 || size > 0xFFFFFFFF)
+	{
+		wxLogMessage("SevenZipArchive::getBlock: Solid block %d has an unsupported size", folder);
+		return NULL;
+	}
+
+	// Decompress it
+	wxStopWatch sw;
+	memstream_t stream;
+	initMemStream(stream, mc);
+	uint8_t* data = new uint8_t[size];
+	UInt32 pack_index = db.FolderStartPackStreamIndex[folder];
+	UInt64 start = db.dataPos + db.PackStreamStartPositions[pack_index];
+	SRes res = SzFolder_Decode(f, db.db.PackSizes + pack_index, &stream.s, start, data, (size_t)size, &sz_alloc);
+	if (res == SZ_OK && f->UnpackCRCDefined && CrcCalc(data, (size_t)size) != f->UnpackCRC)
+		res = SZ_ERROR_CRC;
+	if (res != SZ_OK)
+	{
+		wxLogMessage("SevenZipArchive::getBlock: Unable to decompress solid block %d (error %d)", folder, res);
+		delete[] data;
+		return NULL;
+	}
+	LOG_MESSAGE(2, "Decompressed 7z solid block %d (%s) in %ldms", folder, CHR(Misc::sizeAsString(size)), sw.Time());
+
+	// Add it to the front of the cache
+	block_t block;
+	block.folder = folder;
+	block.data = MemBlock::fromData(data, (uint32_t)size);
+	block_cache.insert(block_cache.begin(), block);
+	cache_size += size;
+
+	// Drop the least recently used blocks if the cache is too big (the newest is
+	// kept until the next block is needed, entries viewing a block keep it too)
+	uint64_t max_size = (uint64_t)MAX(0, (int)archive_7z_block_cache) * 1024 * 1024;
+	while (cache_size > max_size && block_cache.size() > 1)
+	{
+		cache_size -= block_cache.back().data->getSize();
+		block_cache.back().data->release();
+		block_cache.pop_back();
+	}
+
+	return block.data;
+}
+
+/* SevenZipArchive::clearBlockCache
+ * Releases all cached decompressed blocks
+ *******************************************************************/
+void SevenZipArchive::clearBlockCache()
+{
+	for (unsigned a = 0; a < block_cache.size(); a++)
+		block_cache[a].data->release();
+	block_cache.clear();
+	cache_size = 0;
+}
+
+/* SevenZipArchive::open
+ * Reads 7z format data from a MemChunk. Entry data is decompressed
+ * from the archive's source data when needed, so [mc] is kept as the
+ * source data if none is set
+ * Returns true if successful, false otherwise
+ *******************************************************************/
+bool SevenZipArchive::open(MemChunk& mc)
+{
+	// Entry data is read from the source data later
+	if (!data_source)
+		setDataSource(mc);
+	if (!data_source)
+	{
+		Global::error = "Archive is invalid and/or corrupt";
+		return false;
+	}
+
+	// Read the archive headers
+	static bool crc_table = false;
+	if (!crc_table)
+	{
+		CrcGenerateTable();
+		crc_table = true;
+	}
+	theSplashWindow->setProgressMessage("Reading 7z archive data");
+	memstream_t stream;
+	initMemStream(stream, mc);
+	SRes res = SzArEx_Open(&db, &stream.s, &sz_alloc, &sz_alloc);
+	if (res != SZ_OK)
+	{
+		wxLogMessage("SevenZipArchive::open: Opening failed (error %d)", res);
+		Global::error = (res == SZ_ERROR_UNSUPPORTED) ? "Unsupported 7z compression method" : "Archive is invalid and/or corrupt";
+		SzArEx_Free(&db, &sz_alloc);
+		SzArEx_Init(&db);
+		return false;
+	}
+	db_open = true;
+
+	// Stop announcements (don't want to be announcing modification due to entries being added etc)
+	setMuted(true);
+
+	// Go through all files
+	vector<UInt16> name_buf;
+	file_offsets.resize(db.db.NumFiles, 0);
+	uint32_t last_folder = 0xFFFFFFFF;
+	uint64_t offset = 0;
+	for (UInt32 a = 0; a < db.db.NumFiles; a++)
+	{
+		CSzFileItem& file = db.db.Files[a];
+		theSplashWindow->setProgress((float)a / (float)db.db.NumFiles);
+
+		// Get the file's offset within its folder (the files in a folder
+		// are in order, though files without data can be between them)
+		if (file.HasStream)
+		{
+			uint32_t folder = db.FileIndexToFolderIndexMap[a];
+			if (folder != last_folder)
+			{
+				last_folder = folder;
+				offset = 0;
+			}
+			file_offsets[a] = (uint32_t)MIN(offset, (uint64_t)0xFFFFFFFF);
+			offset += file.Size;
+		}
+
+		// Get the name
+		size_t len = SzArEx_GetFileNameUtf16(&db, a, NULL);
+		name_buf.resize(len);
+		SzArEx_GetFileNameUtf16(&db, a, &name_buf[0]);
+		string name((const char*)&name_buf[0], wxMBConvUTF16(), (len - 1) * 2);
+		name.Replace("\\", "/");
+		wxFileName fn(name, wxPATH_UNIX);
+
+		// Directory, add it to the directory tree
+		if (file.IsDir)
+		{
+			createDir(name);
+			continue;
+		}
+
+		// Create entry
+		ArchiveEntry* entry = new ArchiveEntry(fn.GetFullName(), file.Size);
+		entry->setZipIndex(a);
+		entry->setLoaded(file.Size == 0);
+
+		// Add to directory
+		ArchiveTreeNode* dir = createDir(fn.GetPath(true, wxPATH_UNIX));
+		dir->addEntry(entry);
+	}
+
+	// Detect all entry types (this decompresses the solid blocks, the
+	// most recently used are kept in the block cache)
+	theSplashWindow->setProgressMessage("Detecting entry types");
+	vector<ArchiveEntry*> entry_list;
+	getEntryTreeAsList(entry_list);
+	detectEntryTypes(entry_list);
+
+	for (size_t a = 0; a < entry_list.size(); a++)
+	{
+		// Set entry to unchanged
+		entry_list[a]->setState(0);
+
+		// Unload entry data if needed (it can be decompressed again)
+		if (!archive_load_data)
+			entry_list[a]->unloadData();
+	}
+
+	// Setup variables
+	read_only = true;
+	setMuted(false);
+	setModified(false);
+	announce("opened");
+
+	theSplashWindow->setProgressMessage("");
+
+	return true;
+}
+
+/* SevenZipArchive::write
+ * Writing 7z archives isn't supported
+ * Returns false
+ *******************************************************************/
+bool SevenZipArchive::write(MemChunk& mc, bool update)
+{
+	Global::error = "Writing 7z archives is not supported";
+	return false;
+}
+
+/* SevenZipArchive::loadEntryData
+ * Loads an entry's data from its solid block, decompressing the
+ * block if needed. The entry views the block's data
+ * Returns true if successful, false otherwise
+ *******************************************************************/
+bool SevenZipArchive::loadEntryData(ArchiveEntry* entry)
+{
+	// Check entry is ok
+	if (!checkEntry(entry))
+		return false;
+
+	// Do nothing if the entry's size is zero,
+	// or if it has already been loaded
+	if (entry->getSize() == 0 || entry->isLoaded())
+	{
+		entry->setLoaded();
+		return true;
+	}
+
+	// Get the entry's file
+	int index = entry->getZipIndex();
+	if (!db_open || index < 0 || (unsigned)index >= db.db.NumFiles || !db.db.Files[index].HasStream)
+	{
+		wxLogMessage("SevenZipArchive::loadEntryData: Entry %s has no 7z file", CHR(entry->getName()));
+		return false;
+	}
+	CSzFileItem& file = db.db.Files[index];
+
+	// Get its solid block
+	MemBlock* block = getBlock(db.FileIndexToFolderIndexMap[index]);
+	if (!block)
+		return false;
+	if ((uint64_t)file_offsets[index] + entry->getSize() > block->getSize())
+	{
+		wxLogMessage("SevenZipArchive::loadEntryData: Entry %s goes past the end of its solid block", CHR(entry->getName()));
+		return false;
+	}
+
+	// Check the data
+	const uint8_t* data = block->getData() + file_offsets[index];
+	if (file.CrcDefined && CrcCalc(data, entry->getSize()) != file.Crc)
+	{
+		wxLogMessage("SevenZipArchive::loadEntryData: CRC mismatch for entry %s", CHR(entry->getName()));
+		return false;
+	}
+
+	// View the data
+	MemChunk mc;
+	mc.importBlock(block);
+	return readEntryData(entry, mc, file_offsets[index]);
+}
+
+/* SevenZipArchive::close
+ * Closes the archive, releasing the 7z headers and cached blocks
+ *******************************************************************/
+void SevenZipArchive::close()
+{
+	Archive::close();
+
+	clearBlockCache();
+	SzArEx_Free(&db, &sz_alloc);
+	SzArEx_Init(&db);
+	db_open = false;
+	file_offsets.clear();
+}
+
+/* SevenZipArchive::detectNamespace
+ * Returns the namespace that [entry] is within
+ *******************************************************************/
+string SevenZipArchive::detectNamespace(ArchiveEntry* entry)
+{
+	// Check entry
+	if (!checkEntry(entry))
+		return "global";
+
+	// If the entry is in the root dir, it's in the global namespace
+	if (entry->getParentDir() == getRoot())
+		return "global";
+
+	// Get the entry's *first* parent directory after root (ie <root>/namespace/)
+	ArchiveTreeNode* dir = entry->getParentDir();
+	while (dir && dir->getParent() != getRoot())
+		dir = (ArchiveTreeNode*)dir->getParent();
+
+	// Namespace is the directory's name (in lowercase)
+	if (dir)
+		return dir->getName().Lower();
+	else
+		return "global"; // Error, just return global
+}
+
+
+/*******************************************************************
+ * SEVENZIPARCHIVE CLASS STATIC FUNCTIONS
+ *******************************************************************/
+
+/* SevenZipArchive::isSevenZipArchive
+ * Checks if the given data is a valid 7z archive
+ *******************************************************************/
+bool SevenZipArchive::isSevenZipArchive(MemChunk& mc)
+{
+	// Check size (signature header is 32 bytes)
+	if (mc.getSize() < k7zStartHeaderSize)
+		return false;
+
+	// Check signature
+	return memcmp(mc.getData(), k7zSignature, k7zSignatureSize) == 0;
+}
+
+/* SevenZipArchive::isSevenZipArchive
+ * Checks if the file at [filename] is a valid 7z archive
+ *******************************************************************/
+bool SevenZipArchive::isSevenZipArchive(string filename)
+{
+	// Open file for reading
+	wxFile file(filename);
+
+	// Check it opened ok
+	if (!file.IsOpened() || file.Length() < k7zStartHeaderSize)
+		return false;
+
+	// Check signature
+	uint8_t signature[k7zSignatureSize];
+	file.Read(signature, k7zSignatureSize);
+	return memcmp(signature, k7zSignature, k7zSignatureSize) == 0;
+}
@@ -0,0 +1,56 @@
+
+#ifndef __SEVENZIP_ARCHIVE_H__
+#define __SEVENZIP_ARCHIVE_H__
+
+#include "Archive.h"
+#include "lzma/C/7z.h"
+
+// Read-only 7z archive. Entry data is decompressed when first needed,
+// a whole solid block (folder) at a time. The most recently decompressed
+// blocks are kept so that entries in the same block don't decompress it
+// again, and entries view the block's data rather than copying it
+class SevenZipArchive : public Archive
+{
+private:
+	struct block_t
+	{
+		uint32_t	folder;
+		MemBlock*	data;
+	};
+
+	CSzArEx				db;
+	bool				db_open;
+	vector<uint32_t>	file_offsets;	// Offset of each file's data within its folder
+	vector<block_t>		block_cache;	// Most recently used first
+	uint64_t			cache_size;
+
+	MemBlock*	getBlock(uint32_t folder);
+	void		clearBlockCache();
+
+public:
+	SevenZipArchive();
+	~SevenZipArchive();
+
+	// Archive type info
+	string	getFileExtensionString();
+	string	getFormat();
+	bool	isWritable() { return false; }
+
+	// Opening/writing
+	bool	open(MemChunk& mc);							// Open from MemChunk
+	bool	write(MemChunk& mc, bool update = true);	// Write to MemChunk (not supported)
+
+	// Misc
+	bool	loadEntryData(ArchiveEntry* entry);
+	void	close();
+
+	// Detection
+	virtual vector<mapdesc_t>	detectMaps() { return vector<mapdesc_t>(); }
+	string						detectNamespace(ArchiveEntry* entry);
+
+	// Static functions
+	static bool isSevenZipArchive(MemChunk& mc);
+	static bool isSevenZipArchive(string filename);
+};
+
+#endif//__SEVENZIP_ARCHIVE_H__
@@ -190,6 +190,21 @@ static size_t TarMakeChecksum(tar_header* header)
 	return checksum;
 }
 
+/* TarHeaderName
+ * Returns the full path from a tar header, including the prefix if
+ * it is a POSIX ustar header ("ustar\0" magic, "00" version). Old
+ * GNU headers ("ustar  " magic) store other data in that field
+ *******************************************************************/
+static string TarHeaderName(tar_header* header)
+{
+	string name = wxString::FromAscii(header->name, strnlen(header->name, 100));
+	bool posix = (memcmp(header->magic, TMAGIC, 5) == 0 && header->version[0] == 0 &&
+	              header->version[1] == '0' && header->version[2] == '0');
+	if (posix && header->prefix[0])
+		name = wxString::FromAscii(header->prefix, strnlen(header->prefix, 155)) + "/" + name;
+	return name;
+}
+
 /* TarDefaultHeader
  * Fill a tar_header with default preset values
  *******************************************************************/
@@ -312,13 +327,7 @@ bool TarArchive::open(MemChunk& mc)
 		}
 
 		// Find name
-		string name;
-		for (int a = 0; a < 100; ++a)
-		{
-			if (header.name[a] == 0)
-				break;
-			name += header.name[a];
-		}
+		string name = TarHeaderName(&header);
 
 		// Find size
 		size_t size = TarSum(header.size, 12);
@@ -333,7 +342,7 @@ bool TarArchive::open(MemChunk& mc)
 
 			// Create entry
 			ArchiveEntry* entry = new ArchiveEntry(fn.GetFullName(), size);
-			entry->exProp("Offset") = (int)mc.currentPos();
+			entry->setOffset(mc.currentPos());
 			entry->setLoaded(false);
 			entry->setState(0);
 
@@ -358,32 +367,29 @@ bool TarArchive::open(MemChunk& mc)
 
 	}
 
-	// Detect all entry types
-	MemChunk edata;
+	// Entry data is loaded from the source data when needed, if there is
+	// no source data it has to be read now
 	vector<ArchiveEntry*> all_entries;
 	getEntryTreeAsList(all_entries);
-	theSplashWindow->setProgressMessage("Detecting entry types");
-	for (size_t a = 0; a < all_entries.size(); a++)
+	if (!data_source)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)all_entries.size())));
-
-		// Get entry
-		ArchiveEntry* entry = all_entries[a];
-
-		// Read entry data if it isn't zero-sized
-		if (entry->getSize() > 0)
+		for (size_t a = 0; a < all_entries.size(); a++)
 		{
-			// Read the entry data
-			mc.exportMemChunk(edata, (int)entry->exProp("Offset"), entry->getSize());
-			entry->importMemChunk(edata);
+			if (all_entries[a]->getSize() > 0)
+				readEntryData(all_entries[a], mc, all_entries[a]->getOffset());
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	theSplashWindow->setProgressMessage("Detecting entry types");
+	detectEntryTypes(all_entries);
 
-		// Unload entry data if needed
-		if (!archive_load_data)
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
+
+		// Unload entry data if needed (can only be reloaded from the source data)
+		if (!archive_load_data && data_source)
 			entry->unloadData();
 
 		// Set entry to unchanged
@@ -406,9 +412,16 @@ bool TarArchive::open(MemChunk& mc)
  *******************************************************************/
 bool TarArchive::write(MemChunk& mc, bool update)
 {
-	// Clear current data
-	mc.clear();
+	MemChunkOutputStream out(mc);
+	return write(out, update);
+}
 
+/* TarArchive::write
+ * Writes the tar archive to [out]
+ * Returns true if successful, false otherwise
+ *******************************************************************/
+bool TarArchive::write(wxOutputStream& out, bool update)
+{
 	// We'll use that
 	uint8_t padding[512];
 	memset(padding, 0, 512);
@@ -417,15 +430,15 @@ bool TarArchive::write(MemChunk& mc, bool update)
 	vector<ArchiveEntry*> entries;
 	getEntryTreeAsList(entries);
 	size_t listsize = entries.size();
+	vector<uint32_t> offsets(listsize);
 
+	uint32_t offset = 0;
 	for (size_t a = 0; a < listsize; ++a)
 	{
-		// MAYBE TODO: store the header variables as ExProps for the entries, then only change
-		// header.mtime for modified entries, and only use the default values for new entries.
 		tar_header header;
 		TarDefaultHeader(&header);
 
-		// Write entry name
+		// Get entry name
 		string name = entries[a]->getPath(true);
 		name.Remove(0, 1);	// Remove leading /
 		if (name.Len() > 99)
@@ -438,32 +451,73 @@ bool TarArchive::write(MemChunk& mc, bool update)
 		}
 		memcpy(header.name, CHR(name), name.Length());
 
+		// Unchanged members are copied from the source data with their
+		// original header, keeping its metadata (mtime, mode, owner etc.)
+		bool copy_header = false;
+		tar_header source_header;
+		MemChunk source;
+		if (entries[a]->getState() == 0 && entries[a]->hasOffset() && entries[a]->getOffset() >= 512 &&
+		        getSourceData(source, entries[a]->getOffset() - 512, 512))
+		{
+			memcpy(&source_header, source.getData(), 512);
+			copy_header = TarChecksum(&source_header) && TarHeaderName(&source_header) == name &&
+			              TarSum(source_header.size, 12) == (int)entries[a]->getSize();
+		}
+
 		// Address folders
 		if (entries[a]->getType() == EntryType::folderType())
 		{
 			header.typeflag = DIRTYPE;
 			TarWriteOctal(TarMakeChecksum(&header), header.chksum, 7);
-			mc.write(&header, 512);
+			out.Write(&header, 512);
+			offset += 512;
 
 			// Else we've got a file
 		}
 		else
 		{
-			header.typeflag = REGTYPE;
-			TarWriteOctal(entries[a]->getSize(), header.size, 12);
-			TarWriteOctal(TarMakeChecksum(&header), header.chksum, 7);
+			if (copy_header)
+				memcpy(&header, &source_header, 512);
+			else
+			{
+				header.typeflag = REGTYPE;
+				TarWriteOctal(entries[a]->getSize(), header.size, 12);
+				TarWriteOctal(TarMakeChecksum(&header), header.chksum, 7);
+			}
 			size_t padsize = entries[a]->getSize() % 512;
 			if (padsize) padsize = 512 - padsize;
-			mc.write(&header, 512);
-			mc.write(entries[a]->getData(), entries[a]->getSize());
+			out.Write(&header, 512);
+			offsets[a] = offset + 512;
+			if (!writeEntryData(out, entries[a], entries[a]->getOffset()))
+			{
+				Global::error = "Unable to write entry data";
+				return false;
+			}
 			if (padsize)
-				mc.write(padding, padsize);
+				out.Write(padding, padsize);
+			offset += 512 + entries[a]->getSize() + padsize;
+		}
+	}
+
+	// Finished, so write two pages of zeroes
+	out.Write(padding, 512);
+	out.Write(padding, 512);
+	if (!out.IsOk())
+		return false;
+
+	// Update entries (after writing, as unloaded entries are read from their current offset)
+	if (update)
+	{
+		for (size_t a = 0; a < listsize; ++a)
+		{
+			if (entries[a]->getType() == EntryType::folderType())
+				continue;
+
+			entries[a]->setState(0);
+			entries[a]->setOffset(offsets[a]);
 		}
 	}
 
-	// Finished, so write two pages of zeroes and return a success
-	mc.write(padding, 512);
-	mc.write(padding, 512);
 	return true;
 }
 
@@ -485,6 +539,10 @@ bool TarArchive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
+	// Read from the source data if possible
+	if (loadEntrySourceData(entry, entry->getOffset()))
+		return true;
+
 	// Open archive file
 	wxFile file(filename);
 
@@ -496,7 +554,7 @@ bool TarArchive::loadEntryData(ArchiveEntry* entry)
 	}
 
 	// Seek to entry offset in file and read it in
-	file.Seek((int)entry->exProp("Offset"), wxFromStart);
+	file.Seek(entry->getOffset(), wxFromStart);
 	entry->importFileStream(file, entry->getSize());
 
 	// Set the lump to loaded
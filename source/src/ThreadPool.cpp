@@ -0,0 +1,159 @@
+
+/*******************************************************************
+ * SLADE - It's a Doom Editor
+ * Copyright (C) 2008-2012 Simon Judd
+ *
+ * Email:       sirjuddington@gmail.com
+ * Web:         http://slade.mancubus.net
+ * Filename:    ThreadPool.cpp
+ * Description: Functions for running a job over a number of items
+ *              on multiple worker threads
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *******************************************************************/
+
+
+/*******************************************************************
+ * INCLUDES
+ *******************************************************************/
+#include "Main.h"
+#include "ThreadPool.h"
+#include <wx/thread.h>
+
+
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+CVAR(Int, max_worker_threads, 0, CVAR_SAVE)	// 0 = one per cpu core
+
+
+/*******************************************************************
+ * WORKER CLASS
+ *******************************************************************
+ * A thread that processes items of a job until there are none left
+ */
+class Worker : public wxThread
+{
+public:
+	// Job progress, shared between all threads running a job
+	struct jobstate_t
+	{
+		ThreadPool::Job*	job;
+		unsigned			next;
+		unsigned			count;
+		wxCriticalSection	lock;
+	};
+
+private:
+	jobstate_t*	state;
+
+public:
+	Worker(jobstate_t* state) : wxThread(wxTHREAD_JOINABLE)
+	{
+		this->state = state;
+	}
+
+	~Worker() {}
+
+	static void processItems(jobstate_t* state)
+	{
+		// Keep taking the next unprocessed item
+		while (true)
+		{
+			unsigned index;
+			{
+				wxCriticalSectionLocker locker(state->lock);
+				index = state->next++;
+			}
+			if (index >= state->count)
+				break;
+
+			state->job->process(index);
+		}
+	}
+
+	ExitCode Entry()
+	{
+		processItems(state);
+		return 0;
+	}
+};
+
+
+/*******************************************************************
+ * THREADPOOL NAMESPACE FUNCTIONS
+ *******************************************************************/
+
+/* ThreadPool::numThreads
+ * Returns the number of threads jobs will be run on
+ *******************************************************************/
+unsigned ThreadPool::numThreads()
+{
+	if (max_worker_threads > 0)
+		return max_worker_threads;
+
+	int cpus = wxThread::GetCPUCount();
+	return cpus > 0 ? cpus : 1;
+}
+
+/* ThreadPool::run
+ * Runs [job] for every index from 0 to [count]-1, split over as many
+ * threads as possible. The calling thread also processes items, and
+ * this doesn't return until all items have been processed. If there
+ * are less than [min_count] items, the job is just run on the
+ * calling thread. If [max_threads] is given, no more than that many
+ * threads (including the calling thread) are used
+ *******************************************************************/
+void ThreadPool::run(Job& job, unsigned count, unsigned min_count, unsigned max_threads)
+{
+	Worker::jobstate_t state;
+	state.job = &job;
+	state.next = 0;
+	state.count = count;
+
+	// Start worker threads (no more than there are items)
+	vector<Worker*> workers;
+	if (count >= min_count)
+	{
+		unsigned n_threads = numThreads();
+		if (max_threads > 0 && n_threads > max_threads)
+			n_threads = max_threads;
+		if (n_threads > count)
+			n_threads = count;
+
+		for (unsigned a = 1; a < n_threads; a++)
+		{
+			Worker* worker = new Worker(&state);
+			if (worker->Create() != wxTHREAD_NO_ERROR || worker->Run() != wxTHREAD_NO_ERROR)
+			{
+				// Couldn't start the thread, just use what we have
+				delete worker;
+				break;
+			}
+
+			workers.push_back(worker);
+		}
+	}
+
+	// Process items on this thread too
+	Worker::processItems(&state);
+
+	// Wait for the workers to finish
+	for (unsigned a = 0; a < workers.size(); a++)
+	{
+		workers[a]->Wait();
+		delete workers[a];
+	}
+}
@@ -0,0 +1,22 @@
+
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+namespace ThreadPool
+{
+	// A job that can be run for a range of item indices on multiple threads.
+	// process() may be called from any thread, for each index exactly once
+	class Job
+	{
+	public:
+		Job() {}
+		virtual ~Job() {}
+
+		virtual void	process(unsigned index) = 0;
+	};
+
+	unsigned	numThreads();
+	void		run(Job& job, unsigned count, unsigned min_count = 2, unsigned max_threads = 0);
+}
+
+#endif//__THREADPOOL_H__
@@ -98,42 +98,42 @@ STreeNode* STreeNode::getChild(string name)
 	if (name.IsEmpty())
 		return NULL;
 
-	// If name ends with /, remove it
-	if (name.EndsWith("/"))
-		name.RemoveLast(1);
-
-	// Convert name to path for processing
-	wxFileName fn(name);
-
-	// If no directories were given
-	if (fn.GetDirCount() == 0)
+	// Go down the tree through each directory in the path
+	STreeNode* node = this;
+	size_t start = 0;
+	while (start < name.length())
 	{
-		// Find child of this node
-		for (unsigned a = 0; a < children.size(); a++)
+		// Get the next directory name
+		size_t end = name.find('/', start);
+		if (end == string::npos)
+			end = name.length();
+		if (end == start)
 		{
-			if (S_CMPNOCASE(name, children[a]->getName()))
-				return children[a];
+			start++;
+			continue;
 		}
+		string dir = name.Mid(start, end - start);
+		start = end + 1;
 
-		// Child not found
-		return NULL;
-	}
-	else
-	{
-		// Directories were given, get the first directory
-		string dir = fn.GetDirs()[0];
-
-		// See if it is a child of this node
-		STreeNode* child = getChild(dir);
-		if (child)
+		// Find it in the current node's children
+		STreeNode* child = NULL;
+		for (unsigned a = 0; a < node->children.size(); a++)
 		{
-			// It is, remove the first directory and continue searching that child
-			fn.RemoveDir(0);
-			return child->getChild(fn.GetFullPath(wxPATH_UNIX));
+			if (S_CMPNOCASE(dir, node->children[a]->getName()))
+			{
+				child = node->children[a];
+				break;
+			}
 		}
-		else
-			return NULL;	// Child doesn't exist
+
+		// Child doesn't exist
+		if (!child)
+			return NULL;
+
+		node = child;
 	}
+
+	return (node == this) ? NULL : node;
 }
 
 /* STreeNode::getChildren
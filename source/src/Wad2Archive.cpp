@@ -145,7 +145,7 @@ bool Wad2Archive::open(MemChunk& mc)
 		// Create & setup lump
 		ArchiveEntry* nlump = new ArchiveEntry(wxString::FromAscii(info.name, 16), info.dsize);
 		nlump->setLoaded(false);
-		nlump->exProp("Offset") = (int)info.offset;
+		nlump->setOffset(info.offset);
 		nlump->exProp("W2Type") = info.type;
 		nlump->exProp("W2Size") = (int)info.size;
 		nlump->exProp("W2Comp") = !!(info.cmprs);
@@ -155,27 +155,29 @@ bool Wad2Archive::open(MemChunk& mc)
 		getRoot()->addEntry(nlump);
 	}
 
-	// Detect all entry types
-	MemChunk edata;
+	// Read all entry data
+	vector<ArchiveEntry*> all_entries;
 	theSplashWindow->setProgressMessage("Detecting entry types");
 	for (size_t a = 0; a < numEntries(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_lumps)));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
+		all_entries.push_back(entry);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
 		{
 			// Read the entry data
-			mc.exportMemChunk(edata, (int)entry->exProp("Offset"), entry->getSize());
-			entry->importMemChunk(edata);
+			readEntryData(entry, mc, entry->getOffset());
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	EntryType::detectEntryTypes(all_entries);
+
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
 
 		// Unload entry data if needed
 		if (!archive_load_data)
@@ -211,7 +213,7 @@ bool Wad2Archive::write(MemChunk& mc, bool update)
 	for (uint32_t l = 0; l < numEntries(); l++)
 	{
 		entry = getEntry(l);
-		entry->exProp("Offset") = (int)dir_offset;
+		entry->setOffset(dir_offset);
 		dir_offset += entry->getSize();
 	}
 
@@ -249,7 +251,7 @@ bool Wad2Archive::write(MemChunk& mc, bool update)
 		info.cmprs = (bool)entry->exProp("W2Comp");
 		info.dsize = entry->getSize();
 		info.size = entry->getSize();
-		info.offset = (int)entry->exProp("Offset");
+		info.offset = entry->getOffset();
 		info.type = (int)entry->exProp("W2Type");
 
 		// Write it
@@ -280,6 +282,10 @@ bool Wad2Archive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
+	// Read from the source data if possible
+	if (loadEntrySourceData(entry, entry->getOffset()))
+		return true;
+
 	// Open wadfile
 	wxFile file(filename);
 
@@ -291,7 +297,7 @@ bool Wad2Archive::loadEntryData(ArchiveEntry* entry)
 	}
 
 	// Seek to lump offset in file and read it in
-	file.Seek((int)entry->exProp("Offset"), wxFromStart);
+	file.Seek(entry->getOffset(), wxFromStart);
 	entry->importFileStream(file, entry->getSize());
 
 	// Set the lump to loaded
@@ -32,7 +32,15 @@
 #include "WadArchive.h"
 #include "SplashWindow.h"
 #include "Misc.h"
+#include "ThreadPool.h"
+#include "ArchiveSearchIndex.h"
+#include "Console.h"
 #include <wx/filename.h>
+#include <wx/file.h>
+#include <wx/stopwatch.h>
+#include <algorithm>
+#include <map>
+#include <set>
 
 bool JaguarDecode(MemChunk& mc);
 
@@ -41,6 +49,8 @@ bool JaguarDecode(MemChunk& mc);
  *******************************************************************/
 CVAR(Bool, wad_force_uppercase, true, CVAR_SAVE)
 CVAR(Bool, iwad_lock, true, CVAR_SAVE)
+CVAR(Bool, wad_save_incremental, true, CVAR_SAVE)
+CVAR(Bool, wad_save_dedup, false, CVAR_SAVE)
 
 // Used for map detection
 string map_lumps[NUMMAPLUMPS] =
@@ -86,6 +96,120 @@ const int n_special_namespaces = 11;
  *******************************************************************/
 EXTERN_CVAR(Bool, archive_load_data)
 
+
+/*******************************************************************
+ * LUMPSHARER CLASS
+ *******************************************************************/
+
+/* LumpSharer class
+ * Keeps track of the lump data written to a wad file, so that lumps
+ * with data that has already been written can point to it instead.
+ * Unmodified lumps that shared their data in the file they were read
+ * from keep sharing it, and if [dedup] is true any lumps with
+ * identical data share it
+ *******************************************************************/
+class LumpSharer
+{
+private:
+	typedef std::pair<ArchiveEntry*, uint32_t> written_t;
+	typedef std::map<std::pair<uint32_t, uint64_t>, vector<written_t> > HashMap;
+	typedef std::map<std::pair<uint32_t, uint32_t>, uint32_t> SourceMap;
+
+	bool			dedup;
+	HashMap			by_hash;	// Written lumps by (size, data hash)
+	SourceMap		by_source;	// Written offsets by (source offset, size)
+	ArchiveEntry*	last_entry;
+	uint64_t		last_hash;
+
+	bool hasSource(ArchiveEntry* entry)
+	{
+		return entry->getState() == 0 && entry->hasOffset() && !entry->isEncrypted();
+	}
+
+	uint64_t hash(ArchiveEntry* entry)
+	{
+		if (entry != last_entry)
+		{
+			bool loaded = entry->isLoaded();
+			MemChunk& data = entry->getMCData();
+			last_hash = Misc::hash64(data.getData(), data.getSize());
+			last_entry = entry;
+			if (!loaded)
+				entry->unloadData();
+		}
+
+		return last_hash;
+	}
+
+	bool sameData(ArchiveEntry* entry1, ArchiveEntry* entry2)
+	{
+		bool loaded1 = entry1->isLoaded();
+		bool loaded2 = entry2->isLoaded();
+		MemChunk& data1 = entry1->getMCData();
+		MemChunk& data2 = entry2->getMCData();
+		bool same = data1.getSize() == data2.getSize() && memcmp(data1.getData(), data2.getData(), data1.getSize()) == 0;
+		if (!loaded1)
+			entry1->unloadData();
+		if (!loaded2)
+			entry2->unloadData();
+
+		return same;
+	}
+
+public:
+	LumpSharer(bool dedup) : dedup(dedup), last_entry(NULL), last_hash(0) {}
+
+	// Returns true if [entry]'s data has already been written, and
+	// sets [offset] to where
+	bool find(ArchiveEntry* entry, uint32_t& offset)
+	{
+		uint32_t size = entry->getSize();
+		if (size == 0)
+			return false;
+
+		if (hasSource(entry))
+		{
+			SourceMap::iterator i = by_source.find(std::make_pair(entry->getOffset(), size));
+			if (i != by_source.end())
+			{
+				offset = i->second;
+				return true;
+			}
+		}
+
+		if (dedup)
+		{
+			HashMap::iterator i = by_hash.find(std::make_pair(size, hash(entry)));
+			if (i != by_hash.end())
+			{
+				for (unsigned a = 0; a < i->second.size(); a++)
+				{
+					if (sameData(entry, i->second[a].first))
+					{
+						offset = i->second[a].second;
+						return true;
+					}
+				}
+			}
+		}
+
+		return false;
+	}
+
+	// Records that [entry]'s data is written at [offset]
+	void add(ArchiveEntry* entry, uint32_t offset)
+	{
+		uint32_t size = entry->getSize();
+		if (size == 0)
+			return;
+
+		if (hasSource(entry))
+			by_source[std::make_pair(entry->getOffset(), size)] = offset;
+		if (dedup)
+			by_hash[std::make_pair(size, hash(entry))].push_back(written_t(entry, offset));
+	}
+};
+
 /*******************************************************************
  * WADARCHIVE CLASS FUNCTIONS
  *******************************************************************/
@@ -97,6 +221,8 @@ WadArchive::WadArchive() : TreelessArchive(ARCHIVE_WAD)
 {
 	// Init variables
 	iwad = false;
+	file_size = 0;
+	force_full_save = false;
 }
 
 /* WadArchive::~WadArchive
@@ -120,7 +246,7 @@ uint32_t WadArchive::getEntryOffset(ArchiveEntry* entry)
 	if (!checkEntry(entry))
 		return 0;
 
-	return (uint32_t)(int)entry->exProp("Offset");
+	return entry->getOffset();
 }
 
 /* WadArchive::setEntryOffset
@@ -132,7 +258,78 @@ void WadArchive::setEntryOffset(ArchiveEntry* entry, uint32_t offset)
 	if (!checkEntry(entry))
 		return;
 
-	entry->exProp("Offset") = (int)offset;
+	entry->setOffset(offset);
+}
+
+/* WadArchive::resetUsedSpace
+ * Sets the used file space to the regions referenced by the current
+ * entries, the header and the directory at [dir_offset], for a file
+ * of [file_size] bytes
+ *******************************************************************/
+void WadArchive::resetUsedSpace(uint32_t dir_offset, uint32_t file_size)
+{
+	dir_space = wadspan_t(dir_offset, numEntries() * 16);
+	used_space.clear();
+	used_space.push_back(wadspan_t(0, 12));
+	used_space.push_back(dir_space);
+	for (unsigned a = 0; a < numEntries(); a++)
+	{
+		ArchiveEntry* entry = getEntry(a);
+		if (entry->getSize() > 0 && entry->hasOffset())
+			used_space.push_back(wadspan_t(getEntryOffset(entry), entry->getSize()));
+	}
+
+	this->file_size = file_size;
+}
+
+/* WadArchive::getUnusedSpace
+ * Returns the number of bytes in the wad file that aren't used by
+ * the header, directory or any unmodified entry (ie. space that
+ * would be reclaimed by compacting the file)
+ *******************************************************************/
+uint32_t WadArchive::getUnusedSpace()
+{
+	if (file_size == 0)
+		return 0;
+
+	// Get the regions used by the current directory and unmodified entries
+	vector<wadspan_t> spans;
+	spans.push_back(wadspan_t(0, 12));
+	spans.push_back(dir_space);
+	for (unsigned a = 0; a < numEntries(); a++)
+	{
+		ArchiveEntry* entry = getEntry(a);
+		if (entry->getSize() > 0 && entry->getState() == 0 && entry->hasOffset())
+			spans.push_back(wadspan_t(getEntryOffset(entry), entry->getSize()));
+	}
+	std::sort(spans.begin(), spans.end());
+
+	// Add up the space not covered by any of them
+	uint64_t used = 0;
+	uint64_t pos = 0;
+	for (unsigned a = 0; a < spans.size(); a++)
+	{
+		uint64_t end = (uint64_t)spans[a].offset + spans[a].size;
+		if (end <= pos)
+			continue;
+		used += end - MAX(pos, spans[a].offset);
+		pos = end;
+	}
+
+	return used < file_size ? file_size - used : 0;
+}
+
+/* WadArchive::compact
+ * Saves the wad, rewriting the whole file so that any unused space
+ * left by incremental saves is reclaimed
+ *******************************************************************/
+bool WadArchive::compact()
+{
+	force_full_save = true;
+	bool ok = save();
+	force_full_save = false;
+
+	return ok;
 }
 
 /* WadArchive::updateNamespaces
@@ -319,6 +516,9 @@ bool WadArchive::open(MemChunk& mc)
 	setMuted(true);
 
 	// Read the directory
+	wxStopWatch sw;
+	std::set<std::pair<uint32_t, uint32_t> > lump_spans;
+	unsigned n_shared = 0;
 	mc.seek(dir_offset, SEEK_SET);
 	theSplashWindow->setProgressMessage("Reading wad archive data");
 	for (uint32_t d = 0; d < num_lumps; d++)
@@ -390,16 +590,21 @@ bool WadArchive::open(MemChunk& mc)
 			return false;
 		}
 
+		// Count lumps sharing data with an earlier lump (their data views
+		// share it in memory, and WadArchive::write keeps it shared)
+		if (size > 0 && !lump_spans.insert(std::make_pair(offset, size)).second)
+			n_shared++;
+
 		// Create & setup lump
 		ArchiveEntry* nlump = new ArchiveEntry(wxString::FromAscii(name), size);
 		nlump->setLoaded(false);
-		nlump->exProp("Offset") = (int)offset;
+		nlump->setOffset(offset);
 		nlump->setState(0);
 
 		if (jaguarencrypt)
 		{
 			nlump->setEncryption(ENC_JAGUAR);
-			nlump->exProp("FullSize") = (int)size;
+			nlump->setFullSize(size);
 		}
 
 		// Add to entry list
@@ -409,48 +614,62 @@ bool WadArchive::open(MemChunk& mc)
 	// Detect namespaces (needs to be done before type detection as some types
 	// rely on being within certain namespaces)
 	updateNamespaces();
+	resetUsedSpace(dir_offset, mc.getSize());
 
-	// Detect all entry types
+	long time_dir = sw.Time();
+
+	// Read all entry data
 	MemChunk edata;
 	theSplashWindow->setProgressMessage("Detecting entry types");
 	for (size_t a = 0; a < numEntries(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_lumps)));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
 		{
-			// Read the entry data
-			mc.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
 			if (entry->isEncrypted())
 			{
-				if (entry->exProps().propertyExists("FullSize")
-				        && (unsigned)(int)(entry->exProp("FullSize")) >  entry->getSize())
-					edata.reSize((int)(entry->exProp("FullSize")), true);
+				// Read and decode the entry data
+				mc.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
+				if (entry->getFullSize() > entry->getSize())
+					edata.reSize(entry->getFullSize(), true);
 				if (!JaguarDecode(edata))
 					wxLogMessage("%i: %s (following %s), did not decode properly", a, CHR(entry->getName()), a>0?CHR(getEntry(a-1)->getName()):"nothing");
+				entry->importMemChunk(edata);
 			}
-			entry->importMemChunk(edata);
+			else
+				readEntryData(entry, mc, getEntryOffset(entry));
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	vector<ArchiveEntry*> all_entries;
+	getEntryTreeAsList(all_entries);
+	detectEntryTypes(all_entries);
+	long time_detect = sw.Time() - time_dir;
 
-		// Unload entry data if needed
-		if (!archive_load_data)
-			entry->unloadData();
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
 
 		// Set entry to unchanged
 		entry->setState(0);
+
+		// Unload entry data if needed (can only be reloaded from the mapped file)
+		if (!archive_load_data && data_source && !entry->isEncrypted())
+			entry->unloadData();
 	}
 
 	// Detect maps (will detect map entry types)
 	theSplashWindow->setProgressMessage("Detecting maps");
+	long time_maps = sw.Time();
 	detectMaps();
+	time_maps = sw.Time() - time_maps;
+
+	LOG_MESSAGE(1, "WadArchive::open: %d lumps (%d shared), directory %ldms, type detection %ldms (%d threads), maps %ldms",
+	            num_lumps, n_shared, time_dir, time_detect, ThreadPool::numThreads(), time_maps);
 
 	// Setup variables
 	setMuted(false);
@@ -468,6 +687,16 @@ bool WadArchive::open(MemChunk& mc)
  * Returns true if successful, false otherwise
  *******************************************************************/
 bool WadArchive::write(MemChunk& mc, bool update)
+{
+	MemChunkOutputStream out(mc);
+	return write(out, update);
+}
+
+/* WadArchive::write
+ * Writes the wad archive to [out]
+ * Returns true if successful, false otherwise
+ *******************************************************************/
+bool WadArchive::write(wxOutputStream& out, bool update)
 {
 	// Don't write if iwad
 	if (iwad && iwad_lock)
@@ -477,19 +706,31 @@ bool WadArchive::write(MemChunk& mc, bool update)
 	}
 
 	// Determine directory offset & individual lump offsets
+	// (entry offsets aren't updated until the lumps have been written,
+	// as unloaded lumps are read from their current offset). Lumps
+	// sharing data with an earlier lump aren't written themselves
 	uint32_t dir_offset = 12;
 	ArchiveEntry* entry = NULL;
+	vector<uint32_t> offsets(numEntries());
+	vector<bool> shared(numEntries(), false);
+	LumpSharer sharer(wad_save_dedup);
+	unsigned n_shared = 0;
 	for (uint32_t l = 0; l < numEntries(); l++)
 	{
 		entry = getEntry(l);
-		setEntryOffset(entry, dir_offset);
+		if (sharer.find(entry, offsets[l]))
+		{
+			shared[l] = true;
+			n_shared++;
+			continue;
+		}
+
+		offsets[l] = dir_offset;
+		sharer.add(entry, dir_offset);
 		dir_offset += entry->getSize();
 	}
-
-	// Clear/init MemChunk
-	mc.clear();
-	mc.seek(0, SEEK_SET);
-	mc.reSize(dir_offset + numEntries() * 16);
+	if (n_shared > 0)
+		LOG_MESSAGE(2, "WadArchive::write: %d lumps share data with other lumps", n_shared);
 
 	// Setup wad type
 	char wad_type[4] = { 'P', 'W', 'A', 'D' };
@@ -497,15 +738,23 @@ bool WadArchive::write(MemChunk& mc, bool update)
 
 	// Write the header
 	uint32_t num_lumps = numEntries();
-	mc.write(wad_type, 4);
-	mc.write(&num_lumps, 4);
-	mc.write(&dir_offset, 4);
+	uint32_t header_lumps = wxINT32_SWAP_ON_BE(num_lumps);
+	uint32_t header_dir = wxINT32_SWAP_ON_BE(dir_offset);
+	out.Write(wad_type, 4);
+	out.Write(&header_lumps, 4);
+	out.Write(&header_dir, 4);
 
 	// Write the lumps
 	for (uint32_t l = 0; l < num_lumps; l++)
 	{
 		entry = getEntry(l);
-		mc.write(entry->getData(), entry->getSize());
+		if (shared[l])
+			continue;
+		if (!writeEntryData(out, entry, getEntryOffset(entry)))
+		{
+			Global::error = "Unable to write lump data";
+			return false;
+		}
 	}
 
 	// Write the directory
@@ -513,23 +762,269 @@ bool WadArchive::write(MemChunk& mc, bool update)
 	{
 		entry = getEntry(l);
 		char name[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
-		long offset = getEntryOffset(entry);
-		long size = entry->getSize();
+		uint32_t offset = wxINT32_SWAP_ON_BE(offsets[l]);
+		uint32_t size = wxINT32_SWAP_ON_BE(entry->getSize());
 
 		for (size_t c = 0; c < entry->getName().length() && c < 8; c++)
 			name[c] = entry->getName()[c];
 
-		mc.write(&offset, 4);
-		mc.write(&size, 4);
-		mc.write(name, 8);
+		out.Write(&offset, 4);
+		out.Write(&size, 4);
+		out.Write(name, 8);
+	}
+	if (!out.IsOk())
+	{
+		Global::error = "Unable to write wad directory";
+		return false;
+	}
 
-		if (update)
+	// Update entries (after writing, as unloaded lumps are read from their current offset)
+	if (update)
+	{
+		for (uint32_t l = 0; l < num_lumps; l++)
 		{
+			entry = getEntry(l);
 			entry->setState(0);
-			entry->exProp("Offset") = (int)offset;
+			entry->setOffset(offsets[l]);
+		}
+
+		resetUsedSpace(dir_offset, dir_offset + num_lumps * 16);
+	}
+
+	return true;
+}
+
+/* WadArchive::write
+ * Writes the wad archive to a file. If the file is the one the wad
+ * was opened from, only new and modified lumps are written (see
+ * WadArchive::writeIncremental), otherwise the whole file is written
+ * Returns true if successful, false otherwise
+ *******************************************************************/
+bool WadArchive::write(string filename, bool update)
+{
+	if (update && writesInPlace(filename))
+		return writeIncremental(filename);
+
+	return Archive::write(filename, update);
+}
+
+/* WadArchive::writesInPlace
+ * Returns true if the wad can be saved to [filename] incrementally,
+ * ie. [filename] is the wad's own file and it hasn't been changed
+ * by anything else since it was opened or last saved
+ *******************************************************************/
+bool WadArchive::writesInPlace(string filename)
+{
+	if (!wad_save_incremental || force_full_save || parent || !on_disk || file_size == 0)
+		return false;
+
+	// Check it's the same file, with the expected size
+	wxFileName fn(filename);
+	if (!fn.FileExists() || !fn.SameAs(wxFileName(this->filename)) || fn.GetSize().GetValue() != file_size)
+		return false;
+
+	// Jaguar encrypted lumps are stored at a different size to their data,
+	// so can't be kept in place
+	for (unsigned a = 0; a < numEntries(); a++)
+	{
+		if (getEntry(a)->isEncrypted())
+			return false;
+	}
+
+	return !(iwad && iwad_lock);
+}
+
+/* WadArchive::writeIncremental
+ * Saves the wad to [filename] (its current file) in place. New and
+ * modified lumps are written to unused space in the file (or added
+ * to the end of it), followed by a new directory. The header is only
+ * updated to point to the new directory once everything else has
+ * been written, so the file stays valid if saving fails part way.
+ * Space freed by the save is left unused until the next time the wad
+ * is opened, as unloaded entries may still be reading from it (use
+ * WadArchive::compact to reclaim it)
+ * Returns true if successful, false otherwise
+ *******************************************************************/
+bool WadArchive::writeIncremental(string filename)
+{
+	wxStopWatch sw;
+
+	// Open the file
+	wxFile file(filename, wxFile::read_write);
+	if (!file.IsOpened())
+	{
+		Global::error = "Unable to open file for saving. Make sure it isn't in use by another program.";
+		return false;
+	}
+
+	// Find unused regions of the file
+	vector<wadspan_t> spans = used_space;
+	vector<wadspan_t> holes;
+	std::sort(spans.begin(), spans.end());
+	uint64_t pos = 0;
+	for (unsigned a = 0; a < spans.size(); a++)
+	{
+		if (spans[a].offset > pos)
+			holes.push_back(wadspan_t(pos, spans[a].offset - pos));
+		pos = MAX(pos, (uint64_t)spans[a].offset + spans[a].size);
+	}
+	if (pos < file_size)
+		holes.push_back(wadspan_t(pos, file_size - pos));
+	uint64_t file_end = MAX(pos, (uint64_t)file_size);
+
+	// Write new and modified lumps, each to the smallest unused region it fits in
+	// (or the end of the file if there aren't any). Lumps that have only been
+	// renamed or moved (and never loaded) can be kept where they are
+	uint32_t num_lumps = numEntries();
+	vector<uint32_t> offsets(num_lumps);
+	vector<wadspan_t> written;
+	unsigned n_written = 0;
+	uint64_t bytes_written = 0;
+	LumpSharer sharer(wad_save_dedup);
+	for (unsigned a = 0; a <= num_lumps; a++)
+	{
+		// Get the data to write (the directory after all lumps)
+		MemChunk dir;
+		const uint8_t* data;
+		uint32_t size;
+		if (a < num_lumps)
+		{
+			ArchiveEntry* entry = getEntry(a);
+			size = entry->getSize();
+			offsets[a] = entry->hasOffset() ? getEntryOffset(entry) : 0;
+			if (size == 0)
+				continue;
+			if (entry->hasOffset() &&
+			        (entry->getState() == 0 || (entry->getState() == 1 && !entry->isLoaded())))
+				continue;
+
+			// Point to identical data written earlier in this save, if any
+			uint32_t shared_offset;
+			if (sharer.find(entry, shared_offset))
+			{
+				offsets[a] = shared_offset;
+				continue;
+			}
+
+			data = entry->getData();
+		}
+		else
+		{
+			dir.reSize(num_lumps * 16);
+			for (unsigned l = 0; l < num_lumps; l++)
+			{
+				char name[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+				uint32_t offset = wxINT32_SWAP_ON_BE(offsets[l]);
+				uint32_t lsize = wxINT32_SWAP_ON_BE(getEntry(l)->getSize());
+				string ename = getEntry(l)->getName();
+				for (size_t c = 0; c < ename.length() && c < 8; c++)
+					name[c] = ename[c];
+
+				dir.write(&offset, 4);
+				dir.write(&lsize, 4);
+				dir.write(name, 8);
+			}
+			data = dir.getData();
+			size = dir.getSize();
+			if (size == 0)
+			{
+				offsets.push_back(12);
+				continue;
+			}
+		}
+
+		// Find where to write it
+		int best = -1;
+		for (unsigned h = 0; h < holes.size(); h++)
+		{
+			if (holes[h].size >= size && (best < 0 || holes[h].size < holes[best].size))
+				best = h;
+		}
+		uint64_t offset;
+		if (best >= 0)
+		{
+			offset = holes[best].offset;
+			holes[best].offset += size;
+			holes[best].size -= size;
+		}
+		else
+		{
+			offset = file_end;
+			file_end += size;
+		}
+		if (file_end > 0xFFFFFFFF)
+		{
+			Global::error = "Wad file would be larger than 4gb";
+			return false;
+		}
+
+		// Write it
+		if (file.Seek(offset) == wxInvalidOffset || file.Write(data, size) != size)
+		{
+			Global::error = "Unable to write to file, make sure there is enough disk space";
+			return false;
+		}
+		if (a < num_lumps)
+		{
+			offsets[a] = offset;
+			sharer.add(getEntry(a), offset);
 		}
+		else
+			offsets.push_back(offset);
+		written.push_back(wadspan_t(offset, size));
+		bytes_written += size;
+		if (a < num_lumps)
+			n_written++;
 	}
 
+	// Make sure everything is written before pointing the header to the new directory
+	uint32_t dir_offset = offsets[num_lumps];
+	if (!file.Flush())
+	{
+		Global::error = "Unable to write to file, make sure there is enough disk space";
+		return false;
+	}
+
+	// Write the header
+	char wad_type[4] = { 'P', 'W', 'A', 'D' };
+	if (iwad) wad_type[0] = 'I';
+	uint32_t header_lumps = wxINT32_SWAP_ON_BE(num_lumps);
+	uint32_t header_dir = wxINT32_SWAP_ON_BE(dir_offset);
+	MemChunk header;
+	header.write(wad_type, 4);
+	header.write(&header_lumps, 4);
+	header.write(&header_dir, 4);
+	if (file.Seek(0) == wxInvalidOffset || file.Write(header.getData(), 12) != 12 || !file.Flush())
+	{
+		Global::error = "Unable to write to file";
+		return false;
+	}
+	file.Close();
+
+	// Update entry offsets and used space
+	for (unsigned a = 0; a < num_lumps; a++)
+	{
+		ArchiveEntry* entry = getEntry(a);
+		entry->setOffset(offsets[a]);
+		entry->setState(0);
+	}
+	used_space.insert(used_space.end(), written.begin(), written.end());
+	dir_space = wadspan_t(dir_offset, num_lumps * 16);
+	file_size = file_end;
+
+	// Entry offsets can now be past the end of the mapped file, so remap it
+	if (data_source)
+	{
+		MemBlock* mapping = MemBlock::mapFile(filename);
+		setDataSource(mapping);
+		if (mapping)
+			mapping->release();
+	}
+
+	LOG_MESSAGE(1, "WadArchive::write: Saved %s in place, %d of %d lumps written (%s) in %ldms, %s unused",
+	            CHR(filename), n_written, num_lumps, CHR(Misc::sizeAsString((uint32_t)bytes_written)), sw.Time(),
+	            CHR(Misc::sizeAsString(getUnusedSpace())));
+
 	return true;
 }
 
@@ -551,6 +1046,13 @@ bool WadArchive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
+	// Read from the mapped file if possible
+	if (loadEntrySourceData(entry, getEntryOffset(entry)))
+	{
+		entry->setState(0);
+		return true;
+	}
+
 	// Open wadfile
 	wxFile file(filename);
 
@@ -1074,6 +1576,37 @@ string WadArchive::detectNamespace(ArchiveEntry* entry)
 	return "global";
 }
 
+/* WadArchive::findInRange
+ * Finds all entries matching the search criteria in [options] from
+ * index [first] up to (but not including) [last] using the search
+ * index, and adds them to [matches] in order. Returns false without
+ * searching if the index can't narrow down the entries to check (ie.
+ * there is no type or non-wildcard name to search for)
+ *******************************************************************/
+bool WadArchive::findInRange(search_options_t& options, int first, int last, vector<ArchiveEntry*>& matches)
+{
+	// Check the index will help
+	bool literal_name = !options.match_name.IsEmpty() && !options.match_name.Contains("*") && !options.match_name.Contains("?");
+	if (!options.match_type && !literal_name)
+		return false;
+
+	// Get matching entries within the range from the index
+	vector<ArchiveEntry*> found = getSearchIndex()->query(options.match_type, "", options.match_name, false);
+	vector< std::pair<int, ArchiveEntry*> > sorted;
+	for (unsigned a = 0; a < found.size(); a++)
+	{
+		int index = entryIndex(found[a]);
+		if (index >= first && index < last)
+			sorted.push_back(std::make_pair(index, found[a]));
+	}
+	std::sort(sorted.begin(), sorted.end());
+
+	for (unsigned a = 0; a < sorted.size(); a++)
+		matches.push_back(sorted[a].second);
+
+	return true;
+}
+
 /* WadArchive::findFirst
  * Returns the first entry matching the search criteria in [options],
  * or NULL if no matching entry was found
@@ -1110,6 +1643,13 @@ ArchiveEntry* WadArchive::findFirst(search_options_t& options)
 			return NULL;
 	}
 
+	// Use the search index if possible
+	vector<ArchiveEntry*> matches;
+	int first = start ? entryIndex(start) : numEntries();
+	int last = end ? entryIndex(end) : numEntries();
+	if (findInRange(options, first, last, matches))
+		return matches.empty() ? NULL : matches.front();
+
 	// Begin search
 	ArchiveEntry* entry = start;
 	while (entry != end)
@@ -1190,6 +1730,13 @@ ArchiveEntry* WadArchive::findLast(search_options_t& options)
 			return NULL;
 	}
 
+	// Use the search index if possible
+	vector<ArchiveEntry*> matches;
+	int first = end ? entryIndex(end) + 1 : 0;
+	int last = start ? entryIndex(start) + 1 : 0;
+	if (findInRange(options, first, last, matches))
+		return matches.empty() ? NULL : matches.back();
+
 	// Begin search
 	ArchiveEntry* entry = start;
 	while (entry != end)
@@ -1266,6 +1813,12 @@ vector<ArchiveEntry*> WadArchive::findAll(search_options_t& options)
 			return ret;
 	}
 
+	// Use the search index if possible
+	int first = start ? entryIndex(start) : numEntries();
+	int last = end ? entryIndex(end) : numEntries();
+	if (findInRange(options, first, last, ret))
+		return ret;
+
 	ArchiveEntry* entry = start;
 	while (entry != end)
 	{
@@ -1387,3 +1940,65 @@ bool WadArchive::isWadArchive(string filename)
 	// If it's passed to here it's probably a wad file
 	return true;
 }
+
+
+/*******************************************************************
+ * CONSOLE COMMANDS
+ *******************************************************************/
+
+CONSOLE_COMMAND(bench_wadentries, 0, false)
+{
+	// Get number of lumps to test with
+	long count = 100000;
+	if (args.size() > 0)
+		args[0].ToLong(&count);
+	if (count <= 0)
+		return;
+
+	// Build the test wad
+	MemChunk mc;
+	{
+		WadArchive src;
+		uint32_t value = 0;
+		for (long a = 0; a < count; a++)
+		{
+			ArchiveEntry* entry = new ArchiveEntry(S_FMT("L%07d", (int)a));
+			entry->importMem(&value, 4);
+			src.addEntry(entry);
+		}
+		src.write(mc, false);
+	}
+
+	// Open it
+	WadArchive wad;
+	wxStopWatch sw;
+	wad.open(mc);
+	long open_time = sw.Time();
+
+	// Count extra properties (sizeof(ArchiveEntry) below doesn't include
+	// heap allocations such as the name or the property list)
+	vector<ArchiveEntry*> entries;
+	wad.getEntryTreeAsList(entries);
+	unsigned n_props = 0;
+	for (unsigned a = 0; a < entries.size(); a++)
+	{
+		vector<Property> props;
+		entries[a]->exProps().allProperties(props);
+		n_props += props.size();
+	}
+
+	// Time getEntryOffset
+	const int rounds = 100;
+	uint32_t total = 0;
+	sw.Start();
+	for (int r = 0; r < rounds; r++)
+	{
+		for (unsigned a = 0; a < entries.size(); a++)
+			total += wad.getEntryOffset(entries[a]);
+	}
+	long offset_time = sw.Time();
+
+	wxLogMessage("%d lumps, opened in %dms", (int)entries.size(), (int)open_time);
+	wxLogMessage("ArchiveEntry object size: %d bytes (excluding heap), %1.2f extra properties per entry", (int)sizeof(ArchiveEntry), (double)n_props / entries.size());
+	wxLogMessage("getEntryOffset: %1.1fns per call (checksum %u)", offset_time * 1000000.0 / ((double)entries.size() * rounds), total);
+}
@@ -23,8 +23,29 @@ struct wad_ns_pair_t
 class WadArchive : public TreelessArchive
 {
 private:
+	// A region of the wad file
+	struct wadspan_t
+	{
+		uint32_t	offset;
+		uint32_t	size;
+
+		wadspan_t(uint32_t offset = 0, uint32_t size = 0) { this->offset = offset; this->size = size; }
+		bool operator<(const wadspan_t& other) const { return offset < other.offset; }
+	};
+
 	bool					iwad;
 	vector<wad_ns_pair_t>	namespaces;
+	vector<wadspan_t>		used_space;		// File regions referenced by any directory written since the file was opened
+	wadspan_t				dir_space;		// Location of the directory in the file
+	uint32_t				file_size;		// Size of the file when it was last opened or saved
+	bool					force_full_save;
+
+	void	resetUsedSpace(uint32_t dir_offset, uint32_t file_size);
+	bool	writeIncremental(string filename);
+	bool	findInRange(search_options_t& options, int first, int last, vector<ArchiveEntry*>& matches);
+
+protected:
+	bool	writesInPlace(string filename);
 
 public:
 	WadArchive();
@@ -36,6 +57,8 @@ public:
 	uint32_t	getEntryOffset(ArchiveEntry* entry);
 	void		setEntryOffset(ArchiveEntry* entry, uint32_t offset);
 	void		updateNamespaces();
+	uint32_t	getUnusedSpace();
+	bool		compact();
 
 	// Archive type info
 	string	getFileExtensionString();
@@ -45,7 +68,9 @@ public:
 	bool	open(MemChunk& mc);			// Open from MemChunk
 
 	// Writing/Saving
-	bool	write(MemChunk& mc, bool update = true);	// Write to MemChunk
+	bool	write(MemChunk& mc, bool update = true);		// Write to MemChunk
+	bool	write(wxOutputStream& out, bool update = true);	// Write to stream
+	bool	write(string filename, bool update = true);	// Write to File
 
 	// Misc
 	bool		loadEntryData(ArchiveEntry* entry);
@@ -230,13 +230,13 @@ bool WadJArchive::open(MemChunk& mc)
 		// Create & setup lump
 		ArchiveEntry* nlump = new ArchiveEntry(wxString::FromAscii(name), actualsize);
 		nlump->setLoaded(false);
-		nlump->exProp("Offset") = (int)offset;
+		nlump->setOffset(offset);
 		nlump->setState(0);
 
 		if (jaguarencrypt)
 		{
 			nlump->setEncryption(ENC_JAGUAR);
-			nlump->exProp("FullSize") = (int)size;
+			nlump->setFullSize(size);
 		}
 
 		// Add to entry list
@@ -247,16 +247,15 @@ bool WadJArchive::open(MemChunk& mc)
 	// rely on being within certain namespaces)
 	updateNamespaces();
 
-	// Detect all entry types
+	// Read all entry data
 	MemChunk edata;
+	vector<ArchiveEntry*> all_entries;
 	theSplashWindow->setProgressMessage("Detecting entry types");
 	for (size_t a = 0; a < numEntries(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_lumps)));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
+		all_entries.push_back(entry);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
@@ -266,17 +265,21 @@ bool WadJArchive::open(MemChunk& mc)
 			mc.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
 			if (entry->isEncrypted())
 			{
-				if (entry->exProps().propertyExists("FullSize")
-				        && (unsigned)(int)(entry->exProp("FullSize")) >  entry->getSize())
-					edata.reSize((int)(entry->exProp("FullSize")), true);
+				if (entry->getFullSize() > entry->getSize())
+					edata.reSize(entry->getFullSize(), true);
 				if (!JaguarDecode(edata))
 					wxLogMessage("%i: %s (following %s), did not decode properly", a, CHR(entry->getName()), a>0?CHR(getEntry(a-1)->getName()):"nothing");
 			}
 			entry->importMemChunk(edata);
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	EntryType::detectEntryTypes(all_entries);
+
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
 
 		// Unload entry data if needed
 		if (!archive_load_data)
@@ -362,7 +365,7 @@ bool WadJArchive::write(MemChunk& mc, bool update)
 		if (update)
 		{
 			entry->setState(0);
-			entry->exProp("Offset") = (int)wxINT32_SWAP_ON_LE(offset);
+			entry->setOffset(wxINT32_SWAP_ON_LE(offset));
 		}
 	}
 
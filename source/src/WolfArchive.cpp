@@ -301,7 +301,7 @@ WolfArchive::~WolfArchive()
  *******************************************************************/
 uint32_t WolfArchive::getEntryOffset(ArchiveEntry* entry)
 {
-	return uint32_t((int)entry->exProp("Offset"));
+	return entry->getOffset();
 }
 
 /* WolfArchive::setEntryOffset
@@ -309,7 +309,7 @@ uint32_t WolfArchive::getEntryOffset(ArchiveEntry* entry)
  *******************************************************************/
 void WolfArchive::setEntryOffset(ArchiveEntry* entry, uint32_t offset)
 {
-	entry->exProp("Offset") = (int)offset;
+	entry->setOffset(offset);
 }
 
 
@@ -488,7 +488,7 @@ bool WolfArchive::open(MemChunk& mc)
 			// Create & setup lump
 			ArchiveEntry* nlump = new ArchiveEntry(name, size);
 			nlump->setLoaded(false);
-			nlump->exProp("Offset") = (int)pages[d].offset;
+			nlump->setOffset(pages[d].offset);
 			nlump->setState(0);
 
 			d = e;
@@ -512,16 +512,15 @@ bool WolfArchive::open(MemChunk& mc)
 	// Cleanup
 	delete[] pages;
 
-	// Detect all entry types
+	// Read all entry data
 	MemChunk edata;
+	vector<ArchiveEntry*> all_entries;
 	theSplashWindow->setProgressMessage("Detecting entry types");
 	for (size_t a = 0; a < numEntries(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_lumps)));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
+		all_entries.push_back(entry);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
@@ -530,9 +529,14 @@ bool WolfArchive::open(MemChunk& mc)
 			mc.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
 			entry->importMemChunk(edata);
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	EntryType::detectEntryTypes(all_entries);
+
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
 
 		// Set entry to unchanged
 		entry->setState(0);
@@ -603,7 +607,7 @@ bool WolfArchive::openAudio(MemChunk& head, MemChunk& data)
 		// Create & setup lump
 		ArchiveEntry* nlump = new ArchiveEntry(name, size);
 		nlump->setLoaded(false);
-		nlump->exProp("Offset") = (int)offset;
+		nlump->setOffset(offset);
 
 		// Detect entry type
 		if (size > 0) nlump->importMemChunk(edata);
@@ -675,7 +679,7 @@ bool WolfArchive::openMaps(MemChunk& head, MemChunk& data)
 
 		ArchiveEntry* nlump = new ArchiveEntry(name, size);
 		nlump->setLoaded(false);
-		nlump->exProp("Offset") = (int)offset;
+		nlump->setOffset(offset);
 		nlump->setState(0);
 
 		// Add to entry list
@@ -695,22 +699,21 @@ bool WolfArchive::openMaps(MemChunk& head, MemChunk& data)
 			name = S_FMT("PLANE%d", i);
 			nlump = new ArchiveEntry(name, planelen[i]);
 			nlump->setLoaded(false);
-			nlump->exProp("Offset") = (int)planeofs[i];
+			nlump->setOffset(planeofs[i]);
 			nlump->setState(0);
 			getRoot()->addEntry(nlump);
 		}
 	}
 
-	// Detect all entry types
+	// Read all entry data
 	MemChunk edata;
+	vector<ArchiveEntry*> all_entries;
 	theSplashWindow->setProgressMessage("Detecting entry types");
 	for (size_t a = 0; a < numEntries(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_lumps)));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
+		all_entries.push_back(entry);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
@@ -719,9 +722,14 @@ bool WolfArchive::openMaps(MemChunk& head, MemChunk& data)
 			data.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
 			entry->importMemChunk(edata);
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	EntryType::detectEntryTypes(all_entries);
+
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
 
 		// Set entry to unchanged
 		entry->setState(0);
@@ -808,25 +816,24 @@ bool WolfArchive::openGraph(MemChunk& head, MemChunk& data, MemChunk& dict)
 		// Create & setup lump
 		ArchiveEntry* nlump = new ArchiveEntry(name, size);
 		nlump->setLoaded(false);
-		nlump->exProp("Offset") = (int)offset;
+		nlump->setOffset(offset);
 		nlump->setState(0);
 
 		// Add to entry list
 		getRoot()->addEntry(nlump);
 	}
 
-	// Detect all entry types
+	// Read all entry data
 	MemChunk edata;
 	const uint16_t* pictable;
+	vector<ArchiveEntry*> all_entries;
 	theSplashWindow->setProgressMessage("Detecting entry types");
 	for (size_t a = 0; a < numEntries(); a++)
 	{
 		//wxLogMessage(s_fmt("Entry %d/%d", a, numEntries()));
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_lumps)));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
+		all_entries.push_back(entry);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
@@ -845,9 +852,14 @@ bool WolfArchive::openGraph(MemChunk& head, MemChunk& data, MemChunk& dict)
 			size_t i = (a - WC(STARTPICS))<<1;
 			addWolfPicHeader(entry, pictable[i], pictable[i+1]);
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	EntryType::detectEntryTypes(all_entries);
+
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
+		ArchiveEntry* entry = all_entries[a];
 
 		// Set entry to unchanged
 		entry->setState(0);
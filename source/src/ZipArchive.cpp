@@ -32,11 +32,16 @@
 #include "ZipArchive.h"
 #include "WadArchive.h"
 #include "SplashWindow.h"
+#include "ThreadPool.h"
+#include "Compression.h"
+#include "Misc.h"
+#include "zlib/zlib.h"
 #include <wx/wfstream.h>
-#include <wx/zipstrm.h>
-#include <wx/ptr_scpd.h>
+#include <wx/file.h>
+#include <wx/datetime.h>
 #include <wx/filename.h>
 #include <wx/msgdlg.h>
+#include <wx/stopwatch.h>
 #include <algorithm>
 
 
@@ -44,6 +49,120 @@
  * EXTERNAL VARIABLES
  *******************************************************************/
 EXTERN_CVAR(Bool, archive_load_data)
+EXTERN_CVAR(Bool, archive_map_files)
+
+
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+CVAR(Int, zip_compression_level, 9, CVAR_SAVE)	// 0 (store only, fastest) to 9 (smallest)
+
+// Maximum amount of entry data to compress at once when writing
+const uint64_t ZIP_BATCH_SIZE = 64 * 1024 * 1024;
+
+
+/*******************************************************************
+ * FUNCTIONS
+ *******************************************************************/
+
+/* readL64
+ * Reads a little-endian 64-bit value from [data]
+ *******************************************************************/
+static uint64_t readL64(const uint8_t* data)
+{
+	uint64_t val;
+	memcpy(&val, data, 8);
+	return wxUINT64_SWAP_ON_BE(val);
+}
+
+
+/* writeL16/writeL32/writeL64
+ * Writes a little-endian value to [mc]
+ *******************************************************************/
+static void writeL16(MemChunk& mc, uint16_t val)
+{
+	val = wxUINT16_SWAP_ON_BE(val);
+	mc.write(&val, 2);
+}
+static void writeL32(MemChunk& mc, uint32_t val)
+{
+	val = wxUINT32_SWAP_ON_BE(val);
+	mc.write(&val, 4);
+}
+static void writeL64(MemChunk& mc, uint64_t val)
+{
+	val = wxUINT64_SWAP_ON_BE(val);
+	mc.write(&val, 8);
+}
+
+/* isAscii
+ * Returns true if [str] only contains 7-bit ascii characters
+ *******************************************************************/
+static bool isAscii(const char* str)
+{
+	for (; *str; str++)
+	{
+		if ((uint8_t)*str >= 0x80)
+			return false;
+	}
+
+	return true;
+}
+
+
+/*******************************************************************
+ * ZIPCOMPRESSJOB CLASS
+ *******************************************************************
+ * Compresses the data of a list of entries (for writing to a zip)
+ * on multiple threads
+ */
+class ZipCompressJob : public ThreadPool::Job
+{
+public:
+	int					level;
+	vector<ArchiveEntry*>	entries;
+	vector<MemChunk*>	results;	// NULL if the entry is to be stored uncompressed
+	vector<uint16_t>	methods;
+	vector<uint32_t>	crcs;
+
+	ZipCompressJob(int level) { this->level = level; }
+	~ZipCompressJob()
+	{
+		for (unsigned a = 0; a < results.size(); a++)
+			delete results[a];
+	}
+
+	void init()
+	{
+		results.resize(entries.size(), NULL);
+		methods.resize(entries.size(), 0);
+		crcs.resize(entries.size(), 0);
+	}
+
+	void process(unsigned index)
+	{
+		ArchiveEntry* entry = entries[index];
+		const uint8_t* data = entry->getData(false);
+		uint32_t size = entry->getSize();
+		if (size == 0)
+			return;
+
+		crcs[index] = crc32(0, data, size);
+
+		// Compress, keep the data uncompressed if it doesn't get any smaller
+		if (level > 0)
+		{
+			MemChunk* cdata = new MemChunk();
+			if (Compression::ZipDeflate(data, size, *cdata, level) && cdata->getSize() < size)
+			{
+				results[index] = cdata;
+				methods[index] = 8;
+			}
+			else
+				delete cdata;
+		}
+	}
+};
 
 
 /*******************************************************************
@@ -80,103 +199,295 @@ string ZipArchive::getFormat()
 	return "archive_zip";
 }
 
-/* ZipArchive::open
- * Reads zip data from a file
- * Returns true if successful, false otherwise
+/* ZipArchive::readDirectory
+ * Reads the zip central directory from [mc] (the full zip file data)
+ * into the zip directory list, including the offset of each entry's
+ * data in [mc]. Returns false if the zip is invalid, true otherwise
  *******************************************************************/
-bool ZipArchive::open(string filename)
+bool ZipArchive::readDirectory(MemChunk& mc)
 {
-	// Open the file
-	wxFFileInputStream in(filename);
-	if (!in.IsOk())
+	zip_dir.clear();
+	const uint8_t* data = mc.getData();
+	uint32_t size = mc.getSize();
+
+	// Find the end of central directory record, searching backwards from the end
+	// of the file as it can be followed by a comment (up to 64kb)
+	if (size < 22)
 	{
-		Global::error = "Unable to open file";
+		Global::error = "Invalid zip file";
 		return false;
 	}
+	uint32_t eocd = 0;
+	bool found = false;
+	uint32_t search_end = (size > 65535 + 22) ? size - 65535 - 22 : 0;
+	for (uint32_t a = size - 22; !found; a--)
+	{
+		if ((uint32_t)READ_L32(data, a) == 0x06054b50)
+		{
+			eocd = a;
+			found = true;
+		}
 
-	// Create zip stream
-	wxZipInputStream zip(in);
-	if (!zip.IsOk())
+		if (a == search_end)
+			break;
+	}
+	if (!found)
 	{
 		Global::error = "Invalid zip file";
 		return false;
 	}
 
-	// Stop announcements (don't want to be announcing modification due to entries being added etc)
-	setMuted(true);
+	// Read directory info
+	uint64_t num_entries = READ_L16(data, eocd + 10);
+	uint64_t dir_size = (uint32_t)READ_L32(data, eocd + 12);
+	uint64_t dir_offset = (uint32_t)READ_L32(data, eocd + 16);
+	uint32_t base = 0;
 
-	// Go through all zip entries
-	int entry_index = 0;
-	wxZipEntry* entry = zip.GetNextEntry();
-	theSplashWindow->setProgressMessage("Reading zip data");
-	while (entry)
+	// Check for a zip64 end of central directory record
+	if ((num_entries == 0xFFFF || dir_offset == 0xFFFFFFFF) && eocd >= 20 &&
+	        (uint32_t)READ_L32(data, eocd - 20) == 0x07064b50)
 	{
-		theSplashWindow->setProgress(-1.0f);
-		if (entry->GetMethod() != wxZIP_METHOD_DEFLATE && entry->GetMethod() != wxZIP_METHOD_STORE)
+		uint64_t eocd64 = readL64(data + eocd - 12);
+		if (eocd64 + 56 > size || (uint32_t)READ_L32(data, eocd64) != 0x06064b50)
 		{
-			Global::error = "Unsupported zip compression method";
-			setMuted(false);
+			Global::error = "Invalid zip file";
+			return false;
+		}
+
+		num_entries = readL64(data + eocd64 + 32);
+		dir_size = readL64(data + eocd64 + 40);
+		dir_offset = readL64(data + eocd64 + 48);
+	}
+	else if (dir_offset + dir_size < eocd)
+	{
+		// Data was prepended to the zip (eg. a self-extractor), offsets are relative to the zip start
+		base = eocd - (dir_offset + dir_size);
+	}
+
+	// Go through directory entries
+	uint64_t pos = base + dir_offset;
+	for (uint64_t a = 0; a < num_entries; a++)
+	{
+		// Check directory entry
+		if (pos + 46 > size || (uint32_t)READ_L32(data, pos) != 0x02014b50)
+		{
+			Global::error = "Invalid zip file: bad directory entry";
 			return false;
 		}
 
-		if (!entry->IsDir())
+		// Read directory entry
+		zipentry_t zentry;
+		uint16_t flags = READ_L16(data, pos + 8);
+		zentry.flags = flags;
+		zentry.method = READ_L16(data, pos + 10);
+		zentry.mod_time = (uint32_t)READ_L32(data, pos + 12);
+		zentry.crc = (uint32_t)READ_L32(data, pos + 16);
+		uint64_t csize = (uint32_t)READ_L32(data, pos + 20);
+		uint64_t usize = (uint32_t)READ_L32(data, pos + 24);
+		uint16_t name_len = READ_L16(data, pos + 28);
+		uint16_t extra_len = READ_L16(data, pos + 30);
+		uint16_t comment_len = READ_L16(data, pos + 32);
+		uint64_t local_offset = (uint32_t)READ_L32(data, pos + 42);
+		if (pos + 46 + name_len + extra_len + comment_len > size)
 		{
-			// Get the entry name as a wxFileName (so we can break it up)
-			wxFileName fn(entry->GetName(wxPATH_UNIX), wxPATH_UNIX);
+			Global::error = "Invalid zip file: bad directory entry";
+			return false;
+		}
 
-			// Create entry
-			ArchiveEntry* new_entry = new ArchiveEntry(fn.GetFullName(), entry->GetSize());
+		// Read name (utf8 if flag bit 11 is set)
+		const char* name = (const char*)data + pos + 46;
+		if (flags & 0x800)
+			zentry.name = wxString::FromUTF8(name, name_len);
+		else
+			zentry.name = wxString(name, wxConvLocal, name_len);
+		if (zentry.name.IsEmpty() && name_len > 0)
+			zentry.name = wxString::From8BitData(name, name_len);
+		zentry.dir = zentry.name.EndsWith("/");
+
+		// Read zip64 sizes/offset if needed
+		const uint8_t* extra = data + pos + 46 + name_len;
+		for (unsigned e = 0; e + 4 <= extra_len;)
+		{
+			uint16_t id = READ_L16(extra, e);
+			uint16_t len = READ_L16(extra, e + 2);
+			if (id == 0x0001)
+			{
+				unsigned z = e + 4;
+				if (usize == 0xFFFFFFFF && z + 8 <= e + 4 + len)
+				{
+					usize = readL64(extra + z);
+					z += 8;
+				}
+				if (csize == 0xFFFFFFFF && z + 8 <= e + 4 + len)
+				{
+					csize = readL64(extra + z);
+					z += 8;
+				}
+				if (local_offset == 0xFFFFFFFF && z + 8 <= e + 4 + len)
+					local_offset = readL64(extra + z);
+				break;
+			}
+			e += 4 + len;
+		}
+		pos += 46 + name_len + extra_len + comment_len;
 
-			// Setup entry info
-			new_entry->setLoaded(false);
-			new_entry->exProp("ZipIndex") = entry_index;
+		// Get entry data offset from its local header
+		local_offset += base;
+		if (local_offset + 30 > size || (uint32_t)READ_L32(data, local_offset) != 0x04034b50)
+		{
+			Global::error = S_FMT("Invalid zip file: bad local header for %s", CHR(zentry.name));
+			return false;
+		}
+		uint64_t data_offset = local_offset + 30 + READ_L16(data, local_offset + 26) + READ_L16(data, local_offset + 28);
+		if (data_offset + csize > size || usize > 0xFFFFFFFF)
+		{
+			Global::error = S_FMT("Invalid zip file: entry %s is too large", CHR(zentry.name));
+			return false;
+		}
+		zentry.offset = data_offset;
+		zentry.csize = csize;
+		zentry.usize = usize;
 
-			// Add entry and directory to directory tree
-			ArchiveTreeNode* ndir = createDir(fn.GetPath(true, wxPATH_UNIX));
-			ndir->addEntry(new_entry);
-			//zipdir_t* ndir = addDirectory(fn.GetPath(true, wxPATH_UNIX));
-			//ndir->entries.push_back(new_entry);
+		// Check the entry can be read
+		if (!zentry.dir && (flags & 0x01))
+		{
+			Global::error = "Encrypted zip entries are not supported";
+			return false;
+		}
+		if (!zentry.dir && zentry.method != 0 && zentry.method != 8)
+		{
+			Global::error = "Unsupported zip compression method";
+			return false;
+		}
 
-			// Read the data, if possible
-			if (entry->GetSize() < 250 * 1024 * 1024)
-			{
-				uint8_t* data = new uint8_t[entry->GetSize()];
-				zip.Read(data, entry->GetSize());	// Note: this is where exceedingly large files cause an exception.
-				new_entry->importMem(data, entry->GetSize());
-				new_entry->setLoaded(true);
+		zip_dir.push_back(zentry);
+	}
 
-				// Determine its type
-				EntryType::detectEntryType(new_entry);
+	return true;
+}
 
-				// Unload data if needed
-				if (!archive_load_data)
-					new_entry->unloadData();
+/* ZipArchive::readEntryData
+ * Reads [entry]'s data from [data] (its compressed data as described
+ * by [zentry]), decompressing it if needed. Stored entries become
+ * views of [data], without copying. Doesn't change the entry's state.
+ * Returns false if the data couldn't be decompressed
+ *******************************************************************/
+bool ZipArchive::readEntryData(ArchiveEntry* entry, MemChunk& data, zipentry_t& zentry)
+{
+	// Nothing to read if zero-sized
+	if (zentry.usize == 0)
+	{
+		entry->setLoaded();
+		return true;
+	}
 
-				// Clean up
-				delete[] data;
-			}
+	// Stored, just view the data
+	if (zentry.method == 0)
+		return Archive::readEntryData(entry, data, 0);
+
+	// Deflated, inflate to a new block of memory and let the entry view that
+	uint8_t* buf = new uint8_t[zentry.usize];
+	if (!Compression::ZipInflate(data.getData(), data.getSize(), buf, zentry.usize))
+	{
+		delete[] buf;
+		return false;
+	}
+	MemBlock* block = MemBlock::fromData(buf, zentry.usize);
+	MemChunk mc;
+	mc.importBlock(block);
+	block->release();
+
+	return Archive::readEntryData(entry, mc, 0);
+}
+
+/* ZipArchive::open
+ * Reads zip format data from a MemChunk
+ * Returns true if successful, false otherwise
+ *******************************************************************/
+bool ZipArchive::open(MemChunk& mc)
+{
+	// Read the zip directory
+	wxStopWatch sw;
+	if (!readDirectory(mc))
+		return false;
+
+	// The source data (a memory mapped file or the parent entry's data) is
+	// kept to read entry data from later. It may be part of a larger block,
+	// so entry data offsets need to be relative to the start of the block.
+	// If the zip was read into memory from a file, entry data is read from
+	// the file instead, rather than keeping the whole file in memory
+	if (!data_source && (filename.IsEmpty() || !wxFileExists(filename)))
+		setDataSource(mc.shareData());
+	if (data_source)
+	{
+		uint32_t base = mc.getData() - data_source->getData();
+		for (unsigned a = 0; a < zip_dir.size(); a++)
+			zip_dir[a].offset += base;
+	}
+
+	// Stop announcements (don't want to be announcing modification due to entries being added etc)
+	setMuted(true);
+
+	// If types are detected in the background, entry data isn't read here
+	// (the detector decompresses it on its own threads instead)
+	bool background = detectsInBackground();
+
+	// Go through all zip entries
+	vector<ArchiveEntry*> all_entries;
+	theSplashWindow->setProgressMessage("Reading zip data");
+	for (unsigned a = 0; a < zip_dir.size(); a++)
+	{
+		zipentry_t& zentry = zip_dir[a];
+		theSplashWindow->setProgress((float)a / (float)zip_dir.size());
+
+		// Get the entry name as a wxFileName (so we can break it up)
+		wxFileName fn(zentry.name, wxPATH_UNIX);
+
+		if (zentry.dir)
+		{
+			// Zip entry is a directory, add it to the directory tree
+			createDir(fn.GetPath(true, wxPATH_UNIX));
+			continue;
+		}
+
+		// Create entry
+		ArchiveEntry* new_entry = new ArchiveEntry(fn.GetFullName(), zentry.usize);
+
+		// Setup entry info
+		new_entry->setLoaded(false);
+		new_entry->setZipIndex(a);
+
+		// Add entry and directory to directory tree
+		ArchiveTreeNode* ndir = createDir(fn.GetPath(true, wxPATH_UNIX));
+		ndir->addEntry(new_entry);
+
+		// Read the data
+		if (!background)
+		{
+			MemChunk cdata;
+			if (data_source)
+				cdata.importBlock(data_source, zentry.offset, zentry.csize);
 			else
+				cdata.importMem(mc.getData() + zentry.offset, zentry.csize);
+			if (!readEntryData(new_entry, cdata, zentry))
 			{
-				Global::error = S_FMT("Entry too large: %s is %u mb",
-				                      CHR(entry->GetName(wxPATH_UNIX)), entry->GetSize() / (1<<20));
+				Global::error = S_FMT("Unable to decompress %s", CHR(zentry.name));
 				setMuted(false);
 				return false;
 			}
 		}
-		else
-		{
-			// Zip entry is a directory, add it to the directory tree
-			wxFileName fn(entry->GetName(wxPATH_UNIX), wxPATH_UNIX);
-			createDir(fn.GetPath(true, wxPATH_UNIX));
-			//addDirectory(fn.GetPath(true, wxPATH_UNIX));
-		}
-
-		// Go to next entry in the zip file
-		delete entry;
-		entry = zip.GetNextEntry();
-		entry_index++;
+		all_entries.push_back(new_entry);
 	}
 	theSplashWindow->forceRedraw();
+	long time_read = sw.Time();
+
+	// Detect all entry types
+	theSplashWindow->setProgressMessage("Detecting entry types");
+	detectEntryTypes(all_entries);
+	long time_detect = sw.Time() - time_read;
+
+	LOG_MESSAGE(1, "ZipArchive::open: %d entries, reading %ldms, type detection %ldms (%d threads)",
+	            (int)all_entries.size(), time_read, time_detect, ThreadPool::numThreads());
 
 	// Set all entries/directories to unmodified
 	vector<ArchiveEntry*> entry_list;
@@ -184,58 +495,59 @@ bool ZipArchive::open(string filename)
 	for (size_t a = 0; a < entry_list.size(); a++)
 		entry_list[a]->setState(0);
 
+	// Unload data if needed (it can be read back from the source data)
+	if (!archive_load_data)
+	{
+		for (size_t a = 0; a < all_entries.size(); a++)
+			all_entries[a]->unloadData();
+	}
+
 	// Enable announcements
 	setMuted(false);
 
 	// Setup variables
-	this->filename = filename;
 	setModified(false);
-	on_disk = true;
 
 	theSplashWindow->setProgressMessage("");
 
 	return true;
 }
 
-/* ZipArchive::open
- * Reads zip format data from a MemChunk
- * Returns true if successful, false otherwise
- *******************************************************************/
-bool ZipArchive::open(MemChunk& mc)
-{
-	// Write the MemChunk to a temp file
-	string tempfile = appPath("slade-temp-open.zip", DIR_TEMP);
-	mc.exportFile(tempfile);
-
-	// Load the file
-	bool success = open(tempfile);
-
-	// Clean up
-	wxRemoveFile(tempfile);
-
-	return success;
-}
-
 /* ZipArchive::write
  * Writes the zip archive to a MemChunk
  * Returns true if successful, false otherwise
  *******************************************************************/
 bool ZipArchive::write(MemChunk& mc, bool update)
 {
-	bool success = false;
-
-	// Write to a temporary file
-	string tempfile = appPath("slade-temp-write.zip", DIR_TEMP);
-	if (write(tempfile, true))
+	// Write the zip directly to the MemChunk. The current source data stays
+	// valid while writing (it is referenced by data_source), even if [mc]
+	// is what it was opened from
 	{
-		// Load file into MemChunk
-		success = mc.importFile(tempfile);
+		MemChunkOutputStream out(mc);
+		if (!writeZip(out))
+		{
+			mc.clear();
+			return false;
+		}
 	}
 
-	// Clean up
-	wxRemoveFile(tempfile);
+	// Entry zip indices will refer to the written data, so re-read its
+	// directory and load entry data from it (there's no other copy of it
+	// to read from). If that fails the entries are left as they were
+	if (update)
+	{
+		vector<zipentry_t> old_dir = zip_dir;
+		if (!readDirectory(mc))
+		{
+			zip_dir = old_dir;
+			Global::error = "Unable to read the written zip data";
+			return false;
+		}
+		setDataSource(mc);
+		updateEntryInfo();
+	}
 
-	return success;
+	return true;
 }
 
 /* ZipArchive::write
@@ -244,94 +556,371 @@ bool ZipArchive::write(MemChunk& mc, bool update)
  *******************************************************************/
 bool ZipArchive::write(string filename, bool update)
 {
-	// If we're overwriting the current file, rename it so that it can still be read while writing the 'new' file
-	string current = this->filename;
-	bool temp = false;
-	if (S_CMPNOCASE(filename, this->filename))
+	// If we're overwriting the current file, write to a temp file and replace it afterwards,
+	// so that the current file can still be read while writing the 'new' file (and any
+	// memory mapping of it stays valid)
+	string outfile = filename;
+	if (S_CMPNOCASE(filename, this->filename) && wxFileExists(filename))
+		outfile = filename + ".tmp";
+
+	// Write the zip
+	bool ok = false;
 	{
-		current = appPath("tempzip.zip", DIR_TEMP);
-		wxCopyFile(this->filename, current);
-		temp = true;
+		wxFFileOutputStream out(outfile);
+		if (!out.IsOk())
+		{
+			Global::error = "Unable to open file for saving. Make sure it isn't in use by another program.";
+			return false;
+		}
+
+		ok = writeZip(out) && out.Close();
+	}
+	if (!ok)
+	{
+		if (outfile != filename)
+			wxRemoveFile(outfile);
+		return false;
 	}
 
-	// Open the file
-	wxFFileOutputStream out(filename);
-	if (!out.IsOk())
+	// Entry zip indices will refer to the written file, so read its directory
+	// before replacing the current file. If that fails nothing is changed
+	vector<zipentry_t> old_dir = zip_dir;
+	MemChunk mc;
+	if (update)
 	{
+		bool read_ok = archive_map_files ? mc.importFileMapped(outfile) : mc.importFile(outfile);
+		if (!read_ok || !readDirectory(mc))
+		{
+			zip_dir = old_dir;
+			Global::error = "Unable to read the written zip file";
+			if (outfile != filename)
+				wxRemoveFile(outfile);
+			return false;
+		}
+	}
+
+	// Replace the current file
+	if (outfile != filename && !wxRenameFile(outfile, filename, true))
+	{
+		zip_dir = old_dir;
 		Global::error = "Unable to open file for saving. Make sure it isn't in use by another program.";
+		wxRemoveFile(outfile);
 		return false;
 	}
 
-	// Open as zip for writing
-	wxZipOutputStream zip(out, 9);
-	if (!zip.IsOk())
+	// Load entry data from the written file, through its memory mapping if
+	// it has one (otherwise from the file when needed)
+	if (update)
 	{
-		Global::error = "Unable to create zip for saving";
-		return false;
+		setDataSource(mc.isView() ? mc.getBlock() : NULL);
+		updateEntryInfo();
 	}
 
-	// Open old zip for copying, if it exists. This is used to copy any entries
-	// that have been previously saved/compressed and are unmodified, to greatly
-	// speed up zip file saving by not having to recompress unchanged entries
-	wxFFileInputStream in(current);
-	wxZipInputStream inzip(in);
+	return true;
+}
+
+/* ZipArchive::getSourceEntry
+ * Returns the zip directory info for [entry], if it is unmodified
+ * and its compressed data can be read from the archive's source data
+ * (or file). Returns NULL otherwise
+ *******************************************************************/
+ZipArchive::zipentry_t* ZipArchive::getSourceEntry(ArchiveEntry* entry)
+{
+	// Check entry is unmodified
+	if (entry->getState() > 0 || entry->getZipIndex() < 0)
+		return NULL;
+
+	// Check source data exists
+	if (!data_source && !wxFileExists(filename))
+		return NULL;
+
+	// Get zip directory info
+	int index = entry->getZipIndex();
+	if (index < 0 || (unsigned)index >= zip_dir.size() || zip_dir[index].dir)
+		return NULL;
+
+	return &zip_dir[index];
+}
+
+/* ZipArchive::writeZip
+ * Writes the zip archive to [out]. Modified entries are compressed
+ * (in batches, on multiple threads), the compressed data of any
+ * unmodified entries is copied from the archive's current file.
+ * Doesn't change the entries, see updateEntryInfo.
+ * Returns true if successful, false otherwise
+ *******************************************************************/
+bool ZipArchive::writeZip(wxOutputStream& out)
+{
+	wxStopWatch sw;
+	int level = zip_compression_level;
+	if (level < 0) level = 0;
+	if (level > 9) level = 9;
+
+	// Open the current file, if compressed data of unmodified entries needs to be read from it
+	wxFile oldfile;
+	if (!data_source && wxFileExists(filename))
+		oldfile.Open(filename);
 
-	// Get a list of all entries in the old zip
-	wxZipEntry** c_entries = new wxZipEntry*[inzip.GetTotalEntries()];
-	for (int a = 0; a < inzip.GetTotalEntries(); a++)
-		c_entries[a] = inzip.GetNextEntry();
+	// Modification time for new/modified entries
+	wxDateTime now = wxDateTime::Now();
+	uint32_t dos_now = ((now.GetYear() - 1980) << 25) | ((now.GetMonth() + 1) << 21) | (now.GetDay() << 16) |
+	                   (now.GetHour() << 11) | (now.GetMinute() << 5) | (now.GetSecond() >> 1);
 
 	// Get a linear list of all entries in the archive
 	vector<ArchiveEntry*> entries;
 	getEntryTreeAsList(entries);
 
-	// Go through all entries
-	for (size_t a = 0; a < entries.size(); a++)
+	// Go through all entries, in batches
+	vector<zipentry_t> directory;
+	uint64_t offset = 0;
+	unsigned n_compressed = 0;
+	unsigned n_copied = 0;
+	uint64_t compressed_in = 0;
+	size_t a = 0;
+	while (a < entries.size())
 	{
-		if (entries[a]->getType() == EntryType::folderType())
+		// Get the next batch of entries, up to a limited amount of data to compress
+		ZipCompressJob job(level);
+		uint64_t batch_size = 0;
+		size_t batch_end = a;
+		while (batch_end < entries.size() && batch_size < ZIP_BATCH_SIZE)
 		{
-			// If the current entry is a folder, just write a directory entry and continue
-			zip.PutNextDirEntry(entries[a]->getPath(true));
-			if (update) entries[a]->setState(0);
-			continue;
+			ArchiveEntry* entry = entries[batch_end++];
+			if (entry->getType() != EntryType::folderType() && !getSourceEntry(entry))
+			{
+				// Make sure the entry's data is loaded (can't be done from other threads)
+				entry->getMCData();
+				job.entries.push_back(entry);
+				batch_size += entry->getSize();
+			}
 		}
 
-		// Get entry zip index
-		int index = -1;
-		if (entries[a]->exProps().propertyExists("ZipIndex"))
-			index = entries[a]->exProp("ZipIndex");
+		// Compress the modified entries in the batch
+		job.init();
+		ThreadPool::run(job, job.entries.size());
+		n_compressed += job.entries.size();
+		compressed_in += batch_size;
 
-		if (!inzip.IsOk() || entries[a]->getState() > 0 || index < 0 || index >= inzip.GetTotalEntries())
+		// Write the batch
+		unsigned compressed = 0;
+		for (; a < batch_end; a++)
 		{
-			// If the current entry has been changed, or doesn't exist in the old zip,
-			// (re)compress its data and write it to the zip
-			wxZipEntry* zipentry = new wxZipEntry(entries[a]->getPath() + entries[a]->getName());
-			zip.PutNextEntry(zipentry);
-			zip.Write(entries[a]->getData(), entries[a]->getSize());
-		}
-		else
-		{
-			// If the entry is unmodified and exists in the old zip, just copy it over
-			c_entries[index]->SetName(entries[a]->getPath() + entries[a]->getName());
-			zip.CopyEntry(c_entries[index], inzip);
-			inzip.Reset();
-		}
+			ArchiveEntry* entry = entries[a];
+			zipentry_t zentry;
+			zentry.flags = 0;
+			zentry.mod_time = dos_now;
+			zentry.crc = 0;
+			zentry.csize = zentry.usize = 0;
+			zentry.method = 0;
+			zentry.dir = (entry->getType() == EntryType::folderType());
+			zentry.offset = offset;
+			const uint8_t* data = NULL;
+			MemChunk buffer;
+
+			if (zentry.dir)
+			{
+				// Folder, write a directory entry
+				zentry.name = entry->getPath(true) + "/";
+			}
+			else
+			{
+				zentry.name = entry->getPath(true);
+				zipentry_t* source = getSourceEntry(entry);
+				if (source)
+				{
+					// Unmodified, copy its compressed data over
+					zentry.flags = source->flags & 0x06;	// Only keep compression option flags
+					zentry.method = source->method;
+					zentry.mod_time = source->mod_time;
+					zentry.crc = source->crc;
+					zentry.csize = source->csize;
+					zentry.usize = source->usize;
+					if (data_source)
+						data = data_source->getData() + source->offset;
+					else if (zentry.csize > 0)
+					{
+						if (!oldfile.IsOpened() || oldfile.Seek(source->offset) == wxInvalidOffset ||
+						        !buffer.importFileStream(oldfile, source->csize) || buffer.getSize() != source->csize)
+						{
+							Global::error = S_FMT("Unable to read %s from the current file", CHR(zentry.name));
+							return false;
+						}
+						data = buffer.getData();
+					}
+					n_copied++;
+				}
+				else
+				{
+					// Modified, use compressed data from the job
+					MemChunk* cdata = job.results[compressed];
+					zentry.method = job.methods[compressed];
+					zentry.crc = job.crcs[compressed];
+					zentry.usize = entry->getSize();
+					if (cdata)
+					{
+						data = cdata->getData();
+						zentry.csize = cdata->getSize();
+					}
+					else
+					{
+						data = entry->getData();
+						zentry.csize = entry->getSize();
+					}
+					compressed++;
+				}
+			}
 
-		// Update entry info
-		if (update)
-		{
-			entries[a]->setState(0);
-			entries[a]->exProp("ZipIndex") = (int)a;
+			// Remove leading path separator
+			if (zentry.name.StartsWith("/"))
+				zentry.name.Remove(0, 1);
+
+			// Write local header and data
+			wxCharBuffer name = zentry.name.ToUTF8();
+			MemChunk header;
+			writeL32(header, 0x04034b50);
+			writeL16(header, zentry.method == 8 || zentry.dir ? 20 : 10);
+			writeL16(header, zentry.flags | (isAscii(name.data()) ? 0 : 0x800));
+			writeL16(header, zentry.method);
+			writeL32(header, zentry.mod_time);
+			writeL32(header, zentry.crc);
+			writeL32(header, zentry.csize);
+			writeL32(header, zentry.usize);
+			writeL16(header, strlen(name.data()));
+			writeL16(header, 0);
+			header.write(name.data(), strlen(name.data()));
+			out.Write(header.getData(), header.getSize());
+			if (zentry.csize > 0)
+				out.Write(data, zentry.csize);
+			if (!out.IsOk())
+			{
+				Global::error = "Error writing zip file";
+				return false;
+			}
+			offset += header.getSize() + zentry.csize;
+			if (offset > 0xFFFFFFFF)
+			{
+				Global::error = "Zip file is too large (>4gb)";
+				return false;
+			}
+
+			directory.push_back(zentry);
 		}
 	}
 
-	// Clean up
-	delete[] c_entries;
-	zip.Close();
+	// Write central directory (reserve enough space for it first, rather than growing it for every field)
+	MemChunk cdir;
+	uint32_t cdir_reserve = 22 + 76;
+	for (unsigned a = 0; a < directory.size(); a++)
+		cdir_reserve += 46 + directory[a].name.length() * 4;
+	cdir.reSize(cdir_reserve, false);
+	cdir.seek(0, SEEK_SET);
+	for (unsigned a = 0; a < directory.size(); a++)
+	{
+		zipentry_t& zentry = directory[a];
+		wxCharBuffer name = zentry.name.ToUTF8();
+		writeL32(cdir, 0x02014b50);
+		writeL16(cdir, 20);	// Version made by (MS-DOS, 2.0)
+		writeL16(cdir, zentry.method == 8 || zentry.dir ? 20 : 10);
+		writeL16(cdir, zentry.flags | (isAscii(name.data()) ? 0 : 0x800));
+		writeL16(cdir, zentry.method);
+		writeL32(cdir, zentry.mod_time);
+		writeL32(cdir, zentry.crc);
+		writeL32(cdir, zentry.csize);
+		writeL32(cdir, zentry.usize);
+		writeL16(cdir, strlen(name.data()));
+		writeL16(cdir, 0);	// Extra field length
+		writeL16(cdir, 0);	// Comment length
+		writeL16(cdir, 0);	// Disk number
+		writeL16(cdir, 0);	// Internal attributes
+		writeL32(cdir, zentry.dir ? 0x10 : 0);	// External attributes
+		writeL32(cdir, zentry.offset);
+		cdir.write(name.data(), strlen(name.data()));
+	}
+
+	// Write zip64 end of central directory record and locator, if there are too many entries for the normal one
+	uint64_t cdir_offset = offset;
+	uint32_t cdir_size = cdir.currentPos();
+	if (directory.size() >= 0xFFFF)
+	{
+		writeL32(cdir, 0x06064b50);
+		writeL64(cdir, 44);	// Size of remaining record
+		writeL16(cdir, 45);	// Version made by
+		writeL16(cdir, 45);	// Version needed
+		writeL32(cdir, 0);	// Disk number
+		writeL32(cdir, 0);	// Disk with central directory
+		writeL64(cdir, directory.size());
+		writeL64(cdir, directory.size());
+		writeL64(cdir, cdir_size);
+		writeL64(cdir, cdir_offset);
+
+		writeL32(cdir, 0x07064b50);
+		writeL32(cdir, 0);	// Disk with zip64 end record
+		writeL64(cdir, cdir_offset + cdir_size);
+		writeL32(cdir, 1);	// Number of disks
+	}
+
+	// Write end of central directory record
+	uint16_t count = directory.size() >= 0xFFFF ? 0xFFFF : directory.size();
+	writeL32(cdir, 0x06054b50);
+	writeL16(cdir, 0);	// Disk number
+	writeL16(cdir, 0);	// Disk with central directory
+	writeL16(cdir, count);
+	writeL16(cdir, count);
+	writeL32(cdir, cdir_size);
+	writeL32(cdir, cdir_offset);
+	writeL16(cdir, 0);	// Comment length
+	out.Write(cdir.getData(), cdir.currentPos());
+	if (!out.IsOk())
+	{
+		Global::error = "Error writing zip file";
+		return false;
+	}
+
+	// Log save stats
+	long time = sw.Time();
+	LOG_MESSAGE(1, "ZipArchive::write: %d entries (%d compressed at level %d, %d copied), %s in %ldms, compressing %1.1fmb/s (%d threads)",
+	            (int)entries.size(), n_compressed, level, n_copied, CHR(Misc::sizeAsString(offset + cdir.currentPos())),
+	            time, time > 0 ? (double)compressed_in / 1048576.0 / ((double)time / 1000.0) : 0.0, ThreadPool::numThreads());
 
 	return true;
 }
 
+/* ZipArchive::updateEntryInfo
+ * Sets all entries to unmodified, with zip indices referring to the
+ * zip last written by writeZip (once its directory has been read)
+ *******************************************************************/
+void ZipArchive::updateEntryInfo()
+{
+	vector<ArchiveEntry*> entries;
+	getEntryTreeAsList(entries);
+	for (size_t a = 0; a < entries.size(); a++)
+	{
+		entries[a]->setState(0);
+		if (entries[a]->getType() != EntryType::folderType())
+			entries[a]->setZipIndex(a);
+	}
+}
+
+/* ZipArchive::getCompressedEntryData
+ * Gets a view of [entry]'s data as stored in the archive's source
+ * data, without loading it, and its zip compression method (0 or 8)
+ * in [method]. Returns false if the entry is loaded or isn't in the
+ * source data
+ *******************************************************************/
+bool ZipArchive::getCompressedEntryData(ArchiveEntry* entry, MemChunk& data, uint16_t& method)
+{
+	int index = entry->getZipIndex();
+	if (!data_source || entry->isLoaded() || index < 0 || (unsigned)index >= zip_dir.size())
+		return false;
+
+	zipentry_t& zentry = zip_dir[index];
+	if (zentry.dir || zentry.usize != entry->getSize())
+		return false;
+
+	method = zentry.method;
+	return data.importBlock(data_source, zentry.offset, zentry.csize);
+}
+
 /* ZipArchive::loadEntryData
  * Loads an entry's data from the saved copy of the archive if any.
  * Returns false if the entry is invalid, doesn't belong to the
@@ -355,62 +944,39 @@ bool ZipArchive::loadEntryData(ArchiveEntry* entry)
 	}
 
 	// Check that the entry has a zip index
-	int zip_index = 0;
-	if (entry->exProps().propertyExists("ZipIndex"))
-		zip_index = entry->exProp("ZipIndex");
-	else
+	int zip_index = entry->getZipIndex();
+	if (zip_index < 0)
 	{
 		wxLogMessage("ZipArchive::loadEntryData: Entry %s has no zip entry index!", entry->getName().c_str());
 		return false;
 	}
 
-	// Open the file
-	wxFFileInputStream in(filename);
-	if (!in.IsOk())
+	// Abort if entry doesn't exist in zip (some kind of error)
+	if (zip_index < 0 || (unsigned)zip_index >= zip_dir.size() || zip_dir[zip_index].dir)
 	{
-		wxLogMessage("ZipArchive::loadEntryData: Unable to open zip file \"%s\"!", filename.c_str());
+		wxLogMessage("Error: ZipEntry for entry \"%s\" does not exist in zip", entry->getName().c_str());
 		return false;
 	}
-
-	// Create zip stream
-	wxZipInputStream zip(in);
-	if (!zip.IsOk())
+	zipentry_t& zentry = zip_dir[zip_index];
+
+	// Get the entry's compressed data, from the source data if possible
+	// (otherwise read it from the file)
+	MemChunk cdata;
+	if (data_source)
+		cdata.importBlock(data_source, zentry.offset, zentry.csize);
+	else if (!cdata.importFile(filename, zentry.offset, zentry.csize))
 	{
-		wxLogMessage("ZipArchive::loadEntryData: Invalid zip file \"%s\"!", filename.c_str());
+		wxLogMessage("ZipArchive::loadEntryData: Unable to open zip file \"%s\"!", filename.c_str());
 		return false;
 	}
 
-	// Lock entry state
-	entry->lockState();
-
-	// Skip to correct entry in zip
-	wxZipEntry* zentry = zip.GetNextEntry();
-	for (long a = 0; a < zip_index; a++)
-	{
-		delete zentry;
-		zentry = zip.GetNextEntry();
-	}
-
-	// Abort if entry doesn't exist in zip (some kind of error)
-	if (!zentry)
+	// Read the data
+	if (!readEntryData(entry, cdata, zentry))
 	{
-		wxLogMessage("Error: ZipEntry for entry \"%s\" does not exist in zip", entry->getName().c_str());
+		wxLogMessage("ZipArchive::loadEntryData: Unable to decompress entry \"%s\"", entry->getName().c_str());
 		return false;
 	}
 
-	// Read the data
-	uint8_t* data = new uint8_t[zentry->GetSize()];
-	zip.Read(data, zentry->GetSize());
-	entry->importMem(data, zentry->GetSize());
-
-	// Set the entry to loaded
-	entry->setLoaded();
-	entry->unlockState();
-
-	// Clean up
-	delete[] data;
-	delete zentry;
-
 	return true;
 }
 
@@ -3,9 +3,32 @@
 #define __ZIPARCHIVE_H__
 
 #include "Archive.h"
+class wxOutputStream;
 
 class ZipArchive : public Archive
 {
+private:
+	// Info about an entry in the zip central directory
+	struct zipentry_t
+	{
+		string		name;
+		uint32_t	offset;		// Offset of the (compressed) entry data in the zip
+		uint32_t	csize;		// Compressed size
+		uint32_t	usize;		// Uncompressed size
+		uint16_t	method;		// Compression method (0 = stored, 8 = deflated)
+		uint16_t	flags;
+		uint32_t	crc;
+		uint32_t	mod_time;	// DOS date/time
+		bool		dir;
+	};
+	vector<zipentry_t>	zip_dir;	// Indexed by entry zip index
+
+	bool		readDirectory(MemChunk& mc);
+	bool		readEntryData(ArchiveEntry* entry, MemChunk& data, zipentry_t& zentry);
+	zipentry_t*	getSourceEntry(ArchiveEntry* entry);
+	bool		writeZip(wxOutputStream& out);
+	void		updateEntryInfo();
+
 public:
 	ZipArchive();
 	~ZipArchive();
@@ -15,7 +38,6 @@ public:
 	string	getFormat();
 
 	// Opening
-	bool	open(string filename);		// Open from File
 	bool	open(MemChunk& mc);			// Open from MemChunk
 
 	// Writing/Saving
@@ -24,6 +46,7 @@ public:
 
 	// Misc
 	bool	loadEntryData(ArchiveEntry* entry);
+	bool	getCompressedEntryData(ArchiveEntry* entry, MemChunk& data, uint16_t& method);
 
 	// Entry addition/removal
 	ArchiveEntry*	addEntry(ArchiveEntry* entry, string add_namespace, bool copy = false);